@@ -0,0 +1,440 @@
+#include "ledgerstore.h"
+#include "ledgerformat.h"
+#include "ledgerloader.h"
+#include "invoiceparser.h"
+#include "hashchainverifier.h"
+#include "batchchainverifier.h"
+#include "encryptionmanager.h"
+#include "verificationcache.h"
+#include "invoicetablemodel.h"
+#include "processmemory.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QTemporaryDir>
+#include <functional>
+#include <iostream>
+#include <random>
+
+namespace {
+
+// Результат одного замера: лучшее время из нескольких повторов
+struct Measurement
+{
+    QString stage;
+    qsizetype records = 0;
+    qint64 bytes = 0;           // Обработанный объём (0 - стадия не работает с байтами)
+    qint64 bestNs = 0;
+    qint64 peakMemory = 0;      // Пиковый объём памяти процесса после замера
+};
+
+// Синтетический журнал: записи с правильной цепочкой хешей и их текст в формате JSON
+struct SyntheticLedger
+{
+    LedgerStore store;
+    QByteArray json;
+};
+
+SyntheticLedger makeLedger(qsizetype count)
+{
+    SyntheticLedger ledger;
+    ledger.store.reserve(count);
+    // Примерный размер записи в JSON, чтобы текст не перевыделялся
+    ledger.json.reserve(count * 128 + 16);
+    ledger.json.append('[');
+
+    std::mt19937_64 random(20240101);
+    HashChainVerifier hasher;
+    uchar digest[LedgerStore::HASH_SIZE];
+    char encoded[24];
+    qint64 timestamp = 1700000000;
+    for (qsizetype i = 0; i < count; ++i) {
+        const quint64 article = 1000000000ULL + random() % 9000000000ULL;
+        const qint32 quantity = qint32(1 + random() % 1000);
+        timestamp += qint64(random() % 600);
+        hasher.computeDigest(article, quantity, timestamp, i > 0 ? ledger.store.hash(i - 1) : nullptr, digest);
+        LedgerStore::encodeHash(digest, encoded);
+
+        ledger.store.append(article, quantity, timestamp, encoded, sizeof(encoded));
+        ledger.json.append(i > 0 ? ",\n" : "\n");
+        LedgerFormat::appendJsonRecord(ledger.json, article, quantity, timestamp,
+                                       QString::fromLatin1(encoded, sizeof(encoded)));
+    }
+    ledger.json.append("\n]\n");
+    ledger.store.setAllValid();
+    return ledger;
+}
+
+// Те же записи с цепочкой хешей, вычисленной другим алгоритмом
+LedgerStore rehashChain(const LedgerStore &source, LedgerStore::HashAlgorithm algorithm)
+{
+    LedgerStore chain;
+    chain.setHashAlgorithm(algorithm);
+    chain.reserve(source.size());
+
+    HashChainVerifier hasher(algorithm);
+    uchar digest[LedgerStore::HASH_SIZE];
+    char encoded[24];
+    for (qsizetype i = 0; i < source.size(); ++i) {
+        hasher.computeDigest(source.article(i), source.quantity(i), source.timestamp(i),
+                             i > 0 ? chain.hash(i - 1) : nullptr, digest);
+        LedgerStore::encodeHash(digest, encoded);
+        chain.append(source.article(i), source.quantity(i), source.timestamp(i), encoded, sizeof(encoded));
+    }
+    chain.setAllValid();
+    return chain;
+}
+
+bool writeFile(const QString &path, const QByteArray &data)
+{
+    QFile file(path);
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(data) == data.size();
+}
+
+// Загрузка файла так же, как в приложении: пачки забираются по мере готовности и собираются в одно хранилище
+bool loadLedger(const QString &path, const EncryptionManager *encryption, qsizetype expected)
+{
+    LedgerLoader loader;
+    LedgerStore records;
+    QObject::connect(&loader, &LedgerLoader::batchesReady, [&loader, &records]() {
+        for (const LedgerStore &batch : loader.takeBatches()) {
+            records.append(batch);
+        }
+    });
+    loader.start(path, encryption);
+    loader.wait();
+    for (const LedgerStore &batch : loader.takeBatches()) {
+        records.append(batch);
+    }
+    return loader.errorMessage().isEmpty() && records.size() == expected && loader.firstInvalidIndex() < 0;
+}
+
+class Benchmark
+{
+public:
+    Benchmark(int repeats, const QString &filter) : repeats(repeats), filter(filter) {}
+
+    // Замер стадии: body выполняется repeats раз, учитывается лучшее время.
+    // prepare выполняется перед каждым повтором и в замер не входит
+    void run(const QString &stage, qsizetype records, qint64 bytes,
+             const std::function<bool()> &body, const std::function<void()> &prepare = nullptr)
+    {
+        if (!filter.isEmpty() && !stage.contains(filter, Qt::CaseInsensitive)) {
+            return;
+        }
+
+        Measurement measurement;
+        measurement.stage = stage;
+        measurement.records = records;
+        measurement.bytes = bytes;
+        measurement.bestNs = -1;
+        for (int i = 0; i < repeats; ++i) {
+            if (prepare) {
+                prepare();
+            }
+            QElapsedTimer timer;
+            timer.start();
+            const bool ok = body();
+            const qint64 elapsed = timer.nsecsElapsed();
+            if (!ok) {
+                std::cerr << "Стадия завершилась с ошибкой: " << stage.toStdString()
+                          << " (" << records << " записей)" << std::endl;
+                failed = true;
+                return;
+            }
+            if (measurement.bestNs < 0 || elapsed < measurement.bestNs) {
+                measurement.bestNs = elapsed;
+            }
+        }
+        measurement.peakMemory = ProcessMemory::peakResidentBytes();
+        print(measurement);
+        results.append(measurement);
+    }
+
+    static void printHeader()
+    {
+        std::cout << QString("%1 %2 %3 %4 %5 %6 %7")
+                         .arg(QString("Стадия"), -28).arg(QString("Записей"), 10).arg(QString("МиБ"), 9)
+                         .arg(QString("мс"), 10).arg(QString("записей/с"), 13).arg(QString("МиБ/с"), 9)
+                         .arg(QString("Пик МиБ"), 9).toStdString() << std::endl;
+    }
+
+    QJsonArray toJson() const
+    {
+        QJsonArray array;
+        for (const Measurement &m : results) {
+            QJsonObject object;
+            object["stage"] = m.stage;
+            object["records"] = qint64(m.records);
+            object["bytes"] = m.bytes;
+            object["bestMs"] = double(m.bestNs) / 1e6;
+            object["recordsPerSecond"] = recordsPerSecond(m);
+            object["megabytesPerSecond"] = megabytesPerSecond(m);
+            object["peakMemoryBytes"] = m.peakMemory;
+            array.append(object);
+        }
+        return array;
+    }
+
+    bool hasFailures() const { return failed; }
+
+private:
+    static double seconds(const Measurement &m) { return qMax<double>(1e-9, double(m.bestNs) / 1e9); }
+    static double recordsPerSecond(const Measurement &m) { return double(m.records) / seconds(m); }
+    static double megabytesPerSecond(const Measurement &m) { return double(m.bytes) / (1 << 20) / seconds(m); }
+
+    static void print(const Measurement &m)
+    {
+        std::cout << QString("%1 %2 %3 %4 %5 %6 %7")
+                         .arg(m.stage, -28)
+                         .arg(m.records, 10)
+                         .arg(double(m.bytes) / (1 << 20), 9, 'f', 1)
+                         .arg(double(m.bestNs) / 1e6, 10, 'f', 2)
+                         .arg(recordsPerSecond(m), 13, 'f', 0)
+                         .arg(m.bytes > 0 ? QString::number(megabytesPerSecond(m), 'f', 1) : QString("-"), 9)
+                         .arg(double(m.peakMemory) / (1 << 20), 9, 'f', 0)
+                         .toStdString() << std::endl;
+    }
+
+    int repeats;
+    QString filter;
+    bool failed = false;
+    QList<Measurement> results;
+};
+
+// Все стадии загрузки для журнала из count записей
+void benchmarkSize(Benchmark &benchmark, qsizetype count, const EncryptionManager &encryption, const QString &directory)
+{
+    SyntheticLedger ledger = makeLedger(count);
+    const qint64 jsonSize = ledger.json.size();
+
+    // Разбор JSON
+    benchmark.run("Разбор JSON", count, jsonSize, [&]() {
+        LedgerStore parsed;
+        InvoiceParser parser(parsed);
+        for (qint64 offset = 0; offset < jsonSize; offset += EncryptionManager::STREAM_CHUNK_SIZE) {
+            if (!parser.feed(ledger.json.constData() + offset,
+                             qMin<qint64>(EncryptionManager::STREAM_CHUNK_SIZE, jsonSize - offset))) {
+                return false;
+            }
+        }
+        return parser.finish() && parsed.size() == count;
+    });
+
+    // Проверка цепочки каждым поддерживаемым алгоритмом
+    for (int i = 0; i < LedgerStore::HashAlgorithmCount; ++i) {
+        const LedgerStore::HashAlgorithm algorithm = LedgerStore::HashAlgorithm(i);
+        LedgerStore rehashed;
+        if (algorithm != LedgerStore::HashMd5) {
+            rehashed = rehashChain(ledger.store, algorithm);
+        }
+        const LedgerStore &chain = algorithm == LedgerStore::HashMd5 ? ledger.store : rehashed;
+        const QString name = LedgerStore::hashAlgorithmName(algorithm).toUpper();
+
+        benchmark.run(QString("Цепочка %1, 1 поток").arg(name), count, 0, [&]() {
+            HashChainVerifier verifier(algorithm);
+            return verifier.verifyRange(chain, 0, count, nullptr) == count;
+        });
+        benchmark.run(QString("Цепочка %1, параллельно").arg(name), count, 0, [&]() {
+            return HashChainVerifier::verifyRangeParallel(chain, 0, count, nullptr) == count;
+        });
+    }
+
+    // Пакетная проверка MD5 (multi-buffer): участки цепочки заполняют дорожки ядра
+    const QVector<const LedgerStore*> batchStores = {&ledger.store};
+    benchmark.run("Цепочка MD5, multi-buffer, 1 поток", count, 0, [&]() {
+        return BatchChainVerifier::findFirstInvalid(batchStores, 1).first() == count;
+    });
+    benchmark.run("Цепочка MD5, multi-buffer, параллельно", count, 0, [&]() {
+        return BatchChainVerifier::findFirstInvalid(batchStores).first() == count;
+    });
+
+    // Расшифровка: контейнер v2 (AES-GCM по кадрам) и формат v1 (AES-CBC)
+    QString error;
+    QByteArray encryptedV2;
+    benchmark.run("Шифрование v2", count, jsonSize, [&]() {
+        encryptedV2 = encryption.encryptV2(ledger.json, error);
+        return !encryptedV2.isEmpty();
+    });
+    if (encryptedV2.isEmpty()) {
+        encryptedV2 = encryption.encryptV2(ledger.json, error);
+    }
+    benchmark.run("Расшифровка v2", count, jsonSize, [&]() {
+        return encryption.decrypt(encryptedV2, error).size() == jsonSize;
+    });
+    benchmark.run("Расшифровка v2, потоковая", count, jsonSize, [&]() {
+        QBuffer buffer;
+        buffer.setData(encryptedV2);
+        buffer.open(QIODevice::ReadOnly);
+        qint64 received = 0;
+        const bool ok = encryption.decryptStream(&buffer, [&received](const char *, qsizetype size) {
+            received += size;
+            return true;
+        }, error);
+        return ok && received == jsonSize;
+    });
+    {
+        const QByteArray encryptedV1 = encryption.encrypt(ledger.json, error);
+        benchmark.run("Расшифровка v1 (CBC)", count, jsonSize, [&]() {
+            return encryption.decrypt(encryptedV1, error).size() == jsonSize;
+        });
+    }
+
+    // Отображение: модель получает записи пачками, представление запрашивает только видимые строки
+    QList<LedgerStore> batches;
+    benchmark.run("Модель таблицы", count, 0, [&]() {
+        LedgerStore records;
+        InvoiceTableModel model;
+        model.setRecords(&records);
+        for (const LedgerStore &batch : batches) {
+            model.beginAppendRecords(batch.size());
+            records.append(batch);
+            model.endAppendRecords();
+        }
+        // Экран с 50 строками в начале и в конце таблицы
+        qsizetype cells = 0;
+        for (int row : {0, qMax(0, model.rowCount() - 50)}) {
+            for (int r = row; r < qMin(row + 50, model.rowCount()); ++r) {
+                for (int column = 0; column < model.columnCount(); ++column) {
+                    cells += model.data(model.index(r, column)).isValid() ? 1 : 0;
+                }
+            }
+        }
+        return model.rowCount() == count && cells > 0;
+    }, [&]() {
+        // Пачки того же размера, что передаёт LedgerLoader; их подготовка в замер не входит
+        batches.clear();
+        char encoded[24];
+        for (qsizetype begin = 0; begin < count; begin += LedgerLoader::BATCH_SIZE) {
+            const qsizetype end = qMin<qsizetype>(count, begin + LedgerLoader::BATCH_SIZE);
+            LedgerStore batch;
+            batch.reserve(end - begin);
+            for (qsizetype i = begin; i < end; ++i) {
+                LedgerStore::encodeHash(ledger.store.hash(i), encoded);
+                batch.append(ledger.store.article(i), ledger.store.quantity(i), ledger.store.timestamp(i),
+                             encoded, sizeof(encoded));
+            }
+            batch.setAllValid();
+            batches.append(batch);
+        }
+    });
+    batches.clear();
+
+    // Полное открытие файла через LedgerLoader: без кэша проверки и с ним
+    const QString jsonPath = directory + QString("/ledger_%1.json").arg(count);
+    const QString encPath = directory + QString("/ledger_%1.enc").arg(count);
+    const QString ldgPath = directory + QString("/ledger_%1.ldg").arg(count);
+    if (!writeFile(jsonPath, ledger.json) || !writeFile(encPath, encryptedV2)
+        || !LedgerFormat::writeBinary(ledger.store, ldgPath, error)) {
+        std::cerr << "Не удалось записать временные файлы: " << error.toStdString() << std::endl;
+        return;
+    }
+    encryptedV2.clear();
+    ledger.json.clear();
+
+    const auto removeCache = [](const QString &path) {
+        return [path]() { QFile::remove(VerificationCache::cachePath(path)); };
+    };
+    benchmark.run("Открытие JSON", count, jsonSize, [&]() {
+        return loadLedger(jsonPath, &encryption, count);
+    }, removeCache(jsonPath));
+    benchmark.run("Открытие JSON, с кэшем", count, jsonSize, [&]() {
+        return loadLedger(jsonPath, &encryption, count);
+    });
+    benchmark.run("Открытие .enc", count, QFileInfo(encPath).size(), [&]() {
+        return loadLedger(encPath, &encryption, count);
+    }, removeCache(encPath));
+    benchmark.run("Открытие .ldg", count, QFileInfo(ldgPath).size(), [&]() {
+        return loadLedger(ldgPath, &encryption, count);
+    }, removeCache(ldgPath));
+
+    QFile::remove(jsonPath);
+    QFile::remove(encPath);
+    QFile::remove(ldgPath);
+    for (const QString &path : {jsonPath, encPath, ldgPath}) {
+        QFile::remove(VerificationCache::cachePath(path));
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("LedgerBenchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Замеры стадий загрузки файлов накладных на синтетических журналах:\n"
+                                     "разбор JSON, проверка цепочки MD5, расшифровка, модель таблицы\n"
+                                     "и полное открытие файлов JSON, .enc и .ldg.\n"
+                                     "Для 10 млн записей нужно около 5 ГиБ памяти.");
+    parser.addHelpOption();
+    const QCommandLineOption sizesOption({"s", "sizes"}, "Размеры журналов через запятую (по умолчанию 1000,10000,100000,1000000,10000000).", "list");
+    const QCommandLineOption repeatOption({"n", "repeat"}, "Повторов каждого замера; учитывается лучшее время (по умолчанию 3).", "n");
+    const QCommandLineOption filterOption({"f", "filter"}, "Выполнять только стадии, название которых содержит подстроку.", "text");
+    const QCommandLineOption outputOption({"o", "output"}, "Записать результаты в файл JSON для сравнения между версиями.", "file");
+    parser.addOptions({sizesOption, repeatOption, filterOption, outputOption});
+    parser.process(app);
+
+    // Сообщения ядра во время замеров выключены: выключенная категория не форматирует сообщения
+    QLoggingCategory::setFilterRules("ledger.*.debug=false\nledger.*.info=false");
+
+    QList<qsizetype> sizes;
+    const QString sizesText = parser.isSet(sizesOption) ? parser.value(sizesOption) : QString("1000,10000,100000,1000000,10000000");
+    for (const QString &item : sizesText.split(',', Qt::SkipEmptyParts)) {
+        bool ok = false;
+        const qlonglong size = item.trimmed().toLongLong(&ok);
+        if (!ok || size <= 0) {
+            std::cerr << "Некорректный размер журнала: " << item.toStdString() << std::endl;
+            return 2;
+        }
+        sizes.append(qsizetype(size));
+    }
+
+    int repeats = 3;
+    if (parser.isSet(repeatOption)) {
+        bool ok = false;
+        repeats = parser.value(repeatOption).toInt(&ok);
+        if (!ok || repeats <= 0) {
+            std::cerr << "Некорректное число повторов: " << parser.value(repeatOption).toStdString() << std::endl;
+            return 2;
+        }
+    }
+
+    // Ключ фиксированный: замеры не зависят от файла конфигурации
+    EncryptionManager encryption;
+    encryption.setKey(QByteArray(32, '\x5a'));
+
+    QTemporaryDir directory;
+    if (!directory.isValid()) {
+        std::cerr << "Не удалось создать временный каталог." << std::endl;
+        return 2;
+    }
+
+    Benchmark benchmark(repeats, parser.value(filterOption));
+    Benchmark::printHeader();
+    for (qsizetype size : sizes) {
+        benchmarkSize(benchmark, size, encryption, directory.path());
+    }
+
+    if (parser.isSet(outputOption)) {
+        QJsonObject report;
+        report["repeats"] = repeats;
+        report["results"] = benchmark.toJson();
+        QFile output(parser.value(outputOption));
+        const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) || output.write(json) != json.size()) {
+            std::cerr << "Не удалось записать результаты: " << output.errorString().toStdString() << std::endl;
+            return 2;
+        }
+    }
+
+    return benchmark.hasFailures() ? 1 : 0;
+}
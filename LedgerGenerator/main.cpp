@@ -0,0 +1,338 @@
+#include "ledgerstore.h"
+#include "ledgerformat.h"
+#include "hashchainverifier.h"
+#include "encryptionmanager.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+namespace {
+
+// Поле, которое искажается в подделанных записях
+enum TamperField {
+    TamperArticle,
+    TamperQuantity,
+    TamperTimestamp,
+    TamperHash
+};
+
+// Параметры генерации
+struct GeneratorOptions
+{
+    qint64 count = 0;
+    bool binary = false;
+    quint64 seed = 1;
+    qint64 startTime = 1700000000;
+    qint64 tamperAt = -1;           // Первая подделанная запись (-1 - без подделки)
+    qint64 tamperCount = 0;
+    qint64 tamperStep = 1;          // Расстояние между подделанными записями
+    TamperField tamperField = TamperQuantity;
+    LedgerStore::HashAlgorithm hashAlgorithm = LedgerStore::HashMd5;
+};
+
+// Потоковый генератор журнала: записи создаются порциями по CHUNK_RECORDS и сразу
+// сериализуются, поэтому память не зависит от числа записей. Цепочка хешей вычисляется
+// по исходным значениям, а в подделанных записях затем искажается одно поле - как если бы
+// запись изменили в готовом файле, не пересчитав хеши
+class LedgerGenerator
+{
+public:
+    static const int CHUNK_RECORDS = 16384;
+
+    explicit LedgerGenerator(const GeneratorOptions &options)
+        : options(options)
+        , random(options.seed)
+        , hasher(options.hashAlgorithm)
+        , timestamp(options.startTime)
+        , next(0)
+        , offset(0)
+        , finished(false)
+    {
+        if (options.binary) {
+            chunk.resize(LedgerFormat::HEADER_SIZE);
+            LedgerFormat::encodeHeader(reinterpret_cast<uchar*>(chunk.data()), quint64(options.count),
+                                       quint32(options.hashAlgorithm));
+        } else {
+            chunk = "[";
+            if (options.hashAlgorithm != LedgerStore::HashMd5) {
+                chunk.append("\n");
+                LedgerFormat::appendJsonHeader(chunk, LedgerStore::hashAlgorithmName(options.hashAlgorithm));
+            }
+        }
+    }
+
+    // Источник для записи в файл и для EncryptionManager::encryptStream
+    qsizetype read(char *buffer, qsizetype capacity)
+    {
+        qsizetype written = 0;
+        while (written < capacity) {
+            if (offset == chunk.size()) {
+                if (finished) {
+                    break;
+                }
+                produceChunk();
+            }
+            const qsizetype length = qMin<qsizetype>(capacity - written, chunk.size() - offset);
+            std::memcpy(buffer + written, chunk.constData() + offset, size_t(length));
+            written += length;
+            offset += length;
+        }
+        return written;
+    }
+
+    qint64 recordCount() const { return next; }
+
+private:
+    bool isTampered(qint64 index) const
+    {
+        return options.tamperAt >= 0 && index >= options.tamperAt
+            && (index - options.tamperAt) % options.tamperStep == 0
+            && (index - options.tamperAt) / options.tamperStep < options.tamperCount;
+    }
+
+    void produceChunk()
+    {
+        // Размер порции не меняется, поэтому буфер выделяется один раз
+        chunk.resize(0);
+        offset = 0;
+        const qint64 end = qMin<qint64>(options.count, next + CHUNK_RECORDS);
+        chunk.reserve((end - next) * (options.binary ? LedgerFormat::RECORD_SIZE : 160) + 8);
+
+        uchar digest[LedgerStore::HASH_SIZE];
+        char encoded[24];
+        for (; next < end; ++next) {
+            quint64 article = 1000000000ULL + random() % 9000000000ULL;
+            qint32 quantity = qint32(1 + random() % 1000);
+            timestamp += qint64(random() % 600);
+            hasher.computeDigest(article, quantity, timestamp, next > 0 ? lastDigest : nullptr, digest);
+            std::memcpy(lastDigest, digest, LedgerStore::HASH_SIZE);
+
+            qint64 storedTimestamp = timestamp;
+            if (isTampered(next)) {
+                // Искажённое значение остаётся допустимым, чтобы запись не отбрасывалась при разборе
+                switch (options.tamperField) {
+                case TamperArticle:
+                    article = article == 9999999999ULL ? article - 1 : article + 1;
+                    break;
+                case TamperQuantity:
+                    quantity = quantity + 1;
+                    break;
+                case TamperTimestamp:
+                    storedTimestamp = timestamp + 1;
+                    break;
+                case TamperHash:
+                    digest[0] ^= 0x01;
+                    break;
+                }
+            }
+
+            if (options.binary) {
+                const qsizetype position = chunk.size();
+                chunk.resize(position + LedgerFormat::RECORD_SIZE);
+                LedgerFormat::encodeRecord(reinterpret_cast<uchar*>(chunk.data()) + position,
+                                           article, quantity, storedTimestamp, 0, digest);
+            } else {
+                LedgerStore::encodeHash(digest, encoded);
+                const bool hasHeader = options.hashAlgorithm != LedgerStore::HashMd5;
+                chunk.append(next > 0 || hasHeader ? ",\n" : "\n");
+                LedgerFormat::appendJsonRecord(chunk, article, quantity, storedTimestamp,
+                                               QString::fromLatin1(encoded, sizeof(encoded)));
+            }
+        }
+
+        if (next == options.count) {
+            finished = true;
+            if (!options.binary) {
+                chunk.append("\n]\n");
+            }
+        }
+    }
+
+    GeneratorOptions options;
+    std::mt19937_64 random;
+    HashChainVerifier hasher;
+    uchar lastDigest[LedgerStore::HASH_SIZE];
+    qint64 timestamp;
+    qint64 next;            // Номер следующей создаваемой записи
+    QByteArray chunk;       // Сериализованная порция записей
+    qsizetype offset;       // Уже отданная часть порции
+    bool finished;
+};
+
+// Ключ из --key или, как в приложении, config/encryption.key рядом с исполняемым файлом и выше
+bool loadKey(EncryptionManager &encryption, const QString &keyPath, QString &errorMessage)
+{
+    if (!keyPath.isEmpty()) {
+        return encryption.loadKeyFromFile(keyPath, errorMessage);
+    }
+    QDir dir(QCoreApplication::applicationDirPath());
+    for (int i = 0; i < 5; ++i) {
+        const QString candidate = dir.filePath("config/encryption.key");
+        if (QFile::exists(candidate) && encryption.loadKeyFromFile(candidate, errorMessage)) {
+            return true;
+        }
+        if (!dir.cdUp()) {
+            break;
+        }
+    }
+    if (errorMessage.isEmpty()) {
+        errorMessage = QString("Файл config/encryption.key не найден.");
+    }
+    return false;
+}
+
+bool parseInteger(const QCommandLineParser &parser, const QCommandLineOption &option, qint64 minimum, qint64 &value)
+{
+    if (!parser.isSet(option)) {
+        return true;
+    }
+    bool ok = false;
+    value = parser.value(option).toLongLong(&ok);
+    if (!ok || value < minimum) {
+        std::cerr << "Некорректное значение параметра --" << option.names().last().toStdString()
+                  << ": " << parser.value(option).toStdString() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("LedgerGenerator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Создание синтетического файла накладных с правильной цепочкой хешей.\n"
+                                     "Формат определяется по расширению: .json, .ldg или .enc (JSON в зашифрованном виде).\n"
+                                     "Подделка (--tamper-at) искажает поле записей без пересчёта хешей; "
+                                     "первая подделанная запись - первая невалидная при проверке.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("output", "Создаваемый файл.", "<файл>");
+    const QCommandLineOption countOption({"n", "count"}, "Число записей.", "n");
+    const QCommandLineOption seedOption("seed", "Начальное значение генератора случайных чисел (по умолчанию 1).", "n");
+    const QCommandLineOption startTimeOption("start-time", "Timestamp первой записи (по умолчанию 1700000000).", "t");
+    const QCommandLineOption keyOption({"k", "key"}, "Файл ключа шифрования для .enc.", "file");
+    const QCommandLineOption containerOption("container", "Формат шифрования .enc: v2 (кадры AES-GCM, по умолчанию) "
+                                                          "или v1 (AES-CBC, как EncryptionManager::encrypt).", "v1|v2", "v2");
+    const QCommandLineOption tamperAtOption("tamper-at", "Номер первой подделанной записи (с нуля).", "index");
+    const QCommandLineOption tamperCountOption("tamper-count", "Число подделанных записей (по умолчанию 1).", "n");
+    const QCommandLineOption tamperStepOption("tamper-step", "Расстояние между подделанными записями (по умолчанию 1).", "n");
+    const QCommandLineOption tamperFieldOption("tamper-field", "Искажаемое поле: article, quantity, timestamp или hash "
+                                                               "(по умолчанию quantity).", "field", "quantity");
+    const QCommandLineOption hashOption("hash", "Алгоритм цепочки хешей: md5 (по умолчанию), sha256 или blake2s.",
+                                        "algorithm", "md5");
+    parser.addOptions({countOption, seedOption, startTimeOption, keyOption, containerOption,
+                       tamperAtOption, tamperCountOption, tamperStepOption, tamperFieldOption, hashOption});
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1 || !parser.isSet(countOption)) {
+        parser.showHelp(2);
+    }
+    const QString outputPath = parser.positionalArguments().first();
+    const QString suffix = QFileInfo(outputPath).suffix().toLower();
+
+    GeneratorOptions options;
+    options.binary = suffix == "ldg";
+    qint64 seed = 1;
+    if (!parseInteger(parser, countOption, 0, options.count)
+        || !parseInteger(parser, seedOption, 0, seed)
+        || !parseInteger(parser, startTimeOption, 1, options.startTime)
+        || !parseInteger(parser, tamperAtOption, 0, options.tamperAt)
+        || !parseInteger(parser, tamperStepOption, 1, options.tamperStep)) {
+        return 2;
+    }
+    options.seed = quint64(seed);
+    if (options.tamperAt >= 0) {
+        options.tamperCount = 1;
+        if (!parseInteger(parser, tamperCountOption, 1, options.tamperCount)) {
+            return 2;
+        }
+    }
+
+    const QString field = parser.value(tamperFieldOption);
+    if (field == "article") {
+        options.tamperField = TamperArticle;
+    } else if (field == "quantity") {
+        options.tamperField = TamperQuantity;
+    } else if (field == "timestamp") {
+        options.tamperField = TamperTimestamp;
+    } else if (field == "hash") {
+        options.tamperField = TamperHash;
+    } else {
+        std::cerr << "Неизвестное поле для подделки: " << field.toStdString() << std::endl;
+        return 2;
+    }
+    if (!LedgerStore::parseHashAlgorithm(parser.value(hashOption), options.hashAlgorithm)) {
+        std::cerr << "Неизвестный алгоритм цепочки хешей: " << parser.value(hashOption).toStdString() << std::endl;
+        return 2;
+    }
+
+    EncryptionManager encryption;
+    EncryptionManager::FormatVersion container = EncryptionManager::FormatPlain;
+    if (suffix == "enc") {
+        container = parser.value(containerOption) == "v1" ? EncryptionManager::FormatV1 : EncryptionManager::FormatV2;
+        QString keyError;
+        if (!loadKey(encryption, parser.value(keyOption), keyError)) {
+            std::cerr << "Не удалось загрузить ключ шифрования: " << keyError.toStdString() << std::endl;
+            return 2;
+        }
+    }
+
+    // Файл появляется только после успешного завершения записи
+    QSaveFile output(outputPath);
+    if (!output.open(QIODevice::WriteOnly)) {
+        std::cerr << "Не удалось создать файл: " << output.errorString().toStdString() << std::endl;
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    LedgerGenerator generator(options);
+    QString errorMessage;
+    bool success = true;
+    if (container != EncryptionManager::FormatPlain) {
+        success = encryption.encryptStream([&generator](char *buffer, qsizetype capacity) {
+            return generator.read(buffer, capacity);
+        }, &output, errorMessage, container);
+    } else {
+        QByteArray buffer(EncryptionManager::STREAM_CHUNK_SIZE * 4, Qt::Uninitialized);
+        for (qsizetype length; success && (length = generator.read(buffer.data(), buffer.size())) > 0; ) {
+            if (output.write(buffer.constData(), length) != length) {
+                errorMessage = QString("Ошибка записи файла: %1").arg(output.errorString());
+                success = false;
+            }
+        }
+    }
+    if (success && !output.commit()) {
+        errorMessage = QString("Ошибка записи файла: %1").arg(output.errorString());
+        success = false;
+    }
+    if (!success) {
+        output.cancelWriting();
+        std::cerr << errorMessage.toStdString() << std::endl;
+        return 1;
+    }
+
+    const double seconds = qMax(1e-9, double(timer.nsecsElapsed()) / 1e9);
+    const qint64 size = QFileInfo(outputPath).size();
+    std::cerr << QString("Записей: %1, размер: %2 МиБ, время: %3 с (%4 записей/с, %5 МиБ/с)")
+                     .arg(generator.recordCount())
+                     .arg(double(size) / (1 << 20), 0, 'f', 1)
+                     .arg(seconds, 0, 'f', 2)
+                     .arg(double(generator.recordCount()) / seconds, 0, 'f', 0)
+                     .arg(double(size) / (1 << 20) / seconds, 0, 'f', 1)
+                     .toStdString() << std::endl;
+    if (options.tamperAt >= 0 && options.tamperAt < options.count) {
+        std::cerr << "Первая подделанная запись: " << options.tamperAt << std::endl;
+    }
+    return 0;
+}
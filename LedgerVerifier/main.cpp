@@ -0,0 +1,536 @@
+#include "ledgerloader.h"
+#include "encryptionmanager.h"
+#include "merkletree.h"
+#include "batchchainverifier.h"
+#include "md5multibuffer.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QThread>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace {
+
+// Коды завершения: по ним результат проверки различают сценарии cron и CI
+enum ExitCode {
+    ExitValid = 0,      // Все файлы загружены, цепочки целы
+    ExitInvalid = 1,    // Есть файлы с нарушенной цепочкой
+    ExitError = 2,      // Есть файлы, которые не удалось загрузить
+    ExitUsage = 3       // Неверные аргументы
+};
+
+// Режим дерева Меркла (<файл>.merkle): не используется, сверка с деревом или его построение
+enum MerkleMode {
+    MerkleOff,
+    MerkleVerify,
+    MerkleBuild
+};
+
+// Результат сверки с деревом Меркла
+struct MerkleResult
+{
+    QString status;                 // valid, tampered, missing, built или error
+    QString error;
+    qsizetype leaves = 0;
+    QByteArray root;
+    QVector<qsizetype> tampered;    // Записи, лист которых не совпал с деревом
+    qsizetype uncovered = 0;        // Записи после последнего листа (дописаны после построения дерева)
+    qsizetype missing = 0;          // Листья без записей (файл усечён)
+    // Доказательство для одной записи (--prove): её лист, хеши соседей от листа к корню
+    // и результат проверки доказательства по сохранённому корню
+    qsizetype proofIndex = -1;
+    QByteArray proofLeaf;
+    QByteArray proof;
+    bool proofValid = false;
+    QString proofError;
+};
+
+// Результат проверки одного файла
+struct FileResult
+{
+    QString path;
+    bool loaded = false;
+    QString error;
+    qint64 fileSize = 0;
+    qsizetype records = 0;
+    qsizetype rejected = 0;
+    qsizetype firstInvalid = -1;
+    qint64 elapsedNs = 0;
+    QJsonObject stats;          // Статистика загрузчика: стадии, причины отбрасывания, память
+    MerkleResult merkle;
+};
+
+// Построение дерева по записям файла или сверка записей с сохранённым деревом.
+// proveIndex >= 0 - при сверке построить и проверить доказательство для этой записи
+MerkleResult processMerkle(const QString &path, const LedgerStore &records, MerkleMode mode, qsizetype proveIndex)
+{
+    MerkleResult result;
+    const QString treePath = MerkleTree::sidecarPath(path);
+    MerkleTree tree;
+
+    if (mode == MerkleBuild) {
+        tree.build(records);
+        result.status = tree.save(treePath, result.error) ? "built" : "error";
+        result.leaves = tree.leafCount();
+        result.root = tree.root();
+        return result;
+    }
+
+    if (!QFile::exists(treePath)) {
+        result.status = "missing";
+        return result;
+    }
+    if (!tree.load(treePath, result.error)) {
+        result.status = "error";
+        return result;
+    }
+
+    result.leaves = tree.leafCount();
+    result.root = tree.root();
+    result.tampered = tree.findTampered(records);
+    result.uncovered = qMax<qsizetype>(0, records.size() - tree.leafCount());
+    result.missing = qMax<qsizetype>(0, tree.leafCount() - records.size());
+    result.status = result.tampered.isEmpty() && result.missing == 0 ? "valid" : "tampered";
+
+    if (proveIndex >= 0) {
+        result.proofIndex = proveIndex;
+        if (proveIndex >= tree.leafCount() || proveIndex >= records.size()) {
+            result.proofError = QString("Запись %1 не покрыта деревом Меркла.").arg(proveIndex);
+        } else {
+            // Лист вычисляется по записи из файла: доказательство сходится к сохранённому корню,
+            // только если запись не изменилась после построения дерева
+            result.proofLeaf.resize(MerkleTree::DIGEST_SIZE);
+            MerkleTree::leafDigest(records, proveIndex, reinterpret_cast<uchar*>(result.proofLeaf.data()));
+            result.proof = tree.proof(proveIndex);
+            result.proofValid = MerkleTree::verifyProof(reinterpret_cast<const uchar*>(result.proofLeaf.constData()),
+                                                        proveIndex, tree.leafCount(), result.proof, result.root);
+        }
+    }
+    return result;
+}
+
+// Загрузка файла. Записи собираются в records, только если collectRecords: без них пачки
+// освобождаются сразу в потоке проверки, чтобы память не росла с размером файла.
+// Без verifyChain цепочку загрузчик не проверяет - это делает вызывающий по records.
+// Кэш проверки <файл>.vcache используется только при useCache (--cache): по умолчанию утилита
+// проверяет каждую цепочку полностью и не создаёт файлов рядом с проверяемыми
+FileResult loadFile(const QString &path, const EncryptionManager *encryption, bool collectRecords, bool verifyChain,
+                    bool useCache, LedgerStore &records)
+{
+    FileResult result;
+    result.path = path;
+    result.fileSize = QFileInfo(path).size();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    LedgerLoader loader;
+    loader.setChainVerification(verifyChain);
+    loader.setCacheEnabled(useCache);
+    auto collect = [&loader, &records, collectRecords]() {
+        const QList<LedgerStore> batches = loader.takeBatches();
+        if (collectRecords) {
+            for (const LedgerStore &batch : batches) {
+                records.append(batch);
+            }
+        }
+    };
+    QObject::connect(&loader, &LedgerLoader::batchesReady, collect);
+    loader.start(path, encryption);
+    loader.wait();
+    collect();
+
+    result.elapsedNs = timer.nsecsElapsed();
+    result.loaded = loader.errorMessage().isEmpty();
+    result.error = loader.errorMessage();
+    result.records = loader.recordCount();
+    result.rejected = loader.rejectedCount();
+    result.firstInvalid = loader.firstInvalidIndex();
+    result.stats = loader.statsJson();
+    return result;
+}
+
+// Сверка с деревом Меркла или его построение по загруженным записям
+void finishMerkle(FileResult &result, const LedgerStore &records, MerkleMode merkleMode, qsizetype proveIndex)
+{
+    if (merkleMode == MerkleBuild && result.loaded && result.firstInvalid >= 0) {
+        // Дерево, построенное по изменённым записям, узаконило бы изменения
+        result.merkle.status = "error";
+        result.merkle.error = QString("Цепочка хешей нарушена, дерево Меркла не построено.");
+    } else if (merkleMode != MerkleOff && result.loaded) {
+        result.merkle = processMerkle(result.path, records, merkleMode, proveIndex);
+    }
+}
+
+FileResult verifyFile(const QString &path, const EncryptionManager *encryption, MerkleMode merkleMode,
+                      qsizetype proveIndex, bool useCache)
+{
+    LedgerStore records;
+    FileResult result = loadFile(path, encryption, merkleMode != MerkleOff, true, useCache, records);
+    finishMerkle(result, records, merkleMode, proveIndex);
+    return result;
+}
+
+// Режим --multi-buffer: файлы обрабатываются группами. Файлы группы загружаются параллельно
+// без проверки цепочки, затем цепочки всей группы проверяются одним вызовом BatchChainVerifier,
+// который вычисляет MD5 звеньев разных файлов одновременно на дорожках Md5MultiBuffer.
+// Записи группы находятся в памяти до конца её проверки
+qint64 verifyGroup(const QStringList &files, qsizetype begin, qsizetype end, const EncryptionManager *encryption,
+                   MerkleMode merkleMode, qsizetype proveIndex, int jobs, std::vector<FileResult> &results)
+{
+    const qsizetype count = end - begin;
+    std::vector<LedgerStore> records(count);
+    std::atomic<qsizetype> nextFile(0);
+
+    std::vector<std::unique_ptr<QThread>> workers;
+    for (int i = 0; i < int(qMin<qsizetype>(jobs, count)); ++i) {
+        workers.emplace_back(QThread::create([&, begin, count]() {
+            for (qsizetype index = nextFile++; index < count; index = nextFile++) {
+                results[begin + index] = loadFile(files.at(begin + index), encryption, true, false, false, records[index]);
+            }
+        }));
+        workers.back()->start();
+    }
+    for (const std::unique_ptr<QThread> &worker : workers) {
+        worker->wait();
+    }
+
+    QVector<const LedgerStore*> stores;
+    for (qsizetype index = 0; index < count; ++index) {
+        if (results[begin + index].loaded) {
+            stores.append(&records[index]);
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QVector<qsizetype> firstInvalid = BatchChainVerifier::findFirstInvalid(stores, jobs);
+    const qint64 verifyNs = timer.nsecsElapsed();
+
+    int position = 0;
+    for (qsizetype index = 0; index < count; ++index) {
+        FileResult &result = results[begin + index];
+        if (!result.loaded) {
+            continue;
+        }
+        const qsizetype mismatch = firstInvalid.at(position++);
+        result.firstInvalid = mismatch < records[index].size() ? mismatch : -1;
+        result.stats["firstInvalidIndex"] = qint64(result.firstInvalid);
+        finishMerkle(result, records[index], merkleMode, proveIndex);
+        records[index].clear();
+    }
+    return verifyNs;
+}
+
+// Файлы накладных из аргументов: каталоги раскрываются в *.json, *.enc и *.ldg
+QStringList collectFiles(const QStringList &paths, bool recursive, QStringList &missing)
+{
+    const QStringList filters = {"*.json", "*.enc", "*.ldg"};
+    QStringList files;
+    for (const QString &path : paths) {
+        const QFileInfo info(path);
+        if (info.isDir()) {
+            QStringList found;
+            QDirIterator it(path, filters, QDir::Files,
+                            recursive ? QDirIterator::Subdirectories : QDirIterator::NoIteratorFlags);
+            while (it.hasNext()) {
+                found.append(it.next());
+            }
+            found.sort();
+            files.append(found);
+        } else if (info.isFile()) {
+            files.append(path);
+        } else {
+            missing.append(path);
+        }
+    }
+    return files;
+}
+
+// Ключ из --key или, как в приложении, config/encryption.key рядом с исполняемым файлом и выше
+bool loadKey(EncryptionManager &encryption, const QString &keyPath, QString &errorMessage)
+{
+    if (!keyPath.isEmpty()) {
+        return encryption.loadKeyFromFile(keyPath, errorMessage);
+    }
+    QDir dir(QCoreApplication::applicationDirPath());
+    for (int i = 0; i < 5; ++i) {
+        const QString candidate = dir.filePath("config/encryption.key");
+        if (QFile::exists(candidate) && encryption.loadKeyFromFile(candidate, errorMessage)) {
+            return true;
+        }
+        if (!dir.cdUp()) {
+            break;
+        }
+    }
+    return false;
+}
+
+const qsizetype MAX_REPORTED_TAMPERED = 1000;
+
+double toMilliseconds(qint64 ns)
+{
+    return double(ns) / 1e6;
+}
+
+// Итог проверки файла: error, invalid или valid. Изменения, найденные деревом Меркла, делают файл
+// недействительным так же, как нарушенная цепочка; по этому же итогу считается сводка
+QString fileStatus(const FileResult &result)
+{
+    if (!result.loaded || result.merkle.status == "error") {
+        return "error";
+    }
+    return result.firstInvalid >= 0 || result.merkle.status == "tampered" ? "invalid" : "valid";
+}
+
+QJsonObject toJson(const FileResult &result)
+{
+    QJsonObject object;
+    object["path"] = result.path;
+    object["status"] = fileStatus(result);
+    object["bytes"] = result.fileSize;
+    object["records"] = qint64(result.records);
+    object["rejected"] = qint64(result.rejected);
+    object["firstInvalidIndex"] = qint64(result.firstInvalid);
+    object["elapsedMs"] = toMilliseconds(result.elapsedNs);
+    if (!result.loaded) {
+        object["error"] = result.error;
+    }
+    object["stats"] = result.stats;
+    if (!result.merkle.status.isEmpty()) {
+        QJsonObject merkle;
+        merkle["status"] = result.merkle.status;
+        merkle["leaves"] = qint64(result.merkle.leaves);
+        merkle["root"] = QString::fromLatin1(result.merkle.root.toHex());
+        merkle["tamperedCount"] = qint64(result.merkle.tampered.size());
+        // Список изменённых записей ограничен, чтобы отчёт по сильно повреждённому файлу оставался читаемым
+        QJsonArray tampered;
+        for (qsizetype i = 0; i < qMin<qsizetype>(result.merkle.tampered.size(), MAX_REPORTED_TAMPERED); ++i) {
+            tampered.append(qint64(result.merkle.tampered.at(i)));
+        }
+        merkle["tampered"] = tampered;
+        merkle["uncoveredRecords"] = qint64(result.merkle.uncovered);
+        merkle["missingRecords"] = qint64(result.merkle.missing);
+        if (!result.merkle.error.isEmpty()) {
+            merkle["error"] = result.merkle.error;
+        }
+        if (result.merkle.proofIndex >= 0) {
+            QJsonObject proof;
+            proof["index"] = qint64(result.merkle.proofIndex);
+            if (result.merkle.proofError.isEmpty()) {
+                proof["leaf"] = QString::fromLatin1(result.merkle.proofLeaf.toHex());
+                QJsonArray siblings;
+                for (qsizetype offset = 0; offset < result.merkle.proof.size(); offset += MerkleTree::DIGEST_SIZE) {
+                    siblings.append(QString::fromLatin1(result.merkle.proof.mid(offset, MerkleTree::DIGEST_SIZE).toHex()));
+                }
+                proof["siblings"] = siblings;
+                proof["valid"] = result.merkle.proofValid;
+            } else {
+                proof["error"] = result.merkle.proofError;
+            }
+            merkle["proof"] = proof;
+        }
+        object["merkle"] = merkle;
+    }
+    return object;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("LedgerVerifier");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Проверка целостности цепочки хешей в файлах накладных (.json, .enc, .ldg).\n"
+                                     "Отчёт в формате JSON выводится в stdout или в файл --output.\n"
+                                     "С --merkle записи сверяются с деревом Меркла <файл>.merkle (его строит --build-merkle);\n"
+                                     "--prove добавляет доказательство Меркла для одной записи, проверенное по корню дерева.\n"
+                                     "С --multi-buffer цепочки MD5 группы файлов проверяются одновременно (для каталогов\n"
+                                     "из множества журналов; записи группы держатся в памяти до конца её проверки).\n"
+                                     "С --cache неизменённые с прошлой проверки файлы принимаются по кэшу <файл>.vcache,\n"
+                                     "как в приложении; без него каждая цепочка проверяется полностью.\n"
+                                     "Код завершения: 0 - все цепочки целы, 1 - есть нарушения, "
+                                     "2 - есть ошибки загрузки, 3 - неверные аргументы.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("paths", "Файлы накладных или каталоги с ними.", "<путь>...");
+    const QCommandLineOption recursiveOption({"r", "recursive"}, "Обходить подкаталоги.");
+    const QCommandLineOption jobsOption({"j", "jobs"}, "Число файлов, проверяемых одновременно (по умолчанию - число ядер).", "n");
+    const QCommandLineOption keyOption({"k", "key"}, "Файл ключа шифрования для файлов .enc.", "file");
+    const QCommandLineOption outputOption({"o", "output"}, "Записать отчёт в файл.", "file");
+    const QCommandLineOption verboseOption({"v", "verbose"}, "Выводить отладочные сообщения ядра в stderr.");
+    const QCommandLineOption merkleOption({"m", "merkle"}, "Сверить записи с деревом Меркла <файл>.merkle и перечислить все изменённые записи.");
+    const QCommandLineOption buildMerkleOption("build-merkle", "Построить дерево Меркла <файл>.merkle по записям каждого файла.");
+    const QCommandLineOption proveOption("prove", "Построить доказательство Меркла для записи с номером <index> "
+                                         "и проверить его по сохранённому корню (включает --merkle).", "index");
+    const QCommandLineOption cacheOption("cache", "Использовать и обновлять кэш проверки <файл>.vcache рядом с файлами.");
+    const QCommandLineOption multiBufferOption({"b", "multi-buffer"}, "Проверять цепочки группы файлов одновременно (multi-buffer MD5).");
+    parser.addOptions({recursiveOption, jobsOption, keyOption, outputOption, verboseOption, merkleOption, buildMerkleOption,
+                       proveOption, cacheOption, multiBufferOption});
+    parser.process(app);
+
+    // Без --verbose отладочные и информационные сообщения ядра выключены: в stdout только отчёт,
+    // в stderr - предупреждения. С --verbose включаются все категории, в том числе ledger.parser
+    QLoggingCategory::setFilterRules(parser.isSet(verboseOption) ? "ledger.*=true"
+                                                                 : "ledger.*.debug=false\nledger.*.info=false");
+
+    if ((parser.isSet(merkleOption) || parser.isSet(proveOption)) && parser.isSet(buildMerkleOption)) {
+        std::cerr << "Параметры --merkle и --prove несовместимы с --build-merkle" << std::endl;
+        return ExitUsage;
+    }
+    const MerkleMode merkleMode = parser.isSet(buildMerkleOption) ? MerkleBuild
+                                : parser.isSet(merkleOption) || parser.isSet(proveOption) ? MerkleVerify : MerkleOff;
+
+    qsizetype proveIndex = -1;
+    if (parser.isSet(proveOption)) {
+        bool ok = false;
+        proveIndex = parser.value(proveOption).toLongLong(&ok);
+        if (!ok || proveIndex < 0) {
+            std::cerr << "Некорректный номер записи: " << parser.value(proveOption).toStdString() << std::endl;
+            return ExitUsage;
+        }
+    }
+
+    int jobs = QThread::idealThreadCount();
+    if (parser.isSet(jobsOption)) {
+        bool ok = false;
+        jobs = parser.value(jobsOption).toInt(&ok);
+        if (!ok || jobs <= 0) {
+            std::cerr << "Некорректное число потоков: " << parser.value(jobsOption).toStdString() << std::endl;
+            return ExitUsage;
+        }
+    }
+
+    if (parser.positionalArguments().isEmpty()) {
+        parser.showHelp(ExitUsage);
+    }
+
+    QStringList missing;
+    const QStringList files = collectFiles(parser.positionalArguments(), parser.isSet(recursiveOption), missing);
+    for (const QString &path : missing) {
+        std::cerr << "Файл не найден: " << path.toStdString() << std::endl;
+    }
+    if (!missing.isEmpty()) {
+        return ExitUsage;
+    }
+
+    EncryptionManager encryption;
+    QString keyError;
+    if (!loadKey(encryption, parser.value(keyOption), keyError) && parser.isSet(keyOption)) {
+        std::cerr << "Не удалось загрузить ключ шифрования: " << keyError.toStdString() << std::endl;
+        return ExitUsage;
+    }
+
+    // Пул рабочих потоков: каждый берёт следующий файл из общего списка. Загрузчик сам
+    // распараллеливает чтение, расшифровку, разбор и проверку одного файла, а несколько файлов
+    // одновременно держат диск занятым, пока другие файлы разбираются и проверяются
+    std::vector<FileResult> results(files.size());
+    const bool multiBuffer = parser.isSet(multiBufferOption);
+    const bool useCache = parser.isSet(cacheOption);
+    qint64 chainVerifyNs = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (multiBuffer) {
+        // Группа не меньше числа дорожек, чтобы ядро было загружено и при одном потоке
+        const qsizetype groupSize = qMax(jobs, Md5MultiBuffer::LANES);
+        for (qsizetype begin = 0; begin < files.size(); begin += groupSize) {
+            chainVerifyNs += verifyGroup(files, begin, qMin<qsizetype>(files.size(), begin + groupSize), &encryption,
+                                         merkleMode, proveIndex, jobs, results);
+        }
+    } else {
+        std::atomic<qsizetype> nextFile(0);
+        jobs = int(qMin<qsizetype>(jobs, qMax<qsizetype>(1, files.size())));
+
+        std::vector<std::unique_ptr<QThread>> workers;
+        for (int i = 0; i < jobs; ++i) {
+            workers.emplace_back(QThread::create([&files, &results, &nextFile, &encryption, merkleMode, proveIndex, useCache]() {
+                for (qsizetype index = nextFile++; index < files.size(); index = nextFile++) {
+                    results[index] = verifyFile(files.at(index), &encryption, merkleMode, proveIndex, useCache);
+                }
+            }));
+            workers.back()->start();
+        }
+        for (const std::unique_ptr<QThread> &worker : workers) {
+            worker->wait();
+        }
+    }
+    const qint64 elapsedNs = timer.nsecsElapsed();
+
+    QJsonArray fileReports;
+    qint64 validCount = 0;
+    qint64 invalidCount = 0;
+    qint64 errorCount = 0;
+    qint64 merkleTamperedCount = 0;
+    qint64 totalRecords = 0;
+    qint64 totalBytes = 0;
+    for (const FileResult &result : results) {
+        fileReports.append(toJson(result));
+        const QString status = fileStatus(result);
+        if (status == "error") {
+            ++errorCount;
+        } else if (status == "invalid") {
+            ++invalidCount;
+        } else {
+            ++validCount;
+        }
+        if (result.merkle.status == "tampered") {
+            ++merkleTamperedCount;
+        }
+        totalRecords += result.records;
+        totalBytes += result.fileSize;
+    }
+
+    QJsonObject summary;
+    summary["files"] = qint64(results.size());
+    summary["valid"] = validCount;
+    summary["invalid"] = invalidCount;
+    summary["errors"] = errorCount;
+    if (merkleMode == MerkleVerify) {
+        summary["merkleTampered"] = merkleTamperedCount;
+    }
+    summary["records"] = totalRecords;
+    summary["bytes"] = totalBytes;
+    summary["jobs"] = jobs;
+    summary["multiBuffer"] = multiBuffer;
+    if (multiBuffer) {
+        summary["chainVerifyMs"] = toMilliseconds(chainVerifyNs);
+    }
+    summary["elapsedMs"] = toMilliseconds(elapsedNs);
+    summary["throughputMBps"] = elapsedNs > 0 ? double(totalBytes) / (1 << 20) / (double(elapsedNs) / 1e9) : 0.0;
+
+    QJsonObject report;
+    report["files"] = fileReports;
+    report["summary"] = summary;
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption)) {
+        QFile output(parser.value(outputOption));
+        if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate) || output.write(json) != json.size()) {
+            std::cerr << "Не удалось записать отчёт: " << output.errorString().toStdString() << std::endl;
+            return ExitError;
+        }
+    } else {
+        std::cout.write(json.constData(), json.size());
+        std::cout.flush();
+    }
+
+    if (errorCount > 0) {
+        return ExitError;
+    }
+    return invalidCount > 0 ? ExitInvalid : ExitValid;
+}
@@ -0,0 +1,168 @@
+#include "batchchainverifier.h"
+#include "hashchainverifier.h"
+#include "ledgerstore.h"
+#include "md5multibuffer.h"
+#include "ledgerlog.h"
+#include <QThread>
+#include <QtConcurrent/QtConcurrentMap>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+static_assert(HashChainVerifier::MAX_MESSAGE_SIZE <= Md5MultiBuffer::MAX_MESSAGE_SIZE,
+              "сообщение звена цепочки помещается в буфер дорожки");
+
+// Участок цепочки одного хранилища
+struct ChainSegment
+{
+    int store;
+    qsizetype begin;
+    qsizetype end;
+};
+
+// Состояние дорожки: проверяемый участок и следующая запись в нём
+struct Lane
+{
+    const ChainSegment *segment;
+    qsizetype position;
+    const uchar *previousHash;
+};
+
+// Общие данные потоков проверки
+struct BatchState
+{
+    const QVector<const LedgerStore*> *stores;
+    QVector<ChainSegment> segments;
+    std::atomic<qsizetype> nextSegment;
+    std::unique_ptr<std::atomic<qsizetype>[]> firstInvalid;    // По хранилищам
+};
+
+void recordMismatch(std::atomic<qsizetype> &firstInvalid, qsizetype index)
+{
+    qsizetype current = firstInvalid.load();
+    while (index < current && !firstInvalid.compare_exchange_weak(current, index)) {
+    }
+}
+
+// Поток проверки: держит занятыми все дорожки, пока есть непроверенные участки
+void runLanes(BatchState &state)
+{
+    Md5MultiBuffer md5;
+    Lane lanes[Md5MultiBuffer::LANES];
+    int active = 0;
+
+    while (true) {
+        while (active < Md5MultiBuffer::LANES) {
+            const qsizetype next = state.nextSegment.fetch_add(1);
+            if (next >= state.segments.size()) {
+                break;
+            }
+            const ChainSegment &segment = state.segments.at(next);
+            // Нарушение раньше этого участка уже найдено: результат не повлияет на ответ
+            if (state.firstInvalid[segment.store].load(std::memory_order_relaxed) < segment.begin) {
+                continue;
+            }
+            const LedgerStore &store = *state.stores->at(segment.store);
+            lanes[active++] = {&segment, segment.begin, segment.begin > 0 ? store.hash(segment.begin - 1) : nullptr};
+        }
+        if (active == 0) {
+            return;
+        }
+
+        for (int lane = 0; lane < active; ++lane) {
+            const LedgerStore &store = *state.stores->at(lanes[lane].segment->store);
+            const qsizetype i = lanes[lane].position;
+            md5.setLength(lane, HashChainVerifier::formatMessage(store.article(i), store.quantity(i), store.timestamp(i),
+                                                                 lanes[lane].previousHash, md5.message(lane)));
+        }
+        md5.compute(active);
+
+        // Дорожки с завершёнными участками убираются, остальные сдвигаются к началу
+        int kept = 0;
+        for (int lane = 0; lane < active; ++lane) {
+            Lane current = lanes[lane];
+            const ChainSegment &segment = *current.segment;
+            const LedgerStore &store = *state.stores->at(segment.store);
+            std::atomic<qsizetype> &firstInvalid = state.firstInvalid[segment.store];
+
+            if (!store.hasCanonicalHash(current.position)
+                || std::memcmp(md5.digest(lane), store.hash(current.position), LedgerStore::HASH_SIZE) != 0) {
+                recordMismatch(firstInvalid, current.position);
+                continue;
+            }
+            // Хеш записи совпал с вычисленным, поэтому следующее звено строится от сохранённого
+            current.previousHash = store.hash(current.position);
+            ++current.position;
+            if (current.position < segment.end && firstInvalid.load(std::memory_order_relaxed) >= current.position) {
+                lanes[kept++] = current;
+            }
+        }
+        active = kept;
+    }
+}
+
+}
+
+QVector<qsizetype> BatchChainVerifier::findFirstInvalid(const QVector<const LedgerStore*> &stores, int threadCount)
+{
+    if (threadCount <= 0) {
+        threadCount = QThread::idealThreadCount();
+    }
+
+    BatchState state;
+    state.stores = &stores;
+    state.nextSegment = 0;
+    state.firstInvalid.reset(new std::atomic<qsizetype>[size_t(stores.size())]);
+
+    QVector<qsizetype> result(stores.size());
+    qsizetype md5Records = 0;
+    for (int i = 0; i < stores.size(); ++i) {
+        const LedgerStore &store = *stores.at(i);
+        state.firstInvalid[i] = store.size();
+        if (store.hashAlgorithm() != LedgerStore::HashMd5) {
+            // Ядро реализует только MD5; остальные алгоритмы OpenSSL сам ускоряет расширениями процессора
+            result[i] = HashChainVerifier::verifyRangeParallel(store, 0, store.size(), nullptr, threadCount);
+            continue;
+        }
+        for (qsizetype begin = 0; begin < store.size(); begin += SEGMENT_SIZE) {
+            state.segments.append({i, begin, qMin<qsizetype>(store.size(), begin + SEGMENT_SIZE)});
+        }
+        md5Records += store.size();
+    }
+
+    // Потоков не больше, чем нужно, чтобы каждому досталось хотя бы по участку на дорожку
+    const int workerCount = int(qBound<qsizetype>(1, state.segments.size() / Md5MultiBuffer::LANES, threadCount));
+    if (workerCount == 1) {
+        runLanes(state);
+    } else {
+        QVector<int> workers(workerCount);
+        QtConcurrent::blockingMap(workers, [&state](int) { runLanes(state); });
+    }
+
+    for (int i = 0; i < stores.size(); ++i) {
+        if (stores.at(i)->hashAlgorithm() == LedgerStore::HashMd5) {
+            result[i] = state.firstInvalid[i].load();
+        }
+    }
+
+    qCDebug(lcCrypto) << "BatchChainVerifier: Журналов:" << stores.size() << "записей MD5:" << md5Records
+                      << "участков:" << state.segments.size() << "потоков:" << workerCount;
+    return result;
+}
+
+QVector<qsizetype> BatchChainVerifier::verify(const QVector<LedgerStore*> &stores, int threadCount)
+{
+    QVector<const LedgerStore*> constStores;
+    constStores.reserve(stores.size());
+    for (LedgerStore *store : stores) {
+        constStores.append(store);
+    }
+
+    const QVector<qsizetype> result = findFirstInvalid(constStores, threadCount);
+    for (int i = 0; i < stores.size(); ++i) {
+        stores.at(i)->markInvalidFrom(result.at(i));
+    }
+    return result;
+}
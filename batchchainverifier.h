@@ -0,0 +1,30 @@
+#ifndef BATCHCHAINVERIFIER_H
+#define BATCHCHAINVERIFIER_H
+
+#include <QVector>
+#include <QtGlobal>
+
+class LedgerStore;
+
+// Проверка цепочек хешей нескольких журналов сразу (например, каталога при ночной сверке).
+// Звенья одной цепочки вычисляются последовательно, но цепочки разных журналов - и участки
+// одной цепочки, каждый от сохранённого хеша записи перед участком, - независимы. Участки
+// всех журналов распределяются по дорожкам Md5MultiBuffer, и каждый поток продвигает до
+// Md5MultiBuffer::LANES цепочек на одно звено за вызов ядра; освободившаяся дорожка сразу
+// получает следующий участок. Журналы с цепочкой не на MD5 проверяются HashChainVerifier.
+class BatchChainVerifier
+{
+public:
+    // Индекс первой невалидной записи каждого хранилища (размер хранилища, если цепочка цела) -
+    // тот же, что вернул бы HashChainVerifier::verifyParallel. Хранилища не изменяются.
+    // threadCount <= 0 - по числу доступных ядер
+    static QVector<qsizetype> findFirstInvalid(const QVector<const LedgerStore*> &stores, int threadCount = 0);
+
+    // То же, но в каждом хранилище первая нарушенная запись и все последующие помечаются невалидными
+    static QVector<qsizetype> verify(const QVector<LedgerStore*> &stores, int threadCount = 0);
+
+    // Длина участка цепочки, который проверяется на одной дорожке
+    static const int SEGMENT_SIZE = 4096;
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QtGlobal>
+#include <deque>
+#include <utility>
+
+// Статистика очереди между стадиями конвейера
+struct QueueStats
+{
+    int capacity = 0;
+    int maxDepth = 0;               // Наибольшее число элементов в очереди
+    qint64 pushes = 0;              // Число помещённых элементов
+    qint64 depthSum = 0;            // Сумма глубин в момент помещения (для средней глубины)
+    qint64 producerWaitNs = 0;      // Время ожидания свободного места (очередь заполнена)
+    qint64 consumerWaitNs = 0;      // Время ожидания элементов (очередь пуста)
+
+    double averageDepth() const { return pushes > 0 ? double(depthSum) / pushes : 0.0; }
+};
+
+// Ограниченная очередь между стадиями конвейера загрузки.
+// push() блокируется, пока очередь заполнена (обратное давление на предыдущую стадию),
+// pop() - пока она пуста. close() завершает поток данных штатно: потребитель дочитывает
+// оставшиеся элементы. abort() прерывает обе стороны немедленно.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(int capacity)
+        : closed(false)
+        , aborted(false)
+    {
+        statistics.capacity = qMax(1, capacity);
+    }
+
+    // Возвращает false, если очередь закрыта или прервана
+    bool push(T item)
+    {
+        QMutexLocker locker(&mutex);
+        if (int(items.size()) >= statistics.capacity && !aborted && !closed) {
+            QElapsedTimer timer;
+            timer.start();
+            while (int(items.size()) >= statistics.capacity && !aborted && !closed) {
+                notFull.wait(&mutex);
+            }
+            statistics.producerWaitNs += timer.nsecsElapsed();
+        }
+        if (aborted || closed) {
+            return false;
+        }
+
+        items.push_back(std::move(item));
+        const int depth = int(items.size());
+        statistics.maxDepth = qMax(statistics.maxDepth, depth);
+        statistics.depthSum += depth;
+        ++statistics.pushes;
+        notEmpty.wakeOne();
+        return true;
+    }
+
+    // Возвращает false, если очередь закрыта и пуста или прервана
+    bool pop(T &item)
+    {
+        QMutexLocker locker(&mutex);
+        if (items.empty() && !aborted && !closed) {
+            QElapsedTimer timer;
+            timer.start();
+            while (items.empty() && !aborted && !closed) {
+                notEmpty.wait(&mutex);
+            }
+            statistics.consumerWaitNs += timer.nsecsElapsed();
+        }
+        if (aborted || items.empty()) {
+            return false;
+        }
+
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.wakeOne();
+        return true;
+    }
+
+    void close()
+    {
+        QMutexLocker locker(&mutex);
+        closed = true;
+        notEmpty.wakeAll();
+        notFull.wakeAll();
+    }
+
+    void abort()
+    {
+        QMutexLocker locker(&mutex);
+        aborted = true;
+        items.clear();
+        notEmpty.wakeAll();
+        notFull.wakeAll();
+    }
+
+    QueueStats stats() const
+    {
+        QMutexLocker locker(&mutex);
+        return statistics;
+    }
+
+private:
+    mutable QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+    std::deque<T> items;
+    bool closed;
+    bool aborted;
+    QueueStats statistics;
+};
+
+#endif
@@ -1,9 +1,62 @@
 #include "encryptionmanager.h"
+#include "ledgerlog.h"
+#include <QBuffer>
 #include <QFile>
 #include <QFileInfo>
-#include <QDebug>
+#include <QIODevice>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtEndian>
 #include <openssl/evp.h>
 #include <openssl/rand.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char V2_MAGIC[8] = {'I', 'N', 'V', 'E', 'N', 'C', '0', '2'};
+const char V2_INDEX_MAGIC[8] = {'I', 'N', 'V', 'I', 'D', 'X', '0', '2'};
+const quint32 V2_VERSION = 2;
+
+// Кадр контейнера v2, найденный при разборе
+struct V2Frame
+{
+    quint64 index;
+    qint64 fileOffset;
+    qint64 plainOffset;
+    quint32 plainLength;
+    bool ok;
+};
+
+// Диапазон блоков шифротекста, расшифровываемый одним потоком
+struct CbcRange
+{
+    qint64 offset;      // Смещение в байтах от начала участка
+    qint64 length;      // Длина в байтах (кратна размеру блока)
+    bool isFinal;       // Последний диапазон файла: снимается дополнение
+    qint64 produced;    // Размер полученного открытого текста
+    bool ok;
+};
+
+// Чтение до заполнения буфера или конца данных
+qint64 readFully(QIODevice *input, char *buffer, qint64 size)
+{
+    qint64 total = 0;
+    while (total < size) {
+        qint64 bytesRead = input->read(buffer + total, size - total);
+        if (bytesRead < 0) {
+            return -1;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        total += bytesRead;
+    }
+    return total;
+}
+
+}
 
 EncryptionManager::EncryptionManager()
 {
@@ -68,7 +121,7 @@ bool EncryptionManager::loadKeyFromFile(const QString &filePath, QString &errorM
     }
     
     key = parsedKey;
-    qDebug() << "EncryptionManager::loadKeyFromFile: Ключ успешно загружен из файла:" << filePath;
+    qCDebug(lcCrypto) << "EncryptionManager::loadKeyFromFile: Ключ успешно загружен из файла:" << filePath;
     return true;
 }
 
@@ -145,6 +198,14 @@ QByteArray EncryptionManager::decrypt(const QByteArray &encryptedData, QString &
         return QByteArray();
     }
     
+    if (hasV2Header(encryptedData)) {
+        return decryptV2(encryptedData, errorMessage);
+    }
+    
+    if (encryptedData.size() >= PARALLEL_THRESHOLD && QThread::idealThreadCount() > 1) {
+        return decryptParallel(encryptedData, errorMessage);
+    }
+    
     // Извлекаем IV и зашифрованные данные
     const unsigned char *iv = reinterpret_cast<const unsigned char*>(encryptedData.constData());
     const unsigned char *ciphertext = iv + IV_SIZE;
@@ -190,3 +251,1253 @@ QByteArray EncryptionManager::decrypt(const QByteArray &encryptedData, QString &
     return plaintext;
 }
 
+QByteArray EncryptionManager::decryptParallel(const QByteArray &encryptedData, QString &errorMessage, int threadCount) const
+{
+    if (!isReady()) {
+        errorMessage = QString("Ключ шифрования не загружен.");
+        return QByteArray();
+    }
+    
+    if (hasV2Header(encryptedData)) {
+        return decryptV2(encryptedData, errorMessage);
+    }
+    
+    if (encryptedData.size() <= IV_SIZE) {
+        errorMessage = QString("Шифротекст повреждён: недостаточно данных.");
+        return QByteArray();
+    }
+    
+    const unsigned char *iv = reinterpret_cast<const unsigned char*>(encryptedData.constData());
+    const unsigned char *ciphertext = iv + IV_SIZE;
+    qint64 ciphertextLength = encryptedData.size() - IV_SIZE;
+    
+    QByteArray plaintext(ciphertextLength, Qt::Uninitialized);
+    qint64 produced = decryptCbcSegment(iv, ciphertext, ciphertextLength,
+                                        reinterpret_cast<unsigned char*>(plaintext.data()),
+                                        true, threadCount);
+    if (produced < 0) {
+        errorMessage = QString("Ошибка при расшифровке данных. Возможно, неверный ключ.");
+        return QByteArray();
+    }
+    
+    plaintext.resize(produced);
+    return plaintext;
+}
+
+qint64 EncryptionManager::decryptCbcSegment(const unsigned char *iv, const unsigned char *ciphertext, qint64 length,
+                                            unsigned char *plaintext, bool isFinal, int threadCount) const
+{
+    if (length % AES_BLOCK != 0 || (isFinal && length == 0)) {
+        return -1;
+    }
+    if (length == 0) {
+        return 0;
+    }
+    
+    if (threadCount <= 0) {
+        threadCount = QThread::idealThreadCount();
+    }
+    
+    // Размер диапазона кратен блоку AES и ограничен снизу (накладные расходы на поток)
+    // и сверху (длины в EVP API имеют тип int)
+    qint64 rangeSize = (length + threadCount - 1) / qMax(1, threadCount);
+    rangeSize = qBound<qint64>(MIN_RANGE_SIZE, rangeSize, MAX_RANGE_SIZE);
+    rangeSize = (rangeSize + AES_BLOCK - 1) / AES_BLOCK * AES_BLOCK;
+    
+    QVector<CbcRange> ranges;
+    for (qint64 offset = 0; offset < length; offset += rangeSize) {
+        ranges.append({offset, qMin(rangeSize, length - offset), false, 0, false});
+    }
+    ranges.last().isFinal = isFinal;
+    
+    const unsigned char *keyData = reinterpret_cast<const unsigned char*>(key.constData());
+    auto decryptRange = [=](CbcRange &range) {
+        // IV диапазона - предыдущий блок шифротекста
+        const unsigned char *rangeIv = range.offset == 0 ? iv : ciphertext + range.offset - AES_BLOCK;
+        
+        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+        if (!ctx) {
+            return;
+        }
+        
+        int outLen1 = 0;
+        int outLen2 = 0;
+        bool success = EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), nullptr, keyData, rangeIv) == 1;
+        if (success && !range.isFinal) {
+            success = EVP_CIPHER_CTX_set_padding(ctx, 0) == 1;
+        }
+        if (success) {
+            success = EVP_DecryptUpdate(ctx,
+                                        plaintext + range.offset,
+                                        &outLen1,
+                                        ciphertext + range.offset,
+                                        static_cast<int>(range.length)) == 1;
+        }
+        if (success) {
+            success = EVP_DecryptFinal_ex(ctx, plaintext + range.offset + outLen1, &outLen2) == 1;
+        }
+        
+        EVP_CIPHER_CTX_free(ctx);
+        
+        range.produced = outLen1 + outLen2;
+        range.ok = success;
+    };
+    
+    if (ranges.size() == 1) {
+        decryptRange(ranges.first());
+    } else {
+        QtConcurrent::blockingMap(ranges, decryptRange);
+    }
+    
+    for (const CbcRange &range : ranges) {
+        if (!range.ok) {
+            return -1;
+        }
+    }
+    
+    // Все диапазоны, кроме последнего, дают ровно столько же байт, сколько получили
+    return ranges.last().offset + ranges.last().produced;
+}
+
+bool EncryptionManager::decryptStream(QIODevice *input, const ChunkHandler &handler, QString &errorMessage) const
+{
+    if (!isReady()) {
+        errorMessage = QString("Ключ шифрования не загружен.");
+        return false;
+    }
+    
+    if (!input || !input->isReadable()) {
+        errorMessage = QString("Источник зашифрованных данных недоступен для чтения.");
+        return false;
+    }
+    
+    if (hasV2Header(input->peek(V2_HEADER_SIZE))) {
+        return decryptStreamV2(input, handler, errorMessage);
+    }
+    
+    // Первые 16 байт потока - вектор инициализации
+    unsigned char iv[IV_SIZE];
+    if (input->read(reinterpret_cast<char*>(iv), IV_SIZE) != IV_SIZE) {
+        errorMessage = QString("Шифротекст повреждён: недостаточно данных.");
+        return false;
+    }
+    
+    // Блок на каждое ядро: каждый фрагмент расшифровывается параллельно,
+    // а память остаётся ограниченной тремя буферами фиксированного размера
+    const int threadCount = qMax(1, QThread::idealThreadCount());
+    const qint64 segmentSize = qint64(STREAM_CHUNK_SIZE) * threadCount;
+    QByteArray current(segmentSize, Qt::Uninitialized);
+    QByteArray next(segmentSize, Qt::Uninitialized);
+    QByteArray plainChunk(segmentSize, Qt::Uninitialized);
+    
+    qint64 currentLength = readFully(input, current.data(), segmentSize);
+    if (currentLength <= 0) {
+        errorMessage = currentLength < 0
+            ? QString("Ошибка чтения зашифрованных данных: %1").arg(input->errorString())
+            : QString("Шифротекст повреждён: недостаточно данных.");
+        return false;
+    }
+    
+    while (true) {
+        // Читаем следующий фрагмент заранее, чтобы знать, является ли текущий последним
+        qint64 nextLength = readFully(input, next.data(), segmentSize);
+        if (nextLength < 0) {
+            errorMessage = QString("Ошибка чтения зашифрованных данных: %1").arg(input->errorString());
+            return false;
+        }
+        bool isFinal = (nextLength == 0);
+        
+        qint64 produced = decryptCbcSegment(iv,
+                                            reinterpret_cast<const unsigned char*>(current.constData()),
+                                            currentLength,
+                                            reinterpret_cast<unsigned char*>(plainChunk.data()),
+                                            isFinal,
+                                            threadCount);
+        if (produced < 0) {
+            errorMessage = QString("Ошибка при расшифровке данных. Возможно, неверный ключ.");
+            return false;
+        }
+        
+        if (produced > 0 && !handler(plainChunk.constData(), produced)) {
+            errorMessage = QString("Расшифровка прервана.");
+            return false;
+        }
+        
+        if (isFinal) {
+            break;
+        }
+        
+        // Последний блок шифротекста служит IV для следующего фрагмента
+        std::memcpy(iv, current.constData() + currentLength - AES_BLOCK, AES_BLOCK);
+        std::swap(current, next);
+        currentLength = nextLength;
+    }
+    
+    return true;
+}
+
+bool EncryptionManager::hasV2Header(const QByteArray &data)
+{
+    return data.size() >= int(sizeof(V2_MAGIC))
+        && std::memcmp(data.constData(), V2_MAGIC, sizeof(V2_MAGIC)) == 0;
+}
+
+EncryptionManager::FormatVersion EncryptionManager::detectFileFormat(const QString &filePath)
+{
+    QFile file(filePath);
+    if (file.open(QIODevice::ReadOnly) && hasV2Header(file.read(sizeof(V2_MAGIC)))) {
+        return FormatV2;
+    }
+    
+    if (QFileInfo(filePath).suffix().toLower() == "enc") {
+        return FormatV1;
+    }
+    
+    return FormatPlain;
+}
+
+bool EncryptionManager::sealFrame(const unsigned char *header, quint64 frameIndex, quint32 flags,
+                                  const unsigned char *plain, quint32 length, unsigned char *out) const
+{
+    qToLittleEndian<quint32>(length, out);
+    qToLittleEndian<quint32>(flags, out + 4);
+    unsigned char *nonce = out + 8;
+    unsigned char *ciphertext = out + V2_FRAME_HEADER_SIZE;
+    unsigned char *tag = ciphertext + length;
+    
+    if (RAND_bytes(nonce, V2_NONCE_SIZE) != 1) {
+        return false;
+    }
+    
+    // Аутентифицируемые данные: заголовок контейнера, номер кадра, длина и флаги
+    unsigned char frameInfo[16];
+    qToLittleEndian<quint64>(frameIndex, frameInfo);
+    std::memcpy(frameInfo + 8, out, 8);
+    
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        return false;
+    }
+    
+    int outLen = 0;
+    bool success = EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, V2_NONCE_SIZE, nullptr) == 1
+        && EVP_EncryptInit_ex(ctx, nullptr, nullptr,
+                              reinterpret_cast<const unsigned char*>(key.constData()), nonce) == 1
+        && EVP_EncryptUpdate(ctx, nullptr, &outLen, header, V2_HEADER_SIZE) == 1
+        && EVP_EncryptUpdate(ctx, nullptr, &outLen, frameInfo, sizeof(frameInfo)) == 1;
+    if (success && length > 0) {
+        success = EVP_EncryptUpdate(ctx, ciphertext, &outLen, plain, static_cast<int>(length)) == 1;
+    }
+    if (success) {
+        success = EVP_EncryptFinal_ex(ctx, ciphertext + (length > 0 ? outLen : 0), &outLen) == 1
+            && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, V2_TAG_SIZE, tag) == 1;
+    }
+    
+    EVP_CIPHER_CTX_free(ctx);
+    return success;
+}
+
+bool EncryptionManager::openFrame(const unsigned char *header, quint64 frameIndex,
+                                  const unsigned char *frame, unsigned char *plainOut) const
+{
+    quint32 length = qFromLittleEndian<quint32>(frame);
+    const unsigned char *nonce = frame + 8;
+    const unsigned char *ciphertext = frame + V2_FRAME_HEADER_SIZE;
+    const unsigned char *tag = ciphertext + length;
+    
+    unsigned char frameInfo[16];
+    qToLittleEndian<quint64>(frameIndex, frameInfo);
+    std::memcpy(frameInfo + 8, frame, 8);
+    
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        return false;
+    }
+    
+    int outLen = 0;
+    bool success = EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, nullptr, nullptr) == 1
+        && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, V2_NONCE_SIZE, nullptr) == 1
+        && EVP_DecryptInit_ex(ctx, nullptr, nullptr,
+                              reinterpret_cast<const unsigned char*>(key.constData()), nonce) == 1
+        && EVP_DecryptUpdate(ctx, nullptr, &outLen, header, V2_HEADER_SIZE) == 1
+        && EVP_DecryptUpdate(ctx, nullptr, &outLen, frameInfo, sizeof(frameInfo)) == 1;
+    if (success && length > 0) {
+        success = EVP_DecryptUpdate(ctx, plainOut, &outLen, ciphertext, static_cast<int>(length)) == 1;
+    }
+    if (success) {
+        // Тег передаётся до EVP_DecryptFinal_ex, которая и выполняет проверку подлинности
+        success = EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, V2_TAG_SIZE,
+                                      const_cast<unsigned char*>(tag)) == 1
+            && EVP_DecryptFinal_ex(ctx, plainOut + (length > 0 ? outLen : 0), &outLen) == 1;
+    }
+    
+    EVP_CIPHER_CTX_free(ctx);
+    return success;
+}
+
+QByteArray EncryptionManager::encryptV2(const QByteArray &plainData, QString &errorMessage, int frameSize) const
+{
+    if (!isReady()) {
+        errorMessage = QString("Ключ шифрования не загружен.");
+        return QByteArray();
+    }
+    
+    if (frameSize <= 0 || frameSize > V2_MAX_FRAME_SIZE) {
+        errorMessage = QString("Недопустимый размер кадра: %1").arg(frameSize);
+        return QByteArray();
+    }
+    
+    const qint64 plainSize = plainData.size();
+    const qint64 frameCount = qMax<qint64>(1, (plainSize + frameSize - 1) / frameSize);
+    const qint64 indexOffset = V2_HEADER_SIZE + plainSize + frameCount * V2_FRAME_OVERHEAD;
+    const qint64 totalSize = indexOffset + frameCount * V2_INDEX_ENTRY_SIZE + V2_TRAILER_SIZE;
+    
+    QByteArray result(totalSize, Qt::Uninitialized);
+    unsigned char *out = reinterpret_cast<unsigned char*>(result.data());
+    const unsigned char *plain = reinterpret_cast<const unsigned char*>(plainData.constData());
+    
+    std::memset(out, 0, V2_HEADER_SIZE);
+    std::memcpy(out, V2_MAGIC, sizeof(V2_MAGIC));
+    qToLittleEndian<quint32>(V2_VERSION, out + 8);
+    qToLittleEndian<quint32>(quint32(frameSize), out + 12);
+    
+    // Все кадры, кроме последнего, полные, поэтому их положение известно заранее
+    QVector<V2Frame> frames;
+    frames.reserve(frameCount);
+    for (qint64 i = 0; i < frameCount; ++i) {
+        qint64 plainOffset = i * frameSize;
+        quint32 plainLength = quint32(qMin<qint64>(frameSize, plainSize - plainOffset));
+        frames.append({quint64(i), V2_HEADER_SIZE + i * (qint64(frameSize) + V2_FRAME_OVERHEAD),
+                       plainOffset, plainLength, false});
+    }
+    
+    auto sealOne = [this, out, plain, frameCount](V2Frame &frame) {
+        quint32 flags = (qint64(frame.index) == frameCount - 1) ? V2_FLAG_LAST_FRAME : 0;
+        frame.ok = sealFrame(out, frame.index, flags, plain + frame.plainOffset,
+                             frame.plainLength, out + frame.fileOffset);
+    };
+    
+    if (frames.size() == 1) {
+        sealOne(frames.first());
+    } else {
+        QtConcurrent::blockingMap(frames, sealOne);
+    }
+    
+    unsigned char *entry = out + indexOffset;
+    for (const V2Frame &frame : frames) {
+        if (!frame.ok) {
+            errorMessage = QString("Ошибка при шифровании кадра %1.").arg(frame.index);
+            return QByteArray();
+        }
+        qToLittleEndian<quint64>(quint64(frame.fileOffset), entry);
+        qToLittleEndian<quint64>(quint64(frame.plainOffset), entry + 8);
+        entry += V2_INDEX_ENTRY_SIZE;
+    }
+    
+    qToLittleEndian<quint64>(quint64(indexOffset), entry);
+    qToLittleEndian<quint64>(quint64(frameCount), entry + 8);
+    std::memcpy(entry + 16, V2_INDEX_MAGIC, sizeof(V2_INDEX_MAGIC));
+    
+    return result;
+}
+
+QByteArray EncryptionManager::decryptV2(const QByteArray &container, QString &errorMessage) const
+{
+    if (!isReady()) {
+        errorMessage = QString("Ключ шифрования не загружен.");
+        return QByteArray();
+    }
+    
+    // Кадры находятся по индексу: после дописываний кадры действующей версии не обязательно
+    // идут подряд. QBuffer разделяет данные контейнера и не копирует их
+    QBuffer buffer;
+    buffer.setData(container);
+    buffer.open(QIODevice::ReadOnly);
+    QByteArray header;
+    QByteArray index;
+    if (!readV2Index(&buffer, header, index, errorMessage)) {
+        return QByteArray();
+    }
+    
+    const qint64 size = container.size();
+    const unsigned char *data = reinterpret_cast<const unsigned char*>(container.constData());
+    const quint32 frameSize = qFromLittleEndian<quint32>(data + 12);
+    const qint64 frameCount = index.size() / V2_INDEX_ENTRY_SIZE;
+    const unsigned char *entries = reinterpret_cast<const unsigned char*>(index.constData());
+    
+    // Признак последнего кадра должен быть только у последнего кадра индекса, а открытый текст
+    // кадров - идти подряд: индекс не аутентифицирован, поэтому сверяется с заголовками кадров
+    QVector<V2Frame> frames;
+    frames.reserve(frameCount);
+    qint64 plainSize = 0;
+    for (qint64 i = 0; i < frameCount; ++i) {
+        const qint64 offset = qint64(qFromLittleEndian<quint64>(entries + i * V2_INDEX_ENTRY_SIZE));
+        quint32 plainLength = qFromLittleEndian<quint32>(data + offset);
+        quint32 flags = qFromLittleEndian<quint32>(data + offset + 4);
+        if (plainLength > frameSize || size - offset - V2_FRAME_OVERHEAD < qint64(plainLength)) {
+            errorMessage = QString("Контейнер v2 повреждён: некорректная длина кадра %1.").arg(i);
+            return QByteArray();
+        }
+        if (qint64(qFromLittleEndian<quint64>(entries + i * V2_INDEX_ENTRY_SIZE + 8)) != plainSize
+            || ((flags & V2_FLAG_LAST_FRAME) != 0) != (i == frameCount - 1)) {
+            errorMessage = QString("Контейнер v2 повреждён: индекс кадров не соответствует кадрам.");
+            return QByteArray();
+        }
+        frames.append({quint64(i), offset, plainSize, plainLength, false});
+        plainSize += plainLength;
+    }
+    
+    QByteArray plaintext(plainSize, Qt::Uninitialized);
+    unsigned char *plainOut = reinterpret_cast<unsigned char*>(plaintext.data());
+    auto openOne = [this, data, plainOut](V2Frame &frame) {
+        frame.ok = openFrame(data, frame.index, data + frame.fileOffset, plainOut + frame.plainOffset);
+    };
+    
+    if (frames.size() == 1) {
+        openOne(frames.first());
+    } else {
+        QtConcurrent::blockingMap(frames, openOne);
+    }
+    
+    for (const V2Frame &frame : frames) {
+        if (!frame.ok) {
+            errorMessage = QString("Ошибка проверки подлинности кадра %1. Возможно, неверный ключ или данные изменены.")
+                               .arg(frame.index);
+            return QByteArray();
+        }
+    }
+    
+    return plaintext;
+}
+
+bool EncryptionManager::decryptStreamV2(QIODevice *input, const ChunkHandler &handler, QString &errorMessage) const
+{
+    // Устройство с произвольным доступом читается по индексу: после дописываний между кадрами
+    // действующей версии лежат заменённые кадры и прежние индексы. Последовательный поток
+    // должен содержать только действующие кадры подряд (см. readV2Ranges)
+    QByteArray header;
+    QByteArray index;
+    if (input->isSequential()) {
+        header = input->read(V2_HEADER_SIZE);
+    } else if (!readV2Index(input, header, index, errorMessage)) {
+        return false;
+    }
+    const qint64 indexedFrames = index.size() / V2_INDEX_ENTRY_SIZE;
+    const unsigned char *entries = reinterpret_cast<const unsigned char*>(index.constData());
+    const unsigned char *headerData = reinterpret_cast<const unsigned char*>(header.constData());
+    if (header.size() != V2_HEADER_SIZE || qFromLittleEndian<quint32>(headerData + 8) != V2_VERSION) {
+        errorMessage = QString("Заголовок контейнера v2 повреждён или версия не поддерживается.");
+        return false;
+    }
+    const quint32 frameSize = qFromLittleEndian<quint32>(headerData + 12);
+    if (frameSize == 0 || frameSize > quint32(V2_MAX_FRAME_SIZE)) {
+        errorMessage = QString("Заголовок контейнера v2 повреждён: недопустимый размер кадра.");
+        return false;
+    }
+    
+    // Пачка из одного кадра на ядро: кадры пачки проверяются и расшифровываются параллельно
+    const int batchSize = qMax(1, QThread::idealThreadCount());
+    const qint64 frameCapacity = qint64(frameSize) + V2_FRAME_OVERHEAD;
+    QByteArray cipherBatch(frameCapacity * batchSize, Qt::Uninitialized);
+    QByteArray plainBatch(qint64(frameSize) * batchSize, Qt::Uninitialized);
+    unsigned char *cipherData = reinterpret_cast<unsigned char*>(cipherBatch.data());
+    unsigned char *plainData = reinterpret_cast<unsigned char*>(plainBatch.data());
+    
+    quint64 frameIndex = 0;
+    bool lastSeen = false;
+    QVector<V2Frame> frames;
+    
+    while (!lastSeen) {
+        frames.clear();
+        qint64 plainOffset = 0;
+        
+        while (frames.size() < batchSize && !lastSeen) {
+            unsigned char *slot = cipherData + frames.size() * frameCapacity;
+            if (indexedFrames > 0) {
+                const qint64 frameOffset = qint64(frameIndex) < indexedFrames
+                    ? qint64(qFromLittleEndian<quint64>(entries + frameIndex * V2_INDEX_ENTRY_SIZE)) : -1;
+                if (frameOffset < 0 || (input->pos() != frameOffset && !input->seek(frameOffset))) {
+                    errorMessage = QString("Контейнер v2 повреждён: индекс кадров не соответствует кадрам.");
+                    return false;
+                }
+            }
+            if (readFully(input, reinterpret_cast<char*>(slot), V2_FRAME_HEADER_SIZE) != V2_FRAME_HEADER_SIZE) {
+                errorMessage = QString("Контейнер v2 повреждён: кадр %1 обрезан.").arg(frameIndex);
+                return false;
+            }
+            quint32 plainLength = qFromLittleEndian<quint32>(slot);
+            quint32 flags = qFromLittleEndian<quint32>(slot + 4);
+            if (plainLength > frameSize) {
+                errorMessage = QString("Контейнер v2 повреждён: некорректная длина кадра %1.").arg(frameIndex);
+                return false;
+            }
+            qint64 rest = qint64(plainLength) + V2_TAG_SIZE;
+            if (readFully(input, reinterpret_cast<char*>(slot + V2_FRAME_HEADER_SIZE), rest) != rest) {
+                errorMessage = QString("Контейнер v2 повреждён: кадр %1 обрезан.").arg(frameIndex);
+                return false;
+            }
+            frames.append({frameIndex++, frames.size() * frameCapacity, plainOffset, plainLength, false});
+            plainOffset += plainLength;
+            lastSeen = (flags & V2_FLAG_LAST_FRAME) != 0;
+            if (indexedFrames > 0 && lastSeen != (qint64(frameIndex) == indexedFrames)) {
+                errorMessage = QString("Контейнер v2 повреждён: индекс кадров не соответствует кадрам.");
+                return false;
+            }
+        }
+        
+        auto openOne = [this, headerData, cipherData, plainData](V2Frame &frame) {
+            frame.ok = openFrame(headerData, frame.index, cipherData + frame.fileOffset,
+                                 plainData + frame.plainOffset);
+        };
+        if (frames.size() == 1) {
+            openOne(frames.first());
+        } else {
+            QtConcurrent::blockingMap(frames, openOne);
+        }
+        
+        for (const V2Frame &frame : frames) {
+            if (!frame.ok) {
+                errorMessage = QString("Ошибка проверки подлинности кадра %1. Возможно, неверный ключ или данные изменены.")
+                                   .arg(frame.index);
+                return false;
+            }
+        }
+        
+        if (plainOffset > 0 && !handler(plainBatch.constData(), plainOffset)) {
+            errorMessage = QString("Расшифровка прервана.");
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+bool EncryptionManager::encryptStream(const ChunkSource &source, QIODevice *output, QString &errorMessage,
+                                      FormatVersion format) const
+{
+    if (!isReady()) {
+        errorMessage = QString("Ключ шифрования не загружен.");
+        return false;
+    }
+    
+    if (!output || !output->isWritable()) {
+        errorMessage = QString("Устройство для зашифрованных данных недоступно для записи.");
+        return false;
+    }
+    
+    if (format == FormatV1) {
+        return encryptStreamV1(source, output, errorMessage);
+    }
+    if (format == FormatV2) {
+        return encryptStreamV2(source, output, errorMessage);
+    }
+    errorMessage = QString("Неизвестный формат шифрования.");
+    return false;
+}
+
+bool EncryptionManager::encryptStreamV1(const ChunkSource &source, QIODevice *output, QString &errorMessage) const
+{
+    unsigned char iv[IV_SIZE];
+    if (RAND_bytes(iv, IV_SIZE) != 1) {
+        errorMessage = QString("Не удалось сгенерировать IV.");
+        return false;
+    }
+    if (output->write(reinterpret_cast<const char*>(iv), IV_SIZE) != IV_SIZE) {
+        errorMessage = QString("Ошибка записи зашифрованных данных: %1").arg(output->errorString());
+        return false;
+    }
+    
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) {
+        errorMessage = QString("Не удалось инициализировать контекст шифрования.");
+        return false;
+    }
+    
+    // CBC шифруется только последовательно: каждый блок зависит от предыдущего
+    QByteArray plainChunk(STREAM_CHUNK_SIZE, Qt::Uninitialized);
+    QByteArray cipherChunk(STREAM_CHUNK_SIZE + EVP_CIPHER_block_size(EVP_aes_256_cbc()), Qt::Uninitialized);
+    unsigned char *cipher = reinterpret_cast<unsigned char*>(cipherChunk.data());
+    int outLen = 0;
+    
+    bool success = EVP_EncryptInit_ex(ctx,
+                                      EVP_aes_256_cbc(),
+                                      nullptr,
+                                      reinterpret_cast<const unsigned char*>(key.constData()),
+                                      iv) == 1;
+    if (!success) {
+        errorMessage = QString("Ошибка при шифровании данных.");
+    }
+    
+    while (success) {
+        qsizetype length = source(plainChunk.data(), plainChunk.size());
+        if (length < 0) {
+            errorMessage = QString("Шифрование прервано источником данных.");
+            success = false;
+            break;
+        }
+        if (length == 0) {
+            break;
+        }
+        success = EVP_EncryptUpdate(ctx, cipher, &outLen,
+                                    reinterpret_cast<const unsigned char*>(plainChunk.constData()),
+                                    int(length)) == 1;
+        if (!success) {
+            errorMessage = QString("Ошибка при шифровании данных.");
+        } else if (output->write(cipherChunk.constData(), outLen) != outLen) {
+            errorMessage = QString("Ошибка записи зашифрованных данных: %1").arg(output->errorString());
+            success = false;
+        }
+    }
+    
+    if (success) {
+        success = EVP_EncryptFinal_ex(ctx, cipher, &outLen) == 1;
+        if (!success) {
+            errorMessage = QString("Ошибка при шифровании данных.");
+        } else if (output->write(cipherChunk.constData(), outLen) != outLen) {
+            errorMessage = QString("Ошибка записи зашифрованных данных: %1").arg(output->errorString());
+            success = false;
+        }
+    }
+    
+    EVP_CIPHER_CTX_free(ctx);
+    return success;
+}
+
+bool EncryptionManager::encryptStreamV2(const ChunkSource &source, QIODevice *output, QString &errorMessage) const
+{
+    const qint64 frameSize = V2_DEFAULT_FRAME_SIZE;
+    
+    unsigned char header[V2_HEADER_SIZE];
+    std::memset(header, 0, V2_HEADER_SIZE);
+    std::memcpy(header, V2_MAGIC, sizeof(V2_MAGIC));
+    qToLittleEndian<quint32>(V2_VERSION, header + 8);
+    qToLittleEndian<quint32>(quint32(frameSize), header + 12);
+    if (output->write(reinterpret_cast<const char*>(header), V2_HEADER_SIZE) != V2_HEADER_SIZE) {
+        errorMessage = QString("Ошибка записи зашифрованных данных: %1").arg(output->errorString());
+        return false;
+    }
+    
+    // Пачка из одного кадра на ядро и ещё одного кадра: последний полный кадр пачки шифруется
+    // вместе со следующей пачкой, потому что признак последнего кадра известен только
+    // после того, как источник сообщит о конце данных
+    const int batchFrames = qMax(1, QThread::idealThreadCount());
+    QByteArray plainBatch(qint64(batchFrames + 1) * frameSize, Qt::Uninitialized);
+    QByteArray sealedBatch(qint64(batchFrames + 1) * (frameSize + V2_FRAME_OVERHEAD), Qt::Uninitialized);
+    const unsigned char *plain = reinterpret_cast<const unsigned char*>(plainBatch.constData());
+    unsigned char *sealed = reinterpret_cast<unsigned char*>(sealedBatch.data());
+    
+    QByteArray index;
+    quint64 frameIndex = 0;
+    qint64 fileOffset = V2_HEADER_SIZE;
+    qint64 plainOffset = 0;
+    qint64 filled = 0;
+    bool finished = false;
+    QVector<V2Frame> frames;
+    frames.reserve(batchFrames + 1);
+    
+    while (!finished) {
+        while (filled < plainBatch.size()) {
+            qsizetype length = source(plainBatch.data() + filled, plainBatch.size() - filled);
+            if (length < 0) {
+                errorMessage = QString("Шифрование прервано источником данных.");
+                return false;
+            }
+            if (length == 0) {
+                finished = true;
+                break;
+            }
+            filled += length;
+        }
+        
+        // В конце шифруются все оставшиеся данные (пустой текст - один пустой кадр)
+        const qint64 frameCount = finished
+            ? qMax<qint64>(frameIndex == 0 ? 1 : 0, (filled + frameSize - 1) / frameSize)
+            : filled / frameSize - 1;
+        
+        frames.clear();
+        for (qint64 i = 0; i < frameCount; ++i) {
+            quint32 plainLength = quint32(qMin<qint64>(frameSize, filled - i * frameSize));
+            frames.append({frameIndex + quint64(i), i * (frameSize + V2_FRAME_OVERHEAD), i * frameSize, plainLength, false});
+        }
+        
+        const quint64 lastFrame = finished ? frameIndex + quint64(frameCount) - 1 : ~quint64(0);
+        auto sealOne = [this, &header, plain, sealed, lastFrame](V2Frame &frame) {
+            quint32 flags = frame.index == lastFrame ? V2_FLAG_LAST_FRAME : 0;
+            frame.ok = sealFrame(header, frame.index, flags, plain + frame.plainOffset,
+                                 frame.plainLength, sealed + frame.fileOffset);
+        };
+        if (frames.size() == 1) {
+            sealOne(frames.first());
+        } else {
+            QtConcurrent::blockingMap(frames, sealOne);
+        }
+        
+        qint64 sealedSize = 0;
+        for (const V2Frame &frame : frames) {
+            if (!frame.ok) {
+                errorMessage = QString("Ошибка при шифровании кадра %1.").arg(frame.index);
+                return false;
+            }
+            unsigned char entry[V2_INDEX_ENTRY_SIZE];
+            qToLittleEndian<quint64>(quint64(fileOffset + frame.fileOffset), entry);
+            qToLittleEndian<quint64>(quint64(plainOffset + frame.plainOffset), entry + 8);
+            index.append(reinterpret_cast<const char*>(entry), V2_INDEX_ENTRY_SIZE);
+            sealedSize += frame.plainLength + V2_FRAME_OVERHEAD;
+        }
+        if (output->write(sealedBatch.constData(), sealedSize) != sealedSize) {
+            errorMessage = QString("Ошибка записи зашифрованных данных: %1").arg(output->errorString());
+            return false;
+        }
+        
+        // Незашифрованный остаток переносится в начало пачки
+        const qint64 consumed = qMin(filled, frameCount * frameSize);
+        std::memmove(plainBatch.data(), plainBatch.constData() + consumed, size_t(filled - consumed));
+        filled -= consumed;
+        frameIndex += quint64(frameCount);
+        fileOffset += sealedSize;
+        plainOffset += consumed;
+    }
+    
+    unsigned char trailer[V2_TRAILER_SIZE];
+    qToLittleEndian<quint64>(quint64(fileOffset), trailer);
+    qToLittleEndian<quint64>(frameIndex, trailer + 8);
+    std::memcpy(trailer + 16, V2_INDEX_MAGIC, sizeof(V2_INDEX_MAGIC));
+    if (output->write(index) != index.size()
+        || output->write(reinterpret_cast<const char*>(trailer), V2_TRAILER_SIZE) != V2_TRAILER_SIZE) {
+        errorMessage = QString("Ошибка записи зашифрованных данных: %1").arg(output->errorString());
+        return false;
+    }
+    return true;
+}
+
+QByteArray EncryptionManager::readV2Range(QIODevice *device, qint64 plainOffset, qint64 length,
+                                          QString &errorMessage) const
+{
+    if (!isReady()) {
+        errorMessage = QString("Ключ шифрования не загружен.");
+        return QByteArray();
+    }
+    
+    if (plainOffset < 0 || length < 0) {
+        errorMessage = QString("Произвольный доступ к контейнеру невозможен.");
+        return QByteArray();
+    }
+    
+    QByteArray header;
+    QByteArray index;
+    if (!readV2Index(device, header, index, errorMessage)) {
+        return QByteArray();
+    }
+    const unsigned char *headerData = reinterpret_cast<const unsigned char*>(header.constData());
+    const quint32 frameSize = qFromLittleEndian<quint32>(headerData + 12);
+    const qint64 frameCount = index.size() / V2_INDEX_ENTRY_SIZE;
+    const unsigned char *entries = reinterpret_cast<const unsigned char*>(index.constData());
+    auto framePlainOffset = [entries](qint64 i) {
+        return qint64(qFromLittleEndian<quint64>(entries + i * V2_INDEX_ENTRY_SIZE + 8));
+    };
+    
+    // Двоичный поиск последнего кадра, начинающегося не позже plainOffset
+    qint64 low = 0;
+    qint64 high = frameCount - 1;
+    while (low < high) {
+        qint64 middle = (low + high + 1) / 2;
+        if (framePlainOffset(middle) <= plainOffset) {
+            low = middle;
+        } else {
+            high = middle - 1;
+        }
+    }
+    
+    QByteArray result;
+    result.reserve(length);
+    QByteArray frameBuffer;
+    QByteArray plainBuffer(frameSize, Qt::Uninitialized);
+    
+    for (qint64 i = low; i < frameCount && result.size() < length; ++i) {
+        const qint64 fileOffset = qint64(qFromLittleEndian<quint64>(entries + i * V2_INDEX_ENTRY_SIZE));
+        if (!device->seek(fileOffset)) {
+            errorMessage = QString("Не удалось перейти к кадру %1.").arg(i);
+            return QByteArray();
+        }
+        frameBuffer = device->read(V2_FRAME_HEADER_SIZE);
+        if (frameBuffer.size() != V2_FRAME_HEADER_SIZE) {
+            errorMessage = QString("Контейнер v2 повреждён: кадр %1 обрезан.").arg(i);
+            return QByteArray();
+        }
+        quint32 plainLength = qFromLittleEndian<quint32>(reinterpret_cast<const unsigned char*>(frameBuffer.constData()));
+        if (plainLength > frameSize) {
+            errorMessage = QString("Контейнер v2 повреждён: некорректная длина кадра %1.").arg(i);
+            return QByteArray();
+        }
+        frameBuffer.append(device->read(qint64(plainLength) + V2_TAG_SIZE));
+        if (frameBuffer.size() != V2_FRAME_OVERHEAD + qint64(plainLength)
+            || !openFrame(headerData, quint64(i), reinterpret_cast<const unsigned char*>(frameBuffer.constData()),
+                          reinterpret_cast<unsigned char*>(plainBuffer.data()))) {
+            errorMessage = QString("Ошибка проверки подлинности кадра %1.").arg(i);
+            return QByteArray();
+        }
+        
+        const qint64 frameStart = framePlainOffset(i);
+        const qint64 skip = qMax<qint64>(0, plainOffset - frameStart);
+        const qint64 take = qMin<qint64>(qint64(plainLength) - skip, length - result.size());
+        if (take > 0) {
+            result.append(plainBuffer.constData() + skip, take);
+        }
+    }
+    
+    return result;
+}
+
+bool EncryptionManager::readV2Index(QIODevice *device, QByteArray &header, QByteArray &index,
+                                    QString &errorMessage) const
+{
+    if (!device || device->isSequential()) {
+        errorMessage = QString("Произвольный доступ к контейнеру невозможен.");
+        return false;
+    }
+    
+    header.clear();
+    if (device->seek(0)) {
+        header = device->read(V2_HEADER_SIZE);
+    }
+    const unsigned char *headerData = reinterpret_cast<const unsigned char*>(header.constData());
+    if (header.size() != V2_HEADER_SIZE || !hasV2Header(header)
+        || qFromLittleEndian<quint32>(headerData + 8) != V2_VERSION) {
+        errorMessage = QString("Заголовок или индекс контейнера v2 повреждён.");
+        return false;
+    }
+    const quint32 frameSize = qFromLittleEndian<quint32>(headerData + 12);
+    if (frameSize == 0 || frameSize > quint32(V2_MAX_FRAME_SIZE)) {
+        errorMessage = QString("Заголовок контейнера v2 повреждён: недопустимый размер кадра.");
+        return false;
+    }
+    
+    const qint64 size = device->size();
+    if (readV2Trailer(device, size, frameSize, index)) {
+        return true;
+    }
+    
+    // Окончание в конце файла не прошло проверку: дописывание оборвалось до того, как окончание
+    // было записано целиком. Действует предыдущее окончание - ищем его сигнатуру от конца файла
+    // к началу; всё, что записано после него, не было зафиксировано
+    const QByteArray magic = QByteArray::fromRawData(V2_INDEX_MAGIC, sizeof(V2_INDEX_MAGIC));
+    const qint64 lowest = V2_HEADER_SIZE + V2_TRAILER_SIZE - qint64(sizeof(V2_INDEX_MAGIC));
+    qint64 high = size - qint64(sizeof(V2_INDEX_MAGIC));  // Сигнатуры с началом от high уже проверены
+    while (high > lowest) {
+        const qint64 low = qMax(lowest, high - STREAM_CHUNK_SIZE);
+        QByteArray block;
+        if (device->seek(low)) {
+            block = device->read(high - low + qint64(sizeof(V2_INDEX_MAGIC)) - 1);
+        }
+        int from = int(high - low) - 1;
+        while (from >= 0) {
+            const int found = int(block.lastIndexOf(magic, from));
+            if (found < 0) {
+                break;
+            }
+            const qint64 end = low + found + qint64(sizeof(V2_INDEX_MAGIC));
+            if (readV2Trailer(device, end, frameSize, index)) {
+                qCWarning(lcCrypto) << "EncryptionManager: Окончание контейнера v2 повреждено, используется предыдущее;"
+                                    << "не зафиксировано байт:" << size - end;
+                return true;
+            }
+            from = found - 1;
+        }
+        high = low;
+    }
+    
+    errorMessage = QString("Индекс контейнера v2 повреждён.");
+    return false;
+}
+
+bool EncryptionManager::readV2Trailer(QIODevice *device, qint64 end, quint32 frameSize, QByteArray &index) const
+{
+    QByteArray trailer;
+    if (end >= V2_HEADER_SIZE + V2_TRAILER_SIZE && device->seek(end - V2_TRAILER_SIZE)) {
+        trailer = device->read(V2_TRAILER_SIZE);
+    }
+    const unsigned char *trailerData = reinterpret_cast<const unsigned char*>(trailer.constData());
+    if (trailer.size() != V2_TRAILER_SIZE
+        || std::memcmp(trailerData + 16, V2_INDEX_MAGIC, sizeof(V2_INDEX_MAGIC)) != 0) {
+        return false;
+    }
+    
+    const quint64 indexOffset = qFromLittleEndian<quint64>(trailerData);
+    const quint64 frameCount = qFromLittleEndian<quint64>(trailerData + 8);
+    if (frameCount == 0 || frameCount > quint64(end) / V2_INDEX_ENTRY_SIZE
+        || indexOffset < quint64(V2_HEADER_SIZE)
+        || indexOffset + frameCount * V2_INDEX_ENTRY_SIZE != quint64(end - V2_TRAILER_SIZE)) {
+        return false;
+    }
+    
+    index.clear();
+    if (device->seek(qint64(indexOffset))) {
+        index = device->read(qint64(frameCount) * V2_INDEX_ENTRY_SIZE);
+    }
+    if (index.size() != qint64(frameCount) * V2_INDEX_ENTRY_SIZE) {
+        return false;
+    }
+    
+    // Кадры лежат между заголовком и индексом, открытый текст кадров идёт подряд с нуля
+    const unsigned char *entries = reinterpret_cast<const unsigned char*>(index.constData());
+    quint64 previousPlain = 0;
+    for (quint64 i = 0; i < frameCount; ++i) {
+        const quint64 fileOffset = qFromLittleEndian<quint64>(entries + i * V2_INDEX_ENTRY_SIZE);
+        const quint64 plainOffset = qFromLittleEndian<quint64>(entries + i * V2_INDEX_ENTRY_SIZE + 8);
+        if (fileOffset < quint64(V2_HEADER_SIZE) || fileOffset + V2_FRAME_OVERHEAD > indexOffset
+            || (i == 0 && plainOffset != 0)
+            || plainOffset < previousPlain || plainOffset - previousPlain > frameSize) {
+            return false;
+        }
+        previousPlain = plainOffset;
+    }
+    return true;
+}
+
+qint64 EncryptionManager::plainSizeV2(QIODevice *device, QString &errorMessage) const
+{
+    QByteArray header;
+    QByteArray index;
+    if (!readV2Index(device, header, index, errorMessage)) {
+        return -1;
+    }
+    
+    // Размер открытого текста - начало последнего кадра плюс его длина из заголовка кадра
+    const unsigned char *last = reinterpret_cast<const unsigned char*>(index.constData()) + index.size() - V2_INDEX_ENTRY_SIZE;
+    QByteArray frameHeader;
+    if (device->seek(qint64(qFromLittleEndian<quint64>(last)))) {
+        frameHeader = device->read(V2_FRAME_HEADER_SIZE);
+    }
+    if (frameHeader.size() != V2_FRAME_HEADER_SIZE) {
+        errorMessage = QString("Контейнер v2 повреждён: последний кадр обрезан.");
+        return -1;
+    }
+    return qint64(qFromLittleEndian<quint64>(last + 8))
+        + qFromLittleEndian<quint32>(reinterpret_cast<const unsigned char*>(frameHeader.constData()));
+}
+
+bool EncryptionManager::readV2Ranges(QIODevice *device, QVector<FileRange> &ranges, QString &errorMessage) const
+{
+    QByteArray header;
+    QByteArray index;
+    if (!readV2Index(device, header, index, errorMessage)) {
+        return false;
+    }
+    const quint32 frameSize = qFromLittleEndian<quint32>(reinterpret_cast<const unsigned char*>(header.constData()) + 12);
+    const qint64 frameCount = index.size() / V2_INDEX_ENTRY_SIZE;
+    const unsigned char *entries = reinterpret_cast<const unsigned char*>(index.constData());
+    
+    ranges.clear();
+    ranges.append({0, V2_HEADER_SIZE});
+    for (qint64 i = 0; i < frameCount; ++i) {
+        const unsigned char *entry = entries + i * V2_INDEX_ENTRY_SIZE;
+        const qint64 fileOffset = qint64(qFromLittleEndian<quint64>(entry));
+        
+        // Длина кадра - разность смещений открытого текста, у последнего - из заголовка кадра
+        qint64 plainLength = 0;
+        if (i + 1 < frameCount) {
+            plainLength = qint64(qFromLittleEndian<quint64>(entry + V2_INDEX_ENTRY_SIZE + 8) - qFromLittleEndian<quint64>(entry + 8));
+        } else {
+            QByteArray frameHeader;
+            if (device->seek(fileOffset)) {
+                frameHeader = device->read(V2_FRAME_HEADER_SIZE);
+            }
+            if (frameHeader.size() != V2_FRAME_HEADER_SIZE) {
+                errorMessage = QString("Контейнер v2 повреждён: последний кадр обрезан.");
+                return false;
+            }
+            plainLength = qFromLittleEndian<quint32>(reinterpret_cast<const unsigned char*>(frameHeader.constData()));
+            if (plainLength > qint64(frameSize)) {
+                errorMessage = QString("Контейнер v2 повреждён: некорректная длина кадра %1.").arg(i);
+                return false;
+            }
+        }
+        
+        const qint64 length = V2_FRAME_OVERHEAD + plainLength;
+        FileRange &last = ranges.last();
+        if (last.offset + last.length == fileOffset) {
+            last.length += length;
+        } else {
+            ranges.append({fileOffset, length});
+        }
+    }
+    return true;
+}
+
+bool EncryptionManager::appendV2(QFile *file, qint64 keepPlainSize, const QByteArray &plainData,
+                                 const QByteArray &closing, QString &errorMessage, const SyncHandler &sync) const
+{
+    if (!isReady()) {
+        errorMessage = QString("Ключ шифрования не загружен.");
+        return false;
+    }
+    
+    QByteArray header;
+    QByteArray index;
+    qint64 first = 0;
+    QByteArray kept;
+    V2Cursor cursor = {0, 0, 0, QByteArray()};
+    
+    if (file->size() == 0) {
+        // Пустой файл становится новым контейнером: заголовок, кадры данных и последний кадр
+        header = QByteArray(V2_HEADER_SIZE, '\0');
+        unsigned char *headerData = reinterpret_cast<unsigned char*>(header.data());
+        std::memcpy(headerData, V2_MAGIC, sizeof(V2_MAGIC));
+        qToLittleEndian<quint32>(V2_VERSION, headerData + 8);
+        qToLittleEndian<quint32>(quint32(V2_DEFAULT_FRAME_SIZE), headerData + 12);
+        if (!file->seek(0) || file->write(header) != header.size()) {
+            errorMessage = QString("Ошибка записи файла: %1").arg(file->errorString());
+            return false;
+        }
+        cursor.fileOffset = V2_HEADER_SIZE;
+    } else {
+        if (!readV2Index(file, header, index, errorMessage)) {
+            return false;
+        }
+        const qint64 frameCount = index.size() / V2_INDEX_ENTRY_SIZE;
+        const unsigned char *entries = reinterpret_cast<const unsigned char*>(index.constData());
+        
+        // Кадр, в котором заканчивается сохраняемая часть открытого текста: он и все последующие
+        // заменяются, предшествующие кадры не читаются и не изменяются. Обычно граница совпадает
+        // с началом последнего кадра, и заменяется только он
+        first = frameCount - 1;
+        while (first > 0 && qint64(qFromLittleEndian<quint64>(entries + first * V2_INDEX_ENTRY_SIZE + 8)) > keepPlainSize) {
+            --first;
+        }
+        const qint64 firstPlainOffset = qint64(qFromLittleEndian<quint64>(entries + first * V2_INDEX_ENTRY_SIZE + 8));
+        const qint64 keepInFrame = keepPlainSize - firstPlainOffset;
+        
+        kept = readV2Range(file, firstPlainOffset, keepInFrame, errorMessage);
+        if (kept.size() != keepInFrame) {
+            if (errorMessage.isEmpty()) {
+                errorMessage = QString("Сохраняемая часть превышает размер открытого текста контейнера.");
+            }
+            return false;
+        }
+        
+        // Новые кадры, индекс и окончание дописываются после конца файла: прежние кадры, индекс
+        // и окончание остаются на месте, и до записи нового окончания действует прежняя версия
+        cursor.frameIndex = quint64(first);
+        cursor.fileOffset = file->size();
+        cursor.plainOffset = firstPlainOffset;
+        cursor.index = index.left(first * V2_INDEX_ENTRY_SIZE);
+        if (!file->seek(cursor.fileOffset)) {
+            errorMessage = QString("Ошибка записи файла: %1").arg(file->errorString());
+            return false;
+        }
+    }
+    
+    const unsigned char *headerData = reinterpret_cast<const unsigned char*>(header.constData());
+    if (!writeV2Frames(file, headerData, kept.constData(), kept.size(), false, cursor, errorMessage)
+        || !writeV2Frames(file, headerData, plainData.constData(), plainData.size(), false, cursor, errorMessage)
+        || !writeV2Frames(file, headerData, closing.constData(), closing.size(), true, cursor, errorMessage)) {
+        return false;
+    }
+    
+    // Окончание пишется только после того, как кадры и индекс сброшены на диск: иначе при сбое
+    // на диске могло бы оказаться окончание, указывающее на недописанные кадры
+    if (file->write(cursor.index) != cursor.index.size()) {
+        errorMessage = QString("Ошибка записи файла: %1").arg(file->errorString());
+        return false;
+    }
+    if (sync ? !sync(errorMessage) : !file->flush()) {
+        if (errorMessage.isEmpty()) {
+            errorMessage = QString("Ошибка записи файла: %1").arg(file->errorString());
+        }
+        return false;
+    }
+    unsigned char trailer[V2_TRAILER_SIZE];
+    qToLittleEndian<quint64>(quint64(cursor.fileOffset), trailer);
+    qToLittleEndian<quint64>(cursor.frameIndex, trailer + 8);
+    std::memcpy(trailer + 16, V2_INDEX_MAGIC, sizeof(V2_INDEX_MAGIC));
+    if (file->write(reinterpret_cast<const char*>(trailer), V2_TRAILER_SIZE) != V2_TRAILER_SIZE) {
+        errorMessage = QString("Ошибка записи файла: %1").arg(file->errorString());
+        return false;
+    }
+    
+    // Каждое дописывание оставляет заменённые последний кадр, индекс и окончание. Когда они
+    // занимают больше половины файла, контейнер уплотняется: затраты на уплотнение пропорциональны
+    // действующему размеру и распределяются на дописывания, накопившие не меньше мёртвых байт
+    const qint64 fileSize = cursor.fileOffset + cursor.index.size() + V2_TRAILER_SIZE;
+    const qint64 liveSize = V2_HEADER_SIZE + cursor.plainOffset
+        + qint64(cursor.frameIndex) * (V2_FRAME_OVERHEAD + V2_INDEX_ENTRY_SIZE) + V2_TRAILER_SIZE;
+    if (fileSize >= V2_COMPACT_MIN_SIZE && fileSize - liveSize > liveSize) {
+        // Группа уже зафиксирована: ошибка уплотнения оставляет файл целым и не отменяет её
+        QString compactError;
+        if (!compactV2(file, header, cursor.index, compactError, sync)) {
+            qCWarning(lcCrypto) << "EncryptionManager: Не удалось уплотнить контейнер v2:" << compactError;
+        }
+    }
+    return true;
+}
+
+bool EncryptionManager::writeV2Frames(QIODevice *output, const unsigned char *header, const char *plain,
+                                      qint64 length, bool isLast, V2Cursor &cursor, QString &errorMessage) const
+{
+    const qint64 frameSize = qFromLittleEndian<quint32>(header + 12);
+    const qint64 frameCount = qMax<qint64>(isLast ? 1 : 0, (length + frameSize - 1) / frameSize);
+    if (frameCount == 0) {
+        return true;
+    }
+    
+    QVector<V2Frame> frames;
+    frames.reserve(frameCount);
+    qint64 sealedSize = 0;
+    for (qint64 i = 0; i < frameCount; ++i) {
+        quint32 plainLength = quint32(qMin<qint64>(frameSize, length - i * frameSize));
+        frames.append({cursor.frameIndex + quint64(i), sealedSize, i * frameSize, plainLength, false});
+        sealedSize += qint64(plainLength) + V2_FRAME_OVERHEAD;
+    }
+    
+    QByteArray sealed(sealedSize, Qt::Uninitialized);
+    unsigned char *out = reinterpret_cast<unsigned char*>(sealed.data());
+    const unsigned char *plainData = reinterpret_cast<const unsigned char*>(plain);
+    const quint64 lastFrame = isLast ? cursor.frameIndex + quint64(frameCount) - 1 : ~quint64(0);
+    auto sealOne = [this, header, out, plainData, lastFrame](V2Frame &frame) {
+        quint32 flags = frame.index == lastFrame ? V2_FLAG_LAST_FRAME : 0;
+        frame.ok = sealFrame(header, frame.index, flags, plainData + frame.plainOffset,
+                             frame.plainLength, out + frame.fileOffset);
+    };
+    if (frames.size() == 1) {
+        sealOne(frames.first());
+    } else {
+        QtConcurrent::blockingMap(frames, sealOne);
+    }
+    
+    for (const V2Frame &frame : frames) {
+        if (!frame.ok) {
+            errorMessage = QString("Ошибка при шифровании кадра %1.").arg(frame.index);
+            return false;
+        }
+        unsigned char entry[V2_INDEX_ENTRY_SIZE];
+        qToLittleEndian<quint64>(quint64(cursor.fileOffset + frame.fileOffset), entry);
+        qToLittleEndian<quint64>(quint64(cursor.plainOffset + frame.plainOffset), entry + 8);
+        cursor.index.append(reinterpret_cast<const char*>(entry), V2_INDEX_ENTRY_SIZE);
+    }
+    if (output->write(sealed) != sealedSize) {
+        errorMessage = QString("Ошибка записи файла: %1").arg(output->errorString());
+        return false;
+    }
+    cursor.frameIndex += quint64(frameCount);
+    cursor.fileOffset += sealedSize;
+    cursor.plainOffset += length;
+    return true;
+}
+
+bool EncryptionManager::compactV2(QFile *file, const QByteArray &header, const QByteArray &index,
+                                  QString &errorMessage, const SyncHandler &sync) const
+{
+    const unsigned char *headerData = reinterpret_cast<const unsigned char*>(header.constData());
+    const qint64 frameSize = qFromLittleEndian<quint32>(headerData + 12);
+    // Последний кадр (закрывающая часть текста) остаётся отдельным, чтобы следующее дописывание
+    // снова заменяло только его
+    const qint64 lastFrameOffset = qint64(qFromLittleEndian<quint64>(
+        reinterpret_cast<const unsigned char*>(index.constData()) + index.size() - V2_INDEX_ENTRY_SIZE + 8));
+    auto syncFile = [file, &sync](QString &message) {
+        if (sync ? !sync(message) : !file->flush()) {
+            if (message.isEmpty()) {
+                message = QString("Ошибка записи файла: %1").arg(file->errorString());
+            }
+            return false;
+        }
+        return true;
+    };
+    
+    // Шаг 1: копия действующего текста полными кадрами дописывается после конца файла. Текст
+    // читается отдельным дескриптором, пока в конец файла пишется копия
+    if (!syncFile(errorMessage)) {
+        return false;
+    }
+    const qint64 copyStart = file->size();
+    QFile source(file->fileName());
+    if (!source.open(QIODevice::ReadOnly) || !file->seek(copyStart)) {
+        errorMessage = QString("Не удалось открыть файл: %1").arg(source.errorString());
+        return false;
+    }
+    
+    const qint64 batchSize = qMax(1, QThread::idealThreadCount()) * frameSize;
+    V2Cursor cursor = {0, copyStart, 0, QByteArray()};
+    QByteArray plain;
+    QString writeError;
+    bool copied = decryptStream(&source, [&](const char *data, qsizetype size) {
+        plain.append(data, size);
+        const qint64 ready = qMin<qint64>(plain.size(), lastFrameOffset - cursor.plainOffset) / frameSize * frameSize;
+        if (ready < batchSize) {
+            return true;
+        }
+        if (!writeV2Frames(file, headerData, plain.constData(), ready, false, cursor, writeError)) {
+            return false;
+        }
+        plain.remove(0, ready);
+        return true;
+    }, errorMessage);
+    
+    const qint64 dataLength = lastFrameOffset - cursor.plainOffset;
+    copied = copied && dataLength >= 0 && dataLength <= plain.size()
+        && writeV2Frames(file, headerData, plain.constData(), dataLength, false, cursor, writeError)
+        && writeV2Frames(file, headerData, plain.constData() + dataLength, plain.size() - dataLength, true,
+                         cursor, writeError);
+    source.close();
+    
+    unsigned char trailer[V2_TRAILER_SIZE];
+    qToLittleEndian<quint64>(quint64(cursor.fileOffset), trailer);
+    qToLittleEndian<quint64>(cursor.frameIndex, trailer + 8);
+    std::memcpy(trailer + 16, V2_INDEX_MAGIC, sizeof(V2_INDEX_MAGIC));
+    copied = copied && file->write(cursor.index) == cursor.index.size() && syncFile(writeError)
+        && file->write(reinterpret_cast<const char*>(trailer), V2_TRAILER_SIZE) == V2_TRAILER_SIZE
+        && syncFile(writeError);
+    if (!copied) {
+        // Недописанная копия не зафиксирована окончанием; отбрасываем её, чтобы чтение
+        // не искало действующее окончание через неё
+        file->resize(copyStart);
+        if (!writeError.isEmpty()) {
+            errorMessage = writeError;
+        } else if (errorMessage.isEmpty()) {
+            errorMessage = QString("Ошибка записи файла: %1").arg(file->errorString());
+        }
+        return false;
+    }
+    
+    // Шаг 2: копия переносится в начало файла. Кадры не зависят от своего положения в файле,
+    // поэтому копируются без перешифрования, а индекс пересчитывается. Копия не длиннее
+    // действующей версии, а та меньше половины файла, поэтому перенос не задевает саму копию
+    const qint64 shift = copyStart - V2_HEADER_SIZE;
+    const qint64 framesSize = cursor.fileOffset - copyStart;
+    QByteArray buffer;
+    for (qint64 done = 0; done < framesSize; done += buffer.size()) {
+        buffer.clear();
+        if (file->seek(copyStart + done)) {
+            buffer = file->read(qMin<qint64>(framesSize - done, STREAM_CHUNK_SIZE));
+        }
+        if (buffer.isEmpty() || !file->seek(V2_HEADER_SIZE + done) || file->write(buffer) != buffer.size()) {
+            errorMessage = QString("Ошибка записи файла: %1").arg(file->errorString());
+            return false;
+        }
+    }
+    unsigned char *entries = reinterpret_cast<unsigned char*>(cursor.index.data());
+    for (quint64 i = 0; i < cursor.frameIndex; ++i) {
+        unsigned char *entry = entries + i * V2_INDEX_ENTRY_SIZE;
+        qToLittleEndian<quint64>(qFromLittleEndian<quint64>(entry) - quint64(shift), entry);
+    }
+    qToLittleEndian<quint64>(quint64(cursor.fileOffset - shift), trailer);
+    
+    // Окончание в конце файла действует, пока файл не обрезан: обрезка выполняется только
+    // после того, как перенесённая копия сброшена на диск
+    const qint64 compactSize = cursor.fileOffset - shift + cursor.index.size() + V2_TRAILER_SIZE;
+    if (file->write(cursor.index) != cursor.index.size()
+        || file->write(reinterpret_cast<const char*>(trailer), V2_TRAILER_SIZE) != V2_TRAILER_SIZE) {
+        errorMessage = QString("Ошибка записи файла: %1").arg(file->errorString());
+        return false;
+    }
+    if (!syncFile(errorMessage)) {
+        return false;
+    }
+    if (!file->resize(compactSize)) {
+        errorMessage = QString("Не удалось обрезать файл: %1").arg(file->errorString());
+        return false;
+    }
+    qCDebug(lcCrypto) << "EncryptionManager::compactV2: Контейнер уплотнён с" << copyStart
+                      << "до" << compactSize << "байт";
+    return syncFile(errorMessage);
+}
@@ -3,11 +3,24 @@
 
 #include <QString>
 #include <QByteArray>
+#include <QVector>
+#include <functional>
+
+class QIODevice;
+class QFile;
 
 /// Класс для шифрования и расшифровки данных с использованием AES-256-CBC
+/// (формат v1) и контейнера из независимых кадров AES-256-GCM (формат v2)
 class EncryptionManager
 {
 public:
+    /// Версия формата файла
+    enum FormatVersion {
+        FormatPlain = 0,    ///< Файл не зашифрован
+        FormatV1 = 1,       ///< IV + единый поток AES-256-CBC, без заголовка (распознаётся по расширению .enc)
+        FormatV2 = 2        ///< Заголовок + кадры AES-256-GCM + индекс кадров
+    };
+    
     EncryptionManager();
     
     /// Загружает ключ шифрования из файла (поддерживает base64 и hex)
@@ -22,16 +35,173 @@ public:
     /// Шифрует данные, возвращает IV + зашифрованные данные
     QByteArray encrypt(const QByteArray &plainData, QString &errorMessage) const;
     
-    /// Расшифровывает данные (ожидает IV + зашифрованные данные)
+    /// Расшифровывает данные (ожидает IV + зашифрованные данные или контейнер v2)
     QByteArray decrypt(const QByteArray &encryptedData, QString &errorMessage) const;
+    
+    /// Параллельная расшифровка (IV + зашифрованные данные) на нескольких ядрах.
+    /// Шифротекст делится на диапазоны, каждый из которых расшифровывается независимо
+    /// с предыдущим блоком шифротекста в качестве IV; дополнение PKCS#7 снимается только
+    /// в последнем диапазоне. Результат побайтно совпадает с decrypt().
+    /// threadCount <= 0 - по числу доступных ядер
+    QByteArray decryptParallel(const QByteArray &encryptedData, QString &errorMessage, int threadCount = 0) const;
+    
+    /// Обработчик очередного фрагмента открытого текста; возврат false прерывает расшифровку
+    using ChunkHandler = std::function<bool(const char *data, qsizetype size)>;
+    
+    /// Потоковая расшифровка из устройства (IV + зашифрованные данные или контейнер v2).
+    /// Читает шифротекст блоками STREAM_CHUNK_SIZE на каждое ядро, расшифровывает блок параллельно
+    /// и передаёт открытый текст обработчику, поэтому потребление памяти не зависит от размера файла
+    bool decryptStream(QIODevice *input, const ChunkHandler &handler, QString &errorMessage) const;
+    
+    /// Источник открытого текста: заполняет buffer (не более capacity байт) и возвращает число
+    /// записанных байт; 0 - данные закончились, отрицательное значение прерывает шифрование
+    using ChunkSource = std::function<qsizetype(char *buffer, qsizetype capacity)>;
+    
+    /// Потоковое шифрование в устройство: format = FormatV1 даёт тот же формат, что encrypt()
+    /// (IV + AES-256-CBC), FormatV2 - контейнер v2, как encryptV2(). Открытый текст запрашивается
+    /// у источника блоками, поэтому потребление памяти не зависит от размера данных
+    bool encryptStream(const ChunkSource &source, QIODevice *output, QString &errorMessage,
+                       FormatVersion format = FormatV2) const;
+    
+    /// Проверяет, начинаются ли данные с заголовка контейнера v2
+    static bool hasV2Header(const QByteArray &data);
+    
+    /// Определяет формат файла: v2 - по заголовку, v1 - по расширению .enc
+    static FormatVersion detectFileFormat(const QString &filePath);
+    
+    /// Шифрует данные в контейнер v2. Каждый кадр (frameSize байт открытого текста)
+    /// шифруется AES-256-GCM со своим nonce и тегом независимо от остальных, поэтому
+    /// кадры обрабатываются параллельно; номер кадра и признак последнего кадра
+    /// входят в аутентифицируемые данные, что исключает перестановку и усечение кадров
+    QByteArray encryptV2(const QByteArray &plainData, QString &errorMessage,
+                         int frameSize = V2_DEFAULT_FRAME_SIZE) const;
+    
+    /// Расшифровывает контейнер v2 целиком, проверяя подлинность каждого кадра (параллельно)
+    QByteArray decryptV2(const QByteArray &container, QString &errorMessage) const;
+    
+    /// Читает диапазон открытого текста из контейнера v2 с произвольным доступом:
+    /// по индексу кадров находит и расшифровывает только затронутые кадры
+    QByteArray readV2Range(QIODevice *device, qint64 plainOffset, qint64 length, QString &errorMessage) const;
+    
+    /// Размер открытого текста контейнера v2 (по индексу кадров, без расшифровки); -1 при ошибке
+    qint64 plainSizeV2(QIODevice *device, QString &errorMessage) const;
+    
+    /// Участок файла: смещение и длина в байтах
+    struct FileRange
+    {
+        qint64 offset;
+        qint64 length;
+    };
+    
+    /// Участки файла контейнера v2, составляющие его действующую версию: заголовок и кадры
+    /// в порядке индекса (соседние кадры объединены). Последовательное чтение этих участков
+    /// даёт поток, который принимает decryptStream, без кадров, заменённых дописыванием
+    bool readV2Ranges(QIODevice *device, QVector<FileRange> &ranges, QString &errorMessage) const;
+    
+    /// Сброс записанных данных на диск; возврат false прерывает запись
+    using SyncHandler = std::function<bool(QString &errorMessage)>;
+    
+    /// Дописывание в контейнер v2 без перешифрования его начала: открытый текст обрезается
+    /// до keepPlainSize байт и дополняется plainData и closing. plainData шифруется отдельными
+    /// короткими кадрами, closing - отдельным последним кадром, поэтому при следующем дописывании
+    /// с keepPlainSize, равным началу closing, заменяется только этот маленький кадр (если граница
+    /// обрезки проходит внутри кадра, заново шифруется и сохраняемое начало этого кадра). Кадры,
+    /// индекс и окончание дописываются после конца файла, сбрасываются на диск вызовом sync
+    /// (без него - только flush), и лишь затем дописывается окончание, которое делает их
+    /// действующей версией. Когда заменённые кадры и индексы занимают больше половины файла,
+    /// контейнер уплотняется на месте (см. compactV2). Пустой файл становится новым контейнером.
+    /// Файл должен быть открыт для чтения и записи
+    bool appendV2(QFile *file, qint64 keepPlainSize, const QByteArray &plainData, const QByteArray &closing,
+                  QString &errorMessage, const SyncHandler &sync = SyncHandler()) const;
+    
+    static const int STREAM_CHUNK_SIZE = 1 << 20;  // Размер блока потоковой расшифровки (1 МиБ)
+    static const int V2_DEFAULT_FRAME_SIZE = 1 << 20;  // Размер кадра контейнера v2 по умолчанию (1 МиБ)
+    static const int PARALLEL_THRESHOLD = 4 << 20; // Начиная с этого размера decrypt() работает параллельно
 
 private:
     static const int KEY_SIZE = 32;  // Размер ключа AES-256 (32 байта)
     static const int IV_SIZE = 16;   // Размер вектора инициализации (16 байт)
     
+    static const int AES_BLOCK = 16;             // Размер блока AES
+    static const int MIN_RANGE_SIZE = 256 << 10; // Минимальный диапазон на один поток (256 КиБ)
+    static const int MAX_RANGE_SIZE = 256 << 20; // Максимальный диапазон (ограничение int в EVP API)
+    
     /// Декодирует ключ из различных форматов (base64, hex, raw)
     static QByteArray decodeKey(const QByteArray &rawKey);
     
+    /// Расшифровывает непрерывный участок шифротекста CBC, разбивая его на диапазоны по потокам.
+    /// iv - IV файла или последний блок предшествующего шифротекста; при isFinal = true
+    /// снимается дополнение PKCS#7. Возвращает размер открытого текста или -1 при ошибке
+    qint64 decryptCbcSegment(const unsigned char *iv, const unsigned char *ciphertext, qint64 length,
+                             unsigned char *plaintext, bool isFinal, int threadCount) const;
+    
+    // Структура контейнера v2 (все целые - little-endian):
+    //   заголовок:  сигнатура "INVENC02", версия u32, размер кадра u32, 16 байт резерва
+    //   кадр:       длина открытого текста u32, флаги u32, nonce[12], шифротекст, тег GCM[16]
+    //   индекс:     на каждый кадр - смещение кадра в файле u64, смещение открытого текста u64
+    //   окончание:  смещение индекса u64, число кадров u64, сигнатура "INVIDX02"
+    // Индекс лежит непосредственно перед окончанием. appendV2 дописывает кадры, индекс и окончание
+    // в конец файла, поэтому кадры действующей версии не обязательно идут подряд, а кадры, кроме
+    // последнего, могут быть короче размера кадра: действует последнее окончание файла, прошедшее
+    // проверку, а его индекс указывает, где лежит каждый кадр
+    static const int V2_HEADER_SIZE = 32;
+    static const int V2_NONCE_SIZE = 12;
+    static const int V2_TAG_SIZE = 16;
+    static const int V2_FRAME_HEADER_SIZE = 8 + V2_NONCE_SIZE;
+    static const int V2_FRAME_OVERHEAD = V2_FRAME_HEADER_SIZE + V2_TAG_SIZE;
+    static const int V2_INDEX_ENTRY_SIZE = 16;
+    static const int V2_TRAILER_SIZE = 24;
+    static const int V2_MAX_FRAME_SIZE = 64 << 20;
+    static const quint32 V2_FLAG_LAST_FRAME = 1;
+    static const int V2_COMPACT_MIN_SIZE = 1 << 20;  // Файлы меньше этого размера не уплотняются
+    
+    /// Позиция записи кадров v2: номер следующего кадра, его смещения в файле и в открытом тексте
+    /// и индекс уже записанных кадров
+    struct V2Cursor
+    {
+        quint64 frameIndex;
+        qint64 fileOffset;
+        qint64 plainOffset;
+        QByteArray index;
+    };
+    
+    /// Шифрует один кадр v2 в out (V2_FRAME_OVERHEAD + length байт)
+    bool sealFrame(const unsigned char *header, quint64 frameIndex, quint32 flags,
+                   const unsigned char *plain, quint32 length, unsigned char *out) const;
+    
+    /// Проверяет тег и расшифровывает кадр v2; длина открытого текста берётся из заголовка кадра
+    bool openFrame(const unsigned char *header, quint64 frameIndex,
+                   const unsigned char *frame, unsigned char *plainOut) const;
+    
+    /// Шифрует length байт открытого текста кадрами не больше frameSize (пачка кадров - параллельно)
+    /// и записывает их в текущую позицию output, которая должна совпадать с cursor.fileOffset.
+    /// При isLast последний кадр получает признак последнего (пустой текст - один пустой кадр),
+    /// иначе пустой текст не даёт кадров
+    bool writeV2Frames(QIODevice *output, const unsigned char *header, const char *plain, qint64 length,
+                       bool isLast, V2Cursor &cursor, QString &errorMessage) const;
+    
+    /// Уплотнение контейнера v2 на месте: действующий открытый текст шифруется заново полными
+    /// кадрами (последний кадр остаётся отдельным) и дописывается после конца файла с индексом
+    /// и окончанием, затем эта копия переносится в начало файла и файл обрезается. До обрезки
+    /// действует окончание в конце файла, поэтому при сбое на любом шаге файл остаётся целым
+    bool compactV2(QFile *file, const QByteArray &header, const QByteArray &index, QString &errorMessage,
+                   const SyncHandler &sync) const;
+    
+    /// Чтение и проверка заголовка, окончания и индекса кадров контейнера v2 с произвольным доступом.
+    /// Если окончание в конце файла повреждено (дописывание оборвалось), берётся предыдущее
+    bool readV2Index(QIODevice *device, QByteArray &header, QByteArray &index, QString &errorMessage) const;
+    
+    /// Проверка окончания, которое заканчивается в позиции end, и чтение его индекса
+    bool readV2Trailer(QIODevice *device, qint64 end, quint32 frameSize, QByteArray &index) const;
+    
+    /// Потоковая расшифровка контейнера v2: кадры читаются пачками по числу ядер
+    bool decryptStreamV2(QIODevice *input, const ChunkHandler &handler, QString &errorMessage) const;
+    
+    /// Потоковое шифрование: v1 - последовательно блоками STREAM_CHUNK_SIZE,
+    /// v2 - пачками кадров по числу ядер, кадры пачки шифруются параллельно
+    bool encryptStreamV1(const ChunkSource &source, QIODevice *output, QString &errorMessage) const;
+    bool encryptStreamV2(const ChunkSource &source, QIODevice *output, QString &errorMessage) const;
+    
     QByteArray key;  // Ключ шифрования
 };
 
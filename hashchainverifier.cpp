@@ -0,0 +1,216 @@
+#include "hashchainverifier.h"
+#include "ledgerstore.h"
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent/QtConcurrentMap>
+#include <openssl/evp.h>
+#include <atomic>
+#include <cstring>
+
+namespace {
+
+// Сегмент цепочки для параллельной проверки
+struct ChainSegment
+{
+    qsizetype begin;
+    qsizetype end;
+};
+
+// Сегмент проверяется порциями, чтобы вовремя остановиться, если нарушение уже найдено раньше
+const qsizetype SEGMENT_STEP = 4096;
+
+// Запись десятичного представления числа; возвращает количество записанных символов
+inline int writeDecimal(qint64 value, char *out)
+{
+    char digits[20];
+    int count = 0;
+    quint64 magnitude = value < 0 ? quint64(0) - quint64(value) : quint64(value);
+    do {
+        digits[count++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    int length = 0;
+    if (value < 0) {
+        out[length++] = '-';
+    }
+    while (count > 0) {
+        out[length++] = digits[--count];
+    }
+    return length;
+}
+
+// Реализация алгоритма цепочки в OpenSSL
+EVP_MD *fetchDigest(LedgerStore::HashAlgorithm algorithm)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    // Явная выборка реализации один раз вместо неявной при каждой инициализации контекста
+    switch (algorithm) {
+    case LedgerStore::HashSha256:
+        return EVP_MD_fetch(nullptr, "SHA256", nullptr);
+    case LedgerStore::HashBlake2s:
+        return EVP_MD_fetch(nullptr, "BLAKE2S-256", nullptr);
+    default:
+        return EVP_MD_fetch(nullptr, "MD5", nullptr);
+    }
+#else
+    switch (algorithm) {
+    case LedgerStore::HashSha256:
+        return const_cast<EVP_MD*>(EVP_sha256());
+    case LedgerStore::HashBlake2s:
+        return const_cast<EVP_MD*>(EVP_blake2s256());
+    default:
+        return const_cast<EVP_MD*>(EVP_md5());
+    }
+#endif
+}
+
+}
+
+HashChainVerifier::HashChainVerifier(LedgerStore::HashAlgorithm algorithm)
+    : context(EVP_MD_CTX_new())
+    , digest(fetchDigest(algorithm))
+    , hashAlgorithm(algorithm)
+{
+}
+
+HashChainVerifier::~HashChainVerifier()
+{
+    EVP_MD_CTX_free(context);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    EVP_MD_free(digest);
+#endif
+}
+
+void HashChainVerifier::setAlgorithm(LedgerStore::HashAlgorithm algorithm)
+{
+    if (algorithm == hashAlgorithm) {
+        return;
+    }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    EVP_MD_free(digest);
+#endif
+    digest = fetchDigest(algorithm);
+    hashAlgorithm = algorithm;
+}
+
+int HashChainVerifier::formatMessage(quint64 article, qint32 quantity, qint64 timestamp,
+                                     const uchar *previousHash, char *out)
+{
+    LedgerStore::formatArticle(article, out);
+    int length = LedgerStore::ARTICLE_DIGITS;
+    length += writeDecimal(quantity, out + length);
+    length += writeDecimal(timestamp, out + length);
+    if (previousHash) {
+        LedgerStore::encodeHash(previousHash, out + length);
+        length += 24;
+    }
+    return length;
+}
+
+bool HashChainVerifier::computeDigest(quint64 article, qint32 quantity, qint64 timestamp,
+                                      const uchar *previousHash, uchar *out)
+{
+    char message[MAX_MESSAGE_SIZE];
+    const int length = formatMessage(article, quantity, timestamp, previousHash, message);
+
+    if (!context || !digest
+        || EVP_DigestInit_ex(context, digest, nullptr) != 1
+        || EVP_DigestUpdate(context, message, size_t(length)) != 1) {
+        return false;
+    }
+
+    unsigned int digestLength = 0;
+    if (hashAlgorithm == LedgerStore::HashMd5) {
+        return EVP_DigestFinal_ex(context, out, &digestLength) == 1 && digestLength == HASH_SIZE;
+    }
+
+    // SHA-256 и BLAKE2s-256 усекаются до размера хеша цепочки
+    uchar full[EVP_MAX_MD_SIZE];
+    if (EVP_DigestFinal_ex(context, full, &digestLength) != 1 || digestLength < HASH_SIZE) {
+        return false;
+    }
+    std::memcpy(out, full, HASH_SIZE);
+    return true;
+}
+
+qsizetype HashChainVerifier::verifyRange(const LedgerStore &store, qsizetype begin, qsizetype end,
+                                         const uchar *seed)
+{
+    const uchar *previousHash = seed;
+    uchar expected[HASH_SIZE];
+
+    for (qsizetype i = begin; i < end; ++i) {
+        const uchar *storedHash = store.hash(i);
+        if (!store.hasCanonicalHash(i)
+            || !computeDigest(store.article(i), store.quantity(i), store.timestamp(i), previousHash, expected)
+            || std::memcmp(expected, storedHash, HASH_SIZE) != 0) {
+            return i;
+        }
+        // Хеш записи совпал с вычисленным, поэтому следующее звено строится от сохранённого
+        previousHash = storedHash;
+    }
+    return end;
+}
+
+qsizetype HashChainVerifier::verify(LedgerStore &store)
+{
+    const qsizetype firstInvalid = verifyRange(store, 0, store.size(), nullptr);
+    store.markInvalidFrom(firstInvalid);
+    return firstInvalid;
+}
+
+qsizetype HashChainVerifier::verifyParallel(LedgerStore &store, int threadCount)
+{
+    const qsizetype firstInvalid = verifyRangeParallel(store, 0, store.size(), nullptr, threadCount);
+    store.markInvalidFrom(firstInvalid);
+    return firstInvalid;
+}
+
+qsizetype HashChainVerifier::verifyRangeParallel(const LedgerStore &store, qsizetype begin, qsizetype end,
+                                                 const uchar *seed, int threadCount)
+{
+    const qsizetype count = end - begin;
+    if (threadCount <= 0) {
+        threadCount = QThread::idealThreadCount();
+    }
+
+    qsizetype segmentSize = qMax<qsizetype>(MIN_SEGMENT_SIZE, (count + threadCount - 1) / qMax(1, threadCount));
+    const LedgerStore::HashAlgorithm algorithm = store.hashAlgorithm();
+    if (threadCount <= 1 || count <= segmentSize) {
+        HashChainVerifier verifier(algorithm);
+        return verifier.verifyRange(store, begin, end, seed);
+    }
+
+    QVector<ChainSegment> segments;
+    for (qsizetype segmentBegin = begin; segmentBegin < end; segmentBegin += segmentSize) {
+        segments.append({segmentBegin, qMin(end, segmentBegin + segmentSize)});
+    }
+
+    std::atomic<qsizetype> firstInvalid(end);
+    const qsizetype rangeBegin = begin;
+
+    QtConcurrent::blockingMap(segments, [&store, &firstInvalid, rangeBegin, seed, algorithm](const ChainSegment &segment) {
+        HashChainVerifier verifier(algorithm);
+        const uchar *segmentSeed = segment.begin > rangeBegin ? store.hash(segment.begin - 1) : seed;
+
+        for (qsizetype stepBegin = segment.begin; stepBegin < segment.end; stepBegin += SEGMENT_STEP) {
+            // Нарушение раньше этого участка уже найдено: результат не повлияет на ответ
+            if (firstInvalid.load(std::memory_order_relaxed) < stepBegin) {
+                return;
+            }
+
+            const qsizetype stepEnd = qMin(segment.end, stepBegin + SEGMENT_STEP);
+            const qsizetype mismatch = verifier.verifyRange(store, stepBegin, stepEnd, segmentSeed);
+            if (mismatch < stepEnd) {
+                qsizetype current = firstInvalid.load();
+                while (mismatch < current && !firstInvalid.compare_exchange_weak(current, mismatch)) {
+                }
+                return;
+            }
+            segmentSeed = store.hash(stepEnd - 1);
+        }
+    });
+
+    return firstInvalid.load();
+}
@@ -0,0 +1,74 @@
+#ifndef HASHCHAINVERIFIER_H
+#define HASHCHAINVERIFIER_H
+
+#include "ledgerstore.h"
+#include <QtGlobal>
+
+struct evp_md_ctx_st;
+struct evp_md_st;
+
+// Ядро проверки цепочки хешей hash_i = H(article + quantity + timestamp + hash_i-1), где H -
+// алгоритм цепочки (LedgerStore::HashAlgorithm): MD5 или первые 16 байт SHA-256 / BLAKE2s-256.
+// Реализация алгоритма выбирается один раз при создании объекта; OpenSSL сам использует
+// доступные расширения процессора (SHA-NI, AVX2). Сообщение записи собирается в буфер на стеке,
+// дайджест вычисляется переиспользуемым контекстом, а сравнение выполняется по 16 байтам
+// без base64 и без выделений памяти.
+// Единственная реализация формулы: её используют загрузка, слежение за файлом, LedgerWriter
+// и утилиты. Объект не потокобезопасен:
+// для параллельной проверки каждому потоку нужен свой экземпляр.
+class HashChainVerifier
+{
+public:
+    static const int HASH_SIZE = 16;
+    // Максимальная длина сообщения: артикул (10) + int32 (11) + int64 (20) + base64 хеша (24)
+    static const int MAX_MESSAGE_SIZE = 10 + 11 + 20 + 24;
+
+    explicit HashChainVerifier(LedgerStore::HashAlgorithm algorithm = LedgerStore::HashMd5);
+    ~HashChainVerifier();
+
+    LedgerStore::HashAlgorithm algorithm() const { return hashAlgorithm; }
+    // Смена алгоритма (например, после чтения заголовка файла)
+    void setAlgorithm(LedgerStore::HashAlgorithm algorithm);
+
+    HashChainVerifier(const HashChainVerifier &) = delete;
+    HashChainVerifier &operator=(const HashChainVerifier &) = delete;
+
+    // Формирует сообщение записи в out (не менее MAX_MESSAGE_SIZE байт), возвращает его длину.
+    // previousHash == nullptr - первая запись цепочки (пустой предыдущий хеш)
+    static int formatMessage(quint64 article, qint32 quantity, qint64 timestamp,
+                             const uchar *previousHash, char *out);
+
+    // Вычисляет хеш записи (16 байт) в out
+    bool computeDigest(quint64 article, qint32 quantity, qint64 timestamp,
+                       const uchar *previousHash, uchar *out);
+
+    // Проверяет записи [begin, end) хранилища алгоритмом этого объекта; seed - хеш записи begin-1 (nullptr для начала цепочки).
+    // Возвращает индекс первой записи с несовпадающим хешем или end, если все записи верны
+    qsizetype verifyRange(const LedgerStore &store, qsizetype begin, qsizetype end, const uchar *seed);
+
+    // Проверяет всю цепочку и помечает невалидными первую нарушенную запись и все последующие.
+    // Возвращает индекс первой невалидной записи или store.size()
+    qsizetype verify(LedgerStore &store);
+
+    // Параллельная проверка всей цепочки алгоритмом хранилища с тем же результатом, что и verify().
+    // Ожидаемый хеш записи зависит только от сохранённого хеша предыдущей, поэтому хранилище
+    // делится на сегменты, каждый из которых проверяется независимо от сохранённого хеша
+    // записи перед сегментом. Первая нарушенная запись - минимальная по всем сегментам:
+    // все сегменты до неё прошли проверку, значит и затравка её сегмента верна.
+    // threadCount <= 0 - по числу доступных ядер
+    static qsizetype verifyParallel(LedgerStore &store, int threadCount = 0);
+
+    // Параллельный вариант verifyRange: проверяет [begin, end) от затравки seed, не изменяя хранилище
+    static qsizetype verifyRangeParallel(const LedgerStore &store, qsizetype begin, qsizetype end,
+                                         const uchar *seed, int threadCount = 0);
+
+    // Сегменты меньше этого размера не выделяются: накладные расходы превысят выигрыш
+    static const int MIN_SEGMENT_SIZE = 16384;
+
+private:
+    evp_md_ctx_st *context;
+    evp_md_st *digest;
+    LedgerStore::HashAlgorithm hashAlgorithm;
+};
+
+#endif
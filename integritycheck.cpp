@@ -1,11 +1,70 @@
 #include "integritycheck.h"
-#include <imagehlp.h>
 #include <QCryptographicHash>
 #include <QDebug>
+#include <atomic>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <imagehlp.h>
 
 #pragma comment(lib, "imagehlp.lib")
+#elif defined(Q_OS_LINUX)
+#include <link.h>
+#endif
+
+namespace {
 
-bool IntegrityCheck::getTextSegmentInfo(PVOID &baseAddress, SIZE_T &size)
+// Состояние последней проверки: читается перед каждой операцией без блокировок
+enum IntegrityState {
+    Unverified = 0,
+    Intact,
+    Violated
+};
+
+std::atomic<int> integrityState(Unverified);
+
+// Запись результата проверки. Однажды обнаруженное нарушение не сбрасывается последующими проверками
+bool recordResult(bool isValid)
+{
+    if (!isValid) {
+        integrityState = Violated;
+        return false;
+    }
+    int expected = Unverified;
+    integrityState.compare_exchange_strong(expected, Intact);
+    return integrityState.load() == Intact;
+}
+
+#if defined(Q_OS_LINUX)
+struct SegmentSearch
+{
+    const char *address = nullptr;
+    qsizetype size = 0;
+};
+
+// Первым dl_iterate_phdr перечисляет сам исполняемый файл: в нём ищется загружаемый
+// сегмент с правом исполнения, в который компоновщик помещает .text вместе с .init, .plt и .fini
+int findExecutableSegment(struct dl_phdr_info *info, size_t, void *data)
+{
+    SegmentSearch *search = static_cast<SegmentSearch*>(data);
+    
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) &header = info->dlpi_phdr[i];
+        if (header.p_type == PT_LOAD && (header.p_flags & PF_X)) {
+            search->address = reinterpret_cast<const char*>(info->dlpi_addr + header.p_vaddr);
+            search->size = static_cast<qsizetype>(header.p_memsz);
+            break;
+        }
+    }
+    
+    return 1;
+}
+#endif
+
+}
+
+#if defined(Q_OS_WIN)
+bool IntegrityCheck::getTextSegmentInfo(const char *&baseAddress, qsizetype &size)
 {
     HMODULE hModule = GetModuleHandle(nullptr);
     if (!hModule) {
@@ -26,7 +85,7 @@ bool IntegrityCheck::getTextSegmentInfo(PVOID &baseAddress, SIZE_T &size)
     
     for (int i = 0; i < ntHeaders->FileHeader.NumberOfSections; i++) {
         if (strcmp((char*)sectionHeader[i].Name, ".text") == 0) {
-            baseAddress = (PVOID)((BYTE*)hModule + sectionHeader[i].VirtualAddress);
+            baseAddress = (const char*)((BYTE*)hModule + sectionHeader[i].VirtualAddress);
             size = sectionHeader[i].Misc.VirtualSize;
             return true;
         }
@@ -34,11 +93,31 @@ bool IntegrityCheck::getTextSegmentInfo(PVOID &baseAddress, SIZE_T &size)
     
     return false;
 }
+#elif defined(Q_OS_LINUX)
+bool IntegrityCheck::getTextSegmentInfo(const char *&baseAddress, qsizetype &size)
+{
+    SegmentSearch search;
+    dl_iterate_phdr(findExecutableSegment, &search);
+    
+    if (!search.address || search.size <= 0) {
+        return false;
+    }
+    
+    baseAddress = search.address;
+    size = search.size;
+    return true;
+}
+#else
+bool IntegrityCheck::getTextSegmentInfo(const char *&, qsizetype &)
+{
+    return false;
+}
+#endif
 
 QByteArray IntegrityCheck::calculateTextSegmentHash()
 {
-    PVOID baseAddress = nullptr;
-    SIZE_T size = 0;
+    const char *baseAddress = nullptr;
+    qsizetype size = 0;
     
     if (!getTextSegmentInfo(baseAddress, size)) {
         return QByteArray();
@@ -46,7 +125,7 @@ QByteArray IntegrityCheck::calculateTextSegmentHash()
     
     QCryptographicHash hash(QCryptographicHash::Sha256);
     QByteArray segmentData = QByteArray::fromRawData(
-        reinterpret_cast<const char*>(baseAddress), 
+        baseAddress,
         static_cast<int>(size)
     );
     hash.addData(segmentData);
@@ -65,16 +144,14 @@ bool IntegrityCheck::verifyTextSegment()
     
     if (expectedHash.isEmpty()) {
         qDebug() << "IntegrityCheck: эталонный хеш не установлен, проверка пропущена";
-        #ifndef _DEBUG
-        #endif
-        return true;
+        return recordResult(true);
     }
     
     QByteArray calculatedHash = calculateTextSegmentHash();
     
     if (calculatedHash.isEmpty()) {
         qDebug() << "IntegrityCheck: не удалось вычислить хеш сегмента .text";
-        return false;
+        return recordResult(false);
     }
     
     bool isValid = (calculatedHash == expectedHash);
@@ -87,6 +164,42 @@ bool IntegrityCheck::verifyTextSegment()
         qDebug() << "IntegrityCheck: проверка целостности пройдена успешно";
     }
     
-    return isValid;
+    return recordResult(isValid);
+}
+
+void IntegrityCheck::reportViolation()
+{
+    recordResult(false);
 }
 
+bool IntegrityCheck::isIntact()
+{
+    const int state = integrityState.load();
+    if (state == Unverified) {
+        return verifyTextSegment();
+    }
+    return state == Intact;
+}
+
+QByteArray IntegrityCheck::calculatePageDigests(const char *baseAddress, qsizetype size)
+{
+    const qsizetype pageCount = (size + PAGE_BYTES - 1) / PAGE_BYTES;
+    QByteArray digests;
+    digests.reserve(pageCount * DIGEST_BYTES);
+    
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    for (qsizetype page = 0; page < pageCount; page++) {
+        digests.append(calculatePageDigest(hash, baseAddress, size, page));
+    }
+    
+    return digests;
+}
+
+QByteArray IntegrityCheck::calculatePageDigest(QCryptographicHash &hash, const char *baseAddress, qsizetype size, qsizetype page)
+{
+    const qsizetype offset = page * PAGE_BYTES;
+    const qsizetype length = size - offset < PAGE_BYTES ? size - offset : PAGE_BYTES;
+    hash.reset();
+    hash.addData(QByteArray::fromRawData(baseAddress + offset, static_cast<int>(length)));
+    return hash.result();
+}
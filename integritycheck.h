@@ -1,12 +1,13 @@
 #ifndef INTEGRITYCHECK_H
 #define INTEGRITYCHECK_H
 
-#include <windows.h>
 #include <QtCore/QtGlobal>
 #include <QByteArray>
+#include <QCryptographicHash>
 
 // Класс для самопроверки контрольной суммы части приложения в виртуальной памяти
-// Вычисляет SHA-256 хеш сегмента .text и сравнивает с эталонным значением
+// Вычисляет SHA-256 хеш сегмента кода (.text) и сравнивает с эталонным значением.
+// Сегмент находится по заголовкам PE (Windows) или по программным заголовкам ELF (Linux)
 class IntegrityCheck
 {
 public:
@@ -14,6 +15,14 @@ public:
     // Вычисляет текущий хеш и сравнивает с эталонным
     static bool verifyTextSegment();
     
+    // Фиксация нарушения, обнаруженного во время работы (IntegrityService): после неё
+    // isIntact() возвращает false
+    static void reportViolation();
+    
+    // Результат последней проверки без повторного вычисления хеша - для проверок перед операциями.
+    // Если проверка ещё не выполнялась, она выполняется сразу
+    static bool isIntact();
+    
     // Вычисление SHA-256 хеша сегмента .text
     // Возвращает хеш в формате QByteArray (32 байта)
     static QByteArray calculateTextSegmentHash();
@@ -21,12 +30,18 @@ public:
     // Получение эталонного хеша
     // В разработке возвращает пустой массив, в финальной версии должен содержать реальный хеш
     static QByteArray getExpectedHash();
-
-private:
-    // Получение информации о сегменте .text в PE-файле
-    // Возвращает адрес и размер сегмента в виртуальной памяти
-    static bool getTextSegmentInfo(PVOID &baseAddress, SIZE_T &size);
+    
+    // Получение адреса и размера сегмента кода исполняемого файла в виртуальной памяти
+    static bool getTextSegmentInfo(const char *&baseAddress, qsizetype &size);
+    
+    // Постраничные хеши сегмента кода для выборочной проверки во время работы:
+    // SHA-256 каждой страницы по PAGE_BYTES байт (последняя может быть короче), подряд по 32 байта
+    static QByteArray calculatePageDigests(const char *baseAddress, qsizetype size);
+    // Хеш одной страницы с номером page; hash переиспользуется между вызовами
+    static QByteArray calculatePageDigest(QCryptographicHash &hash, const char *baseAddress, qsizetype size, qsizetype page);
+    
+    static const qsizetype PAGE_BYTES = 4096;
+    static const int DIGEST_BYTES = 32;
 };
 
 #endif
-
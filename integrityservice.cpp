@@ -0,0 +1,126 @@
+#include "integrityservice.h"
+#include "integritycheck.h"
+#include <QTimer>
+#include <QDebug>
+#include <cstring>
+
+IntegrityService::IntegrityService(QObject *parent)
+    : QObject(parent)
+    , timer(new QTimer(this))
+    , segmentAddress(nullptr)
+    , segmentSize(0)
+    , pageHash(QCryptographicHash::Sha256)
+    , nextPage(0)
+    , violationReported(false)
+{
+    // Точность срабатывания не важна: грубый таймер позволяет системе объединять пробуждения
+    timer->setTimerType(Qt::CoarseTimer);
+    connect(timer, &QTimer::timeout, this, &IntegrityService::onTick);
+}
+
+bool IntegrityService::start(int coveragePeriodMs, int tickIntervalMs)
+{
+    stop();
+    
+    if (!IntegrityCheck::getTextSegmentInfo(segmentAddress, segmentSize)) {
+        qDebug() << "IntegrityService: сегмент кода не определён, проверка во время работы отключена";
+        return false;
+    }
+    
+    pageDigests = IntegrityCheck::calculatePageDigests(segmentAddress, segmentSize);
+    nextPage = 0;
+    
+    // Порция подбирается так, чтобы весь сегмент обходился за coveragePeriodMs
+    const int tickMs = tickIntervalMs > MIN_TICK_INTERVAL_MS ? tickIntervalMs : MIN_TICK_INTERVAL_MS;
+    const qint64 ticksPerRotation = qMax<qint64>(1, coveragePeriodMs / tickMs);
+    const qsizetype pageCount = pageDigests.size() / IntegrityCheck::DIGEST_BYTES;
+    qsizetype pagesPerTick = qsizetype((pageCount + ticksPerRotation - 1) / ticksPerRotation);
+    pagesPerTick = qBound<qsizetype>(1, pagesPerTick, MAX_PAGES_PER_TICK);
+    
+    stats = Metrics();
+    stats.pageCount = pageCount;
+    stats.pagesPerTick = pagesPerTick;
+    stats.tickIntervalMs = tickMs;
+    stats.coveragePeriodMs = qint64((pageCount + pagesPerTick - 1) / pagesPerTick) * tickMs;
+    
+    runningTimer.start();
+    rotationTimer.start();
+    timer->start(tickMs);
+    
+    qDebug() << "IntegrityService: страниц кода:" << pageCount << "по" << pagesPerTick
+             << "за" << tickMs << "мс, полный обход за" << stats.coveragePeriodMs << "мс";
+    return true;
+}
+
+void IntegrityService::stop()
+{
+    timer->stop();
+}
+
+IntegrityService::Metrics IntegrityService::metrics() const
+{
+    Metrics result = stats;
+    const qint64 runningNs = runningTimer.isValid() ? runningTimer.nsecsElapsed() : 0;
+    result.cpuLoad = runningNs > 0 ? double(stats.totalTickNs) / runningNs : 0.0;
+    return result;
+}
+
+QString IntegrityService::metricsReport() const
+{
+    const Metrics current = metrics();
+    return QString("страниц %1, по %2 за %3 мс, обход за %4 мс (последний %5 мс), обходов %6, "
+                   "срабатывание в среднем %7 мкс, максимум %8 мкс, доля процессора %9%")
+        .arg(current.pageCount)
+        .arg(current.pagesPerTick)
+        .arg(current.tickIntervalMs)
+        .arg(current.coveragePeriodMs)
+        .arg(current.lastRotationMs)
+        .arg(current.rotations)
+        .arg(current.averageTickUs(), 0, 'f', 1)
+        .arg(current.maxTickNs / 1e3, 0, 'f', 1)
+        .arg(current.cpuLoad * 100, 0, 'f', 4);
+}
+
+void IntegrityService::onTick()
+{
+    QElapsedTimer tickTimer;
+    tickTimer.start();
+    
+    const qsizetype end = qMin(nextPage + stats.pagesPerTick, stats.pageCount);
+    qsizetype modifiedPage = -1;
+    for (qsizetype page = nextPage; page < end; page++) {
+        const QByteArray digest = IntegrityCheck::calculatePageDigest(pageHash, segmentAddress, segmentSize, page);
+        if (memcmp(digest.constData(), pageDigests.constData() + page * IntegrityCheck::DIGEST_BYTES,
+                   IntegrityCheck::DIGEST_BYTES) != 0) {
+            modifiedPage = page;
+            break;
+        }
+    }
+    
+    stats.lastTickNs = tickTimer.nsecsElapsed();
+    stats.maxTickNs = qMax(stats.maxTickNs, stats.lastTickNs);
+    stats.totalTickNs += stats.lastTickNs;
+    stats.ticks++;
+    
+    if (modifiedPage >= 0) {
+        qDebug() << "IntegrityService: изменена страница кода" << modifiedPage
+                 << "по адресу" << static_cast<const void*>(segmentAddress + modifiedPage * IntegrityCheck::PAGE_BYTES);
+        IntegrityCheck::reportViolation();
+        timer->stop();
+        if (!violationReported) {
+            violationReported = true;
+            emit violationDetected();
+        }
+        return;
+    }
+    
+    nextPage = end;
+    if (nextPage >= stats.pageCount) {
+        nextPage = 0;
+        stats.rotations++;
+        stats.lastRotationMs = rotationTimer.restart();
+        if (stats.rotations == 1) {
+            qDebug().noquote() << "IntegrityService: первый обход завершён:" << metricsReport();
+        }
+    }
+}
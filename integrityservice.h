@@ -0,0 +1,77 @@
+#ifndef INTEGRITYSERVICE_H
+#define INTEGRITYSERVICE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+
+class QTimer;
+
+// Служба проверки целостности кода во время работы.
+// Хеш сегмента кода вычисляется один раз при запуске (IntegrityCheck::verifyTextSegment),
+// после чего операции только читают результат (IntegrityCheck::isIntact) и не ждут хеширования.
+// При запуске службы сегмент кода разбивается на страницы и запоминаются их хеши SHA-256;
+// затем по таймеру проверяется небольшая порция страниц по кругу, так что весь сегмент
+// обходится за заданный период, а одно срабатывание таймера занимает микросекунды.
+// Изменение кода сообщается сигналом violationDetected (один раз)
+class IntegrityService : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Показатели проверки для журнала и настройки периода
+    struct Metrics
+    {
+        qsizetype pageCount = 0;        // Страниц в сегменте кода
+        qsizetype pagesPerTick = 0;     // Страниц за одно срабатывание таймера
+        int tickIntervalMs = 0;
+        qint64 coveragePeriodMs = 0;    // Расчётный период полного обхода сегмента
+        qint64 ticks = 0;
+        qint64 rotations = 0;           // Завершённых полных обходов
+        qint64 lastRotationMs = 0;      // Фактическая длительность последнего полного обхода
+        qint64 lastTickNs = 0;
+        qint64 maxTickNs = 0;
+        qint64 totalTickNs = 0;         // Суммарное время проверки страниц
+        double cpuLoad = 0.0;           // Доля времени работы службы, занятая проверкой
+
+        double averageTickUs() const { return ticks > 0 ? double(totalTickNs) / ticks / 1e3 : 0.0; }
+    };
+
+    explicit IntegrityService(QObject *parent = nullptr);
+
+    // Запуск проверки: coveragePeriodMs - за сколько обходится весь сегмент, tickIntervalMs - период
+    // таймера. Порция на одно срабатывание не превышает MAX_PAGES_PER_TICK: если сегмент слишком
+    // велик для заданного периода, период обхода увеличивается (см. metrics().coveragePeriodMs).
+    // Возвращает false, если сегмент кода на этой платформе не определяется
+    bool start(int coveragePeriodMs = DEFAULT_COVERAGE_PERIOD_MS, int tickIntervalMs = DEFAULT_TICK_INTERVAL_MS);
+    void stop();
+
+    Metrics metrics() const;
+    // Показатели одной строкой для журнала
+    QString metricsReport() const;
+
+    static const int DEFAULT_COVERAGE_PERIOD_MS = 10000;
+    static const int DEFAULT_TICK_INTERVAL_MS = 50;
+    static const int MIN_TICK_INTERVAL_MS = 10;
+    static const int MAX_PAGES_PER_TICK = 256;     // 1 МиБ кода, около миллисекунды SHA-256
+
+signals:
+    void violationDetected();
+
+private:
+    void onTick();
+
+    QTimer *timer;
+    const char *segmentAddress;
+    qsizetype segmentSize;
+    QByteArray pageDigests;         // Хеши страниц, вычисленные при запуске, подряд по 32 байта
+    QCryptographicHash pageHash;
+    qsizetype nextPage;
+    bool violationReported;
+    Metrics stats;
+    QElapsedTimer runningTimer;     // С запуска службы (для доли времени проверки)
+    QElapsedTimer rotationTimer;    // С начала текущего обхода
+};
+
+#endif
@@ -0,0 +1,23 @@
+#include "invoiceitemdelegate.h"
+#include "invoicetablemodel.h"
+#include <QColor>
+#include <QPalette>
+
+InvoiceItemDelegate::InvoiceItemDelegate(QObject *parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+void InvoiceItemDelegate::initStyleOption(QStyleOptionViewItem *option, const QModelIndex &index) const
+{
+    QStyledItemDelegate::initStyleOption(option, index);
+    
+    if (index.data(InvoiceTableModel::ValidRole).toBool()) {
+        return;
+    }
+    
+    const QColor invalidBackground(0xdc, 0x35, 0x45);  // #dc3545
+    option->backgroundBrush = invalidBackground;
+    option->palette.setColor(QPalette::Text, Qt::white);
+    option->palette.setColor(QPalette::HighlightedText, Qt::white);
+}
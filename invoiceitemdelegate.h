@@ -0,0 +1,19 @@
+#ifndef INVOICEITEMDELEGATE_H
+#define INVOICEITEMDELEGATE_H
+
+#include <QStyledItemDelegate>
+
+// Делегат, выделяющий красным цветом строки с нарушенной цепочкой хешей.
+// Заменяет отдельные таблицы стилей у каждого виджета ячейки.
+class InvoiceItemDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit InvoiceItemDelegate(QObject *parent = nullptr);
+
+protected:
+    void initStyleOption(QStyleOptionViewItem *option, const QModelIndex &index) const override;
+};
+
+#endif
@@ -0,0 +1,820 @@
+#include "invoiceparser.h"
+#include "ledgerlog.h"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace {
+
+const int MAX_NESTING_DEPTH = 1024;  // Как и QJsonDocument, ограничиваем глубину вложенности
+
+inline void skipWhitespace(const char *&p, const char *end)
+{
+    while (p != end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+        ++p;
+    }
+}
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+void appendUtf8(QByteArray &out, uint codePoint)
+{
+    if (codePoint < 0x80) {
+        out.append(char(codePoint));
+    } else if (codePoint < 0x800) {
+        out.append(char(0xC0 | (codePoint >> 6)));
+        out.append(char(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        out.append(char(0xE0 | (codePoint >> 12)));
+        out.append(char(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.append(char(0x80 | (codePoint & 0x3F)));
+    } else {
+        out.append(char(0xF0 | (codePoint >> 18)));
+        out.append(char(0x80 | ((codePoint >> 12) & 0x3F)));
+        out.append(char(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.append(char(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+// Аналог QJsonValue::toInt(): целое значение в диапазоне int, иначе 0
+qint64 toIntSemantics(qint64 integer, double real, bool isInteger)
+{
+    if (isInteger) {
+        if (integer < std::numeric_limits<int>::min() || integer > std::numeric_limits<int>::max()) {
+            return 0;
+        }
+        return integer;
+    }
+    if (std::trunc(real) != real
+        || real < std::numeric_limits<int>::min()
+        || real > std::numeric_limits<int>::max()) {
+        return 0;
+    }
+    return static_cast<qint64>(real);
+}
+
+// Аналог QJsonValue::toVariant().toLongLong(): дробные значения округляются
+qint64 toLongLongSemantics(qint64 integer, double real, bool isInteger)
+{
+    if (isInteger) {
+        return integer;
+    }
+    if (!(std::fabs(real) < 9.2e18)) {
+        return 0;
+    }
+    return static_cast<qint64>(std::llround(real));
+}
+
+}
+
+InvoiceParser::InvoiceParser(LedgerStore &output)
+    : records(output)
+    , scanOffset(0)
+    , scanDepth(0)
+    , scanInString(false)
+    , scanEscape(false)
+    , scanScalar(false)
+    , state(ExpectArrayStart)
+    , streamOffset(0)
+    , bufferBegin(nullptr)
+    , elementIndex(0)
+    , lastElementEnd(-1)
+    , accepted(0)
+    , rejected(0)
+    , errorPosition(-1)
+    , hasArticle(false)
+    , hasHash(false)
+    , hasAlgorithm(false)
+    , headerParsed(false)
+    , quantityValue(0)
+    , timestampValue(0)
+{
+    std::fill(rejectedBy, rejectedBy + RejectReasonCount, qsizetype(0));
+}
+
+void InvoiceParser::resumeAfterElement(qint64 offset, qint64 index)
+{
+    state = ExpectSeparatorOrEnd;
+    streamOffset = offset;
+    elementIndex = index;
+    lastElementEnd = offset;
+}
+
+bool InvoiceParser::feed(const char *data, qsizetype size)
+{
+    if (state == Failed) {
+        return false;
+    }
+    if (size <= 0) {
+        return true;
+    }
+
+    if (pending.isEmpty()) {
+        qsizetype consumed = process(data, data + size);
+        if (state == Failed) {
+            return false;
+        }
+        if (consumed < size) {
+            pending.append(data + consumed, size - consumed);
+            scanOffset = 0;
+            scanPending();
+        }
+        streamOffset += consumed;
+    } else {
+        // Элемент, не поместившийся в прошлые фрагменты, разбирается заново только после того,
+        // как пришёл его конец: иначе элемент длиной в k фрагментов разбирался бы k раз
+        pending.append(data, size);
+        if (!scanPending()) {
+            return true;
+        }
+        qsizetype consumed = process(pending.constData(), pending.constData() + pending.size());
+        if (state == Failed) {
+            return false;
+        }
+        pending.remove(0, consumed);
+        streamOffset += consumed;
+        scanOffset = 0;
+        if (!pending.isEmpty()) {
+            scanPending();
+        }
+    }
+
+    return true;
+}
+
+bool InvoiceParser::scanPending()
+{
+    if (state != ExpectElement && state != ExpectElementOrEnd) {
+        return true;
+    }
+    const char *data = pending.constData();
+    const qsizetype size = pending.size();
+    if (scanOffset == 0) {
+        if (size == 0) {
+            return true;
+        }
+        scanDepth = 0;
+        scanInString = false;
+        scanEscape = false;
+        scanScalar = data[0] != '{' && data[0] != '[' && data[0] != '"';
+    }
+
+    // Скобки внутри строк не учитываются; конец элемента - закрытие внешней скобки или строки,
+    // у числа и литерала - первый разделитель после него
+    for (qsizetype i = scanOffset; i < size; ++i) {
+        const char c = data[i];
+        bool complete = false;
+        if (scanInString) {
+            if (scanEscape) {
+                scanEscape = false;
+            } else if (c == '\\') {
+                scanEscape = true;
+            } else if (c == '"') {
+                scanInString = false;
+                complete = scanDepth == 0;
+            }
+        } else if (scanScalar) {
+            complete = c == ',' || c == ']' || c == '}' || c == ' ' || c == '\n' || c == '\r' || c == '\t';
+        } else if (c == '"') {
+            scanInString = true;
+        } else if (c == '{' || c == '[') {
+            ++scanDepth;
+        } else if (c == '}' || c == ']') {
+            complete = --scanDepth <= 0;
+        }
+        if (complete) {
+            scanOffset = 0;
+            return true;
+        }
+    }
+    scanOffset = size;
+    return false;
+}
+
+bool InvoiceParser::finish()
+{
+    if (state == Failed) {
+        return false;
+    }
+    if (!pending.isEmpty()) {
+        fail("Неожиданный конец данных", streamOffset + pending.size());
+        return false;
+    }
+    if (state == ExpectArrayStart) {
+        fail("Документ пуст или не является массивом", streamOffset);
+        return false;
+    }
+    if (state != Finished) {
+        fail("Массив не закрыт", streamOffset);
+        return false;
+    }
+    return true;
+}
+
+void InvoiceParser::fail(const QString &message, qint64 position)
+{
+    if (state == Failed) {
+        return;
+    }
+    state = Failed;
+    error = message;
+    errorPosition = position;
+}
+
+qsizetype InvoiceParser::process(const char *begin, const char *end)
+{
+    bufferBegin = begin;
+    const char *p = begin;
+
+    while (state != Failed) {
+        skipWhitespace(p, end);
+        if (p == end) {
+            break;
+        }
+
+        switch (state) {
+        case ExpectArrayStart:
+            if (static_cast<unsigned char>(*p) == 0xEF) {
+                // Метка порядка байтов UTF-8
+                if (end - p < 3) {
+                    return p - begin;
+                }
+                if (static_cast<unsigned char>(p[1]) == 0xBB && static_cast<unsigned char>(p[2]) == 0xBF) {
+                    p += 3;
+                    continue;
+                }
+            }
+            if (*p != '[') {
+                fail("Документ не является массивом", streamOffset + (p - begin));
+                break;
+            }
+            ++p;
+            state = ExpectElementOrEnd;
+            break;
+
+        case ExpectElementOrEnd:
+        case ExpectElement: {
+            if (*p == ']') {
+                if (state == ExpectElement) {
+                    fail("Ожидается элемент массива", streamOffset + (p - begin));
+                    break;
+                }
+                ++p;
+                state = Finished;
+                break;
+            }
+
+            const char *elementStart = p;
+            Status status;
+            bool isObject = (*p == '{');
+            if (isObject) {
+                status = parseObject(p, end);
+            } else {
+                status = skipValue(p, end, 0);
+            }
+
+            if (status == NeedMore) {
+                return elementStart - begin;
+            }
+            if (status == Error) {
+                break;
+            }
+
+            if (isObject && hasAlgorithm && !hasArticle && !hasHash && lastElementEnd < 0) {
+                // Заголовок не является накладной и не учитывается в номерах элементов
+                if (!applyHeader(streamOffset + (elementStart - begin))) {
+                    break;
+                }
+                lastElementEnd = streamOffset + (p - begin);
+                state = ExpectSeparatorOrEnd;
+                break;
+            }
+
+            if (isObject) {
+                emitRecord();
+            } else {
+                reject(NotObject);
+            }
+            ++elementIndex;
+            lastElementEnd = streamOffset + (p - begin);
+            state = ExpectSeparatorOrEnd;
+            break;
+        }
+
+        case ExpectSeparatorOrEnd:
+            if (*p == ',') {
+                ++p;
+                state = ExpectElement;
+            } else if (*p == ']') {
+                ++p;
+                state = Finished;
+            } else {
+                fail("Ожидается ',' или ']'", streamOffset + (p - begin));
+            }
+            break;
+
+        case Finished:
+            fail("Лишние данные после конца массива", streamOffset + (p - begin));
+            break;
+
+        case Failed:
+            break;
+        }
+    }
+
+    return p - begin;
+}
+
+InvoiceParser::Status InvoiceParser::parseObject(const char *&p, const char *end)
+{
+    hasArticle = false;
+    hasHash = false;
+    hasAlgorithm = false;
+    articleBuffer.resize(0);
+    hashBuffer.resize(0);
+    quantityValue = 0;
+    timestampValue = 0;
+
+    ++p;
+    skipWhitespace(p, end);
+    if (p == end) {
+        return NeedMore;
+    }
+    if (*p == '}') {
+        ++p;
+        return Ok;
+    }
+
+    while (true) {
+        skipWhitespace(p, end);
+        if (p == end) {
+            return NeedMore;
+        }
+        if (*p != '"') {
+            fail("Ожидается имя поля", streamOffset + (p - bufferBegin));
+            return Error;
+        }
+
+        Status status = parseString(p, end, scratchBuffer);
+        if (status != Ok) {
+            return status;
+        }
+
+        skipWhitespace(p, end);
+        if (p == end) {
+            return NeedMore;
+        }
+        if (*p != ':') {
+            fail("Ожидается ':'", streamOffset + (p - bufferBegin));
+            return Error;
+        }
+        ++p;
+        skipWhitespace(p, end);
+        if (p == end) {
+            return NeedMore;
+        }
+
+        qint64 integer = 0;
+        double real = 0.0;
+        bool isInteger = true;
+        bool isNumber = (*p == '-' || isDigit(*p));
+
+        if (scratchBuffer == "article") {
+            hasArticle = (*p == '"');
+            status = hasArticle ? parseString(p, end, articleBuffer) : skipValue(p, end, 1);
+            if (!hasArticle) {
+                articleBuffer.resize(0);
+            }
+        } else if (scratchBuffer == "hash") {
+            hasHash = (*p == '"');
+            status = hasHash ? parseString(p, end, hashBuffer) : skipValue(p, end, 1);
+            if (!hasHash) {
+                hashBuffer.resize(0);
+            }
+        } else if (scratchBuffer == "hashAlgorithm") {
+            hasAlgorithm = (*p == '"');
+            status = hasAlgorithm ? parseString(p, end, algorithmBuffer) : skipValue(p, end, 1);
+        } else if (scratchBuffer == "quantity") {
+            quantityValue = 0;
+            if (isNumber) {
+                status = parseNumber(p, end, integer, real, isInteger);
+                if (status == Ok) {
+                    quantityValue = toIntSemantics(integer, real, isInteger);
+                }
+            } else {
+                status = skipValue(p, end, 1);
+            }
+        } else if (scratchBuffer == "timestamp") {
+            timestampValue = 0;
+            if (isNumber) {
+                status = parseNumber(p, end, integer, real, isInteger);
+                if (status == Ok) {
+                    timestampValue = toLongLongSemantics(integer, real, isInteger);
+                }
+            } else if (*p == '"') {
+                status = parseString(p, end, scratchBuffer);
+                if (status == Ok) {
+                    timestampValue = scratchBuffer.toLongLong();
+                }
+            } else {
+                status = skipValue(p, end, 1);
+            }
+        } else {
+            status = skipValue(p, end, 1);
+        }
+
+        if (status != Ok) {
+            return status;
+        }
+
+        skipWhitespace(p, end);
+        if (p == end) {
+            return NeedMore;
+        }
+        if (*p == ',') {
+            ++p;
+            continue;
+        }
+        if (*p == '}') {
+            ++p;
+            return Ok;
+        }
+        fail("Ожидается ',' или '}'", streamOffset + (p - bufferBegin));
+        return Error;
+    }
+}
+
+InvoiceParser::Status InvoiceParser::parseString(const char *&p, const char *end, QByteArray &out)
+{
+    out.resize(0);  // resize(0) сохраняет выделенную ёмкость, в отличие от clear()
+    const char *q = p + 1;
+
+    while (true) {
+        const char *runStart = q;
+        while (q != end && *q != '"' && *q != '\\' && static_cast<unsigned char>(*q) >= 0x20) {
+            ++q;
+        }
+        if (q == end) {
+            return NeedMore;
+        }
+        out.append(runStart, q - runStart);
+
+        if (*q == '"') {
+            p = q + 1;
+            return Ok;
+        }
+        if (*q != '\\') {
+            fail("Недопустимый управляющий символ в строке", streamOffset + (q - bufferBegin));
+            return Error;
+        }
+
+        if (end - q < 2) {
+            return NeedMore;
+        }
+        char escape = q[1];
+        q += 2;
+        switch (escape) {
+        case '"':  out.append('"'); break;
+        case '\\': out.append('\\'); break;
+        case '/':  out.append('/'); break;
+        case 'b':  out.append('\b'); break;
+        case 'f':  out.append('\f'); break;
+        case 'n':  out.append('\n'); break;
+        case 'r':  out.append('\r'); break;
+        case 't':  out.append('\t'); break;
+        case 'u': {
+            if (end - q < 4) {
+                return NeedMore;
+            }
+            uint codePoint = 0;
+            for (int i = 0; i < 4; ++i) {
+                int digit = hexValue(q[i]);
+                if (digit < 0) {
+                    fail("Некорректная escape-последовательность \\u", streamOffset + (q - bufferBegin));
+                    return Error;
+                }
+                codePoint = (codePoint << 4) | uint(digit);
+            }
+            q += 4;
+
+            if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+                // Суррогатная пара: ожидается вторая половина \uDC00..\uDFFF
+                if (end - q < 6) {
+                    return NeedMore;
+                }
+                uint low = 0;
+                bool lowValid = (q[0] == '\\' && q[1] == 'u');
+                for (int i = 0; lowValid && i < 4; ++i) {
+                    int digit = hexValue(q[2 + i]);
+                    lowValid = digit >= 0;
+                    low = (low << 4) | uint(digit);
+                }
+                if (lowValid && low >= 0xDC00 && low <= 0xDFFF) {
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    q += 6;
+                } else {
+                    codePoint = 0xFFFD;
+                }
+            } else if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+                codePoint = 0xFFFD;
+            }
+            appendUtf8(out, codePoint);
+            break;
+        }
+        default:
+            fail("Некорректная escape-последовательность", streamOffset + (q - 2 - bufferBegin));
+            return Error;
+        }
+    }
+}
+
+InvoiceParser::Status InvoiceParser::parseNumber(const char *&p, const char *end,
+                                                 qint64 &integer, double &real, bool &isInteger)
+{
+    const char *q = p;
+    bool negative = false;
+    isInteger = true;
+
+    if (*q == '-') {
+        negative = true;
+        ++q;
+    }
+    if (q == end) {
+        return NeedMore;
+    }
+    if (!isDigit(*q)) {
+        fail("Некорректное число", streamOffset + (q - bufferBegin));
+        return Error;
+    }
+
+    // Целая часть: накапливаем значение, пока оно помещается в qint64
+    quint64 magnitude = 0;
+    bool overflow = false;
+    if (*q == '0') {
+        ++q;
+    } else {
+        while (q != end && isDigit(*q)) {
+            if (magnitude > (std::numeric_limits<quint64>::max() - 9) / 10) {
+                overflow = true;
+            }
+            magnitude = magnitude * 10 + quint64(*q - '0');
+            ++q;
+        }
+    }
+    if (q == end) {
+        return NeedMore;
+    }
+
+    if (*q == '.') {
+        isInteger = false;
+        ++q;
+        if (q == end) {
+            return NeedMore;
+        }
+        if (!isDigit(*q)) {
+            fail("Некорректное число", streamOffset + (q - bufferBegin));
+            return Error;
+        }
+        while (q != end && isDigit(*q)) {
+            ++q;
+        }
+        if (q == end) {
+            return NeedMore;
+        }
+    }
+
+    if (*q == 'e' || *q == 'E') {
+        isInteger = false;
+        ++q;
+        if (q == end) {
+            return NeedMore;
+        }
+        if (*q == '+' || *q == '-') {
+            ++q;
+            if (q == end) {
+                return NeedMore;
+            }
+        }
+        if (!isDigit(*q)) {
+            fail("Некорректное число", streamOffset + (q - bufferBegin));
+            return Error;
+        }
+        while (q != end && isDigit(*q)) {
+            ++q;
+        }
+        if (q == end) {
+            return NeedMore;
+        }
+    }
+
+    const quint64 limit = negative ? quint64(std::numeric_limits<qint64>::max()) + 1
+                                   : quint64(std::numeric_limits<qint64>::max());
+    if (isInteger && !overflow && magnitude <= limit) {
+        integer = negative ? qint64(0 - magnitude) : qint64(magnitude);
+    } else {
+        // Редкий случай: дробь, экспонента или выход за диапазон qint64
+        bool ok = false;
+        real = QByteArray(p, q - p).toDouble(&ok);
+        if (!ok) {
+            fail("Некорректное число", streamOffset + (p - bufferBegin));
+            return Error;
+        }
+        isInteger = false;
+    }
+
+    p = q;
+    return Ok;
+}
+
+InvoiceParser::Status InvoiceParser::skipValue(const char *&p, const char *end, int depth)
+{
+    if (depth > MAX_NESTING_DEPTH) {
+        fail("Слишком глубокая вложенность", streamOffset + (p - bufferBegin));
+        return Error;
+    }
+
+    switch (*p) {
+    case '"':
+        return parseString(p, end, scratchBuffer);
+
+    case '{':
+    case '[': {
+        const char close = (*p == '{') ? '}' : ']';
+        const bool isObject = (*p == '{');
+        ++p;
+        skipWhitespace(p, end);
+        if (p == end) {
+            return NeedMore;
+        }
+        if (*p == close) {
+            ++p;
+            return Ok;
+        }
+        while (true) {
+            skipWhitespace(p, end);
+            if (p == end) {
+                return NeedMore;
+            }
+            if (isObject) {
+                if (*p != '"') {
+                    fail("Ожидается имя поля", streamOffset + (p - bufferBegin));
+                    return Error;
+                }
+                Status status = parseString(p, end, scratchBuffer);
+                if (status != Ok) {
+                    return status;
+                }
+                skipWhitespace(p, end);
+                if (p == end) {
+                    return NeedMore;
+                }
+                if (*p != ':') {
+                    fail("Ожидается ':'", streamOffset + (p - bufferBegin));
+                    return Error;
+                }
+                ++p;
+                skipWhitespace(p, end);
+                if (p == end) {
+                    return NeedMore;
+                }
+            }
+            Status status = skipValue(p, end, depth + 1);
+            if (status != Ok) {
+                return status;
+            }
+            skipWhitespace(p, end);
+            if (p == end) {
+                return NeedMore;
+            }
+            if (*p == ',') {
+                ++p;
+                continue;
+            }
+            if (*p == close) {
+                ++p;
+                return Ok;
+            }
+            fail("Ожидается ',' или закрывающая скобка", streamOffset + (p - bufferBegin));
+            return Error;
+        }
+    }
+
+    case 't':
+    case 'f':
+    case 'n': {
+        const char *literal = (*p == 't') ? "true" : (*p == 'f') ? "false" : "null";
+        const char *q = p;
+        for (const char *l = literal; *l; ++l, ++q) {
+            if (q == end) {
+                return NeedMore;
+            }
+            if (*q != *l) {
+                fail("Некорректное значение", streamOffset + (q - bufferBegin));
+                return Error;
+            }
+        }
+        p = q;
+        return Ok;
+    }
+
+    default:
+        if (*p == '-' || isDigit(*p)) {
+            qint64 integer = 0;
+            double real = 0.0;
+            bool isInteger = true;
+            return parseNumber(p, end, integer, real, isInteger);
+        }
+        fail("Некорректное значение", streamOffset + (p - bufferBegin));
+        return Error;
+    }
+}
+
+void InvoiceParser::emitRecord()
+{
+    bool articleValid = hasArticle && articleBuffer.size() == LedgerStore::ARTICLE_DIGITS;
+    quint64 article = 0;
+    for (int i = 0; articleValid && i < articleBuffer.size(); ++i) {
+        articleValid = isDigit(articleBuffer.at(i));
+        article = article * 10 + quint64(articleBuffer.at(i) - '0');
+    }
+    if (!articleValid || article == 0) {
+        reject(InvalidArticle);
+        return;
+    }
+
+    if (quantityValue <= 0) {
+        reject(InvalidQuantity);
+        return;
+    }
+
+    if (timestampValue <= 0) {
+        reject(InvalidTimestamp);
+        return;
+    }
+
+    if (!hasHash || hashBuffer.isEmpty()) {
+        reject(MissingHash);
+        return;
+    }
+
+    records.append(article, static_cast<qint32>(quantityValue), timestampValue,
+                   hashBuffer.constData(), hashBuffer.size());
+    ++accepted;
+}
+
+bool InvoiceParser::applyHeader(qint64 position)
+{
+    LedgerStore::HashAlgorithm algorithm;
+    if (!LedgerStore::parseHashAlgorithm(QString::fromUtf8(algorithmBuffer), algorithm)) {
+        fail(QString("Неизвестный алгоритм цепочки хешей: %1").arg(QString::fromUtf8(algorithmBuffer)), position);
+        return false;
+    }
+
+    records.setHashAlgorithm(algorithm);
+    headerParsed = true;
+    qCDebug(lcParser) << "InvoiceParser: Алгоритм цепочки хешей:" << LedgerStore::hashAlgorithmName(algorithm);
+    return true;
+}
+
+void InvoiceParser::reject(RejectReason reason)
+{
+    // Сообщение на каждую запись: категория ledger.parser по умолчанию выключена
+    qCDebug(lcParser) << "InvoiceParser: Запись #" << elementIndex << "отброшена:" << rejectReasonName(reason);
+    ++rejected;
+    ++rejectedBy[reason];
+}
+
+QString InvoiceParser::rejectReasonName(RejectReason reason)
+{
+    switch (reason) {
+    case NotObject:
+        return QString("элемент не является объектом");
+    case InvalidArticle:
+        return QString("некорректный артикул");
+    case InvalidQuantity:
+        return QString("некорректное количество");
+    case InvalidTimestamp:
+        return QString("некорректный timestamp");
+    case MissingHash:
+        return QString("отсутствует хеш");
+    default:
+        return QString();
+    }
+}
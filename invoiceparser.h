@@ -0,0 +1,129 @@
+#ifndef INVOICEPARSER_H
+#define INVOICEPARSER_H
+
+#include "ledgerstore.h"
+#include <QByteArray>
+#include <QString>
+
+// Потоковый разборщик массива накладных в формате JSON.
+// Не строит QJsonDocument: данные подаются частями через feed(), каждая запись
+// разбирается непосредственно по фиксированной схеме (article, quantity, timestamp, hash)
+// и сразу добавляется в хранилище LedgerStore. Между вызовами feed() хранится только
+// незавершённый хвост текущего элемента массива, поэтому потребление памяти
+// пропорционально результату, а не размеру входного документа.
+// Первым элементом массива может быть заголовок {"hashAlgorithm": "sha256"} без полей записи:
+// он задаёт алгоритм цепочки хешей хранилища и не считается накладной. Без заголовка
+// алгоритм хранилища не меняется (для файлов накладных - MD5).
+class InvoiceParser
+{
+public:
+    explicit InvoiceParser(LedgerStore &output);
+
+    // Передача очередной порции данных. Возвращает false при синтаксической ошибке
+    bool feed(const char *data, qsizetype size);
+    bool feed(const QByteArray &data) { return feed(data.constData(), data.size()); }
+
+    // Завершение разбора: проверяет, что массив закрыт и после него нет лишних данных
+    bool finish();
+
+    // Описание ошибки и смещение (в байтах от начала потока), на котором она обнаружена
+    QString errorString() const { return error; }
+    qint64 errorOffset() const { return errorPosition; }
+
+    // Продолжение разбора массива сразу после его элемента: offset - смещение в потоке после
+    // элемента, index - номер следующего элемента. Используется для разбора дописанного хвоста
+    // файла без повторного чтения начала; вызывается до первого feed()
+    void resumeAfterElement(qint64 offset, qint64 index);
+    // Смещение в потоке сразу после последнего полностью разобранного элемента (-1, если их не было)
+    qint64 elementEndOffset() const { return lastElementEnd; }
+
+    // Количество элементов массива, принятых и отброшенных при проверке полей
+    qsizetype acceptedCount() const { return accepted; }
+    qsizetype rejectedCount() const { return rejected; }
+
+    // Причины, по которым элемент массива отбрасывается
+    enum RejectReason {
+        NotObject = 0,
+        InvalidArticle,
+        InvalidQuantity,
+        InvalidTimestamp,
+        MissingHash,
+        RejectReasonCount
+    };
+
+    qsizetype rejectedCount(RejectReason reason) const { return rejectedBy[reason]; }
+    // Признак разобранного заголовка с алгоритмом цепочки
+    bool hasHeader() const { return headerParsed; }
+    static QString rejectReasonName(RejectReason reason);
+
+private:
+    enum State {
+        ExpectArrayStart,       // Ожидается '['
+        ExpectElementOrEnd,     // Сразу после '[': элемент или ']'
+        ExpectElement,          // После ',': только элемент
+        ExpectSeparatorOrEnd,   // После элемента: ',' или ']'
+        Finished,               // Массив закрыт, допустимы только пробелы
+        Failed
+    };
+
+    enum Status {
+        Ok,
+        NeedMore,   // Элемент не помещается в доступные данные, нужен следующий фрагмент
+        Error
+    };
+
+    // Разбор доступных данных; возвращает количество полностью обработанных байт
+    qsizetype process(const char *begin, const char *end);
+    // Поиск конца незавершённого элемента в pending без его разбора. Продолжает с места, где
+    // остановился прошлый вызов, поэтому каждый байт длинного элемента просматривается один раз,
+    // а сам элемент разбирается заново только целиком. true - хвост пора разобрать
+    bool scanPending();
+    // Разбор одного объекта-накладной, p указывает на '{'
+    Status parseObject(const char *&p, const char *end);
+    // Разбор строки JSON (p указывает на '"') с раскодированием escape-последовательностей
+    Status parseString(const char *&p, const char *end, QByteArray &out);
+    // Разбор числа JSON; isInteger = false, если число содержит дробную часть или экспоненту
+    Status parseNumber(const char *&p, const char *end, qint64 &integer, double &real, bool &isInteger);
+    // Пропуск произвольного значения JSON (для неизвестных полей и элементов не-объектов)
+    Status skipValue(const char *&p, const char *end, int depth);
+    // Проверка полей разобранной записи по правилам формата и добавление в результат
+    void emitRecord();
+    // Применение заголовка с алгоритмом цепочки; position - смещение заголовка для сообщения об ошибке
+    bool applyHeader(qint64 position);
+    // Учёт отброшенного элемента
+    void reject(RejectReason reason);
+    void fail(const QString &message, qint64 position);
+
+    LedgerStore &records;
+    QByteArray pending;         // Незавершённый хвост предыдущего фрагмента
+    // Состояние поиска конца элемента в pending (см. scanPending)
+    qsizetype scanOffset;       // Просмотрено байт pending; 0 - поиск начинается с начала элемента
+    int scanDepth;
+    bool scanInString;
+    bool scanEscape;
+    bool scanScalar;            // Элемент - число или литерал: заканчивается разделителем
+    State state;
+    qint64 streamOffset;        // Смещение начала текущего буфера в потоке
+    const char *bufferBegin;    // Начало буфера, разбираемого в process()
+    qint64 elementIndex;
+    qint64 lastElementEnd;
+    qsizetype accepted;
+    qsizetype rejected;
+    qsizetype rejectedBy[RejectReasonCount];
+    QString error;
+    qint64 errorPosition;
+
+    // Поля текущей записи (буферы переиспользуются между записями)
+    QByteArray articleBuffer;
+    QByteArray hashBuffer;
+    QByteArray scratchBuffer;
+    QByteArray algorithmBuffer;
+    bool hasArticle;
+    bool hasHash;
+    bool hasAlgorithm;
+    bool headerParsed;
+    qint64 quantityValue;
+    qint64 timestampValue;
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef INVOICERECORD_H
+#define INVOICERECORD_H
+
+#include <QString>
+#include <QtGlobal>
+
+// Структура записи товарной накладной
+struct InvoiceRecord
+{
+    QString article;        // Артикул товара (10 цифр)
+    int quantity;           // Количество единиц товара
+    qint64 timestamp;      // Дата и время отгрузки (unix timestamp)
+    QString hash;          // Хеш MD5 в кодировке base64
+    bool valid;            // Признак валидности записи (для подсветки)
+    
+    InvoiceRecord()
+        : quantity(0)
+        , timestamp(0)
+        , valid(true)
+    {
+    }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "invoicetablemodel.h"
+#include "ledgerstore.h"
+#include <QDateTime>
+
+InvoiceTableModel::InvoiceTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+    , records(nullptr)
+    , filtered(false)
+    , filterRows(nullptr)
+    , filterCount(0)
+{
+}
+
+void InvoiceTableModel::setRecords(const LedgerStore *records)
+{
+    beginResetModel();
+    this->records = records;
+    endResetModel();
+}
+
+void InvoiceTableModel::reload()
+{
+    beginResetModel();
+    endResetModel();
+}
+
+void InvoiceTableModel::beginReplaceRecords()
+{
+    beginResetModel();
+}
+
+void InvoiceTableModel::endReplaceRecords()
+{
+    endResetModel();
+}
+
+void InvoiceTableModel::setRowFilter(const int *rows, qsizetype count)
+{
+    filtered = true;
+    filterRows = rows;
+    filterCount = count;
+}
+
+void InvoiceTableModel::clearRowFilter()
+{
+    filtered = false;
+    filterRows = nullptr;
+    filterCount = 0;
+}
+
+void InvoiceTableModel::beginAppendRecords(qsizetype count)
+{
+    const int first = records ? static_cast<int>(records->size()) : 0;
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(count) - 1);
+}
+
+void InvoiceTableModel::endAppendRecords()
+{
+    endInsertRows();
+}
+
+int InvoiceTableModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() || !records) {
+        return 0;
+    }
+    return static_cast<int>(filtered ? filterCount : records->size());
+}
+
+int InvoiceTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant InvoiceTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || !records || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    
+    const qsizetype row = recordIndex(index.row());
+    
+    if (role == ValidRole) {
+        return records->isValid(row);
+    }
+    
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+    
+    switch (index.column()) {
+    case ArticleColumn:
+        return records->articleText(row);
+    case QuantityColumn:
+        return QString::number(records->quantity(row));
+    case DateColumn:
+        return QDateTime::fromSecsSinceEpoch(records->timestamp(row)).toString("dd.MM.yyyy hh:mm:ss");
+    case HashColumn:
+        return records->hashText(row);
+    default:
+        return QVariant();
+    }
+}
+
+QVariant InvoiceTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    
+    switch (section) {
+    case ArticleColumn:
+        return QString("Артикул");
+    case QuantityColumn:
+        return QString("Количество");
+    case DateColumn:
+        return QString("Дата отгрузки");
+    case HashColumn:
+        return QString("Хеш");
+    default:
+        return QVariant();
+    }
+}
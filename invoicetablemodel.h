@@ -0,0 +1,64 @@
+#ifndef INVOICETABLEMODEL_H
+#define INVOICETABLEMODEL_H
+
+#include <QAbstractTableModel>
+
+class LedgerStore;
+
+// Табличная модель поверх хранилища записей накладных.
+// Не копирует записи и форматирует только те ячейки, которые запрашивает представление,
+// поэтому стоимость отрисовки зависит от числа видимых строк, а не от размера файла.
+class InvoiceTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column {
+        ArticleColumn = 0,
+        QuantityColumn,
+        DateColumn,
+        HashColumn,
+        ColumnCount
+    };
+
+    // Роль, по которой делегат узнаёт признак валидности строки
+    enum Role {
+        ValidRole = Qt::UserRole + 1
+    };
+
+    explicit InvoiceTableModel(QObject *parent = nullptr);
+
+    // Привязка модели к хранилищу записей (хранилище принадлежит владельцу модели)
+    void setRecords(const LedgerStore *records);
+    // Полное обновление представления после перезагрузки или перепроверки записей
+    void reload();
+    // Замена содержимого хранилища (между begin и end хранилище можно менять целиком)
+    void beginReplaceRecords();
+    void endReplaceRecords();
+    // Добавление count записей в конец хранилища (между begin и end вызывается LedgerStore::append);
+    // только без фильтра строк - при фильтре записи добавляются через beginReplaceRecords
+    void beginAppendRecords(qsizetype count);
+    void endAppendRecords();
+    // Отображение только записей с номерами rows[0, count) в этом порядке (результат поиска
+    // по LedgerIndex) и возврат ко всем записям хранилища. Массив принадлежит вызывающему.
+    // Вызываются между beginReplaceRecords и endReplaceRecords
+    void setRowFilter(const int *rows, qsizetype count);
+    void clearRowFilter();
+    bool isFiltered() const { return filtered; }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+private:
+    // Номер записи хранилища для строки представления
+    qsizetype recordIndex(int row) const { return filtered ? filterRows[row] : row; }
+
+    const LedgerStore *records;
+    bool filtered;
+    const int *filterRows;
+    qsizetype filterCount;
+};
+
+#endif
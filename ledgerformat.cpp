@@ -0,0 +1,339 @@
+#include "ledgerformat.h"
+#include "ledgerstore.h"
+#include "mappedfile.h"
+#include "invoiceparser.h"
+#include "ledgerlog.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QHash>
+#include <QList>
+#include <QtEndian>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+const char BINARY_MAGIC[8] = {'I', 'N', 'V', 'L', 'D', 'G', '0', '1'};
+
+// Размер буфера записи: файл пишется крупными блоками
+const int WRITE_BUFFER_SIZE = 1 << 20;
+
+// Запись числа в десятичном виде в конец буфера
+void appendNumber(QByteArray &out, qint64 value)
+{
+    char digits[24];
+    int length = 0;
+    quint64 magnitude = value < 0 ? quint64(0) - quint64(value) : quint64(value);
+    do {
+        digits[length++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) {
+        out.append('-');
+    }
+    while (length > 0) {
+        out.append(digits[--length]);
+    }
+}
+
+// Запись строки JSON с экранированием
+void appendJsonString(QByteArray &out, const QString &text)
+{
+    out.append('"');
+    const QByteArray utf8 = text.toUtf8();
+    for (char c : utf8) {
+        const uchar u = static_cast<uchar>(c);
+        if (c == '"' || c == '\\') {
+            out.append('\\');
+            out.append(c);
+        } else if (u < 0x20) {
+            static const char HEX[] = "0123456789abcdef";
+            out.append("\\u00");
+            out.append(HEX[u >> 4]);
+            out.append(HEX[u & 0x0F]);
+        } else {
+            out.append(c);
+        }
+    }
+    out.append('"');
+}
+
+bool flushBuffer(QSaveFile &file, QByteArray &buffer, QString &errorMessage)
+{
+    if (file.write(buffer) != buffer.size()) {
+        errorMessage = QString("Ошибка записи файла: %1").arg(file.errorString());
+        file.cancelWriting();
+        return false;
+    }
+    buffer.resize(0);
+    return true;
+}
+
+bool commitFile(QSaveFile &file, QString &errorMessage)
+{
+    if (!file.commit()) {
+        errorMessage = QString("Не удалось сохранить файл: %1").arg(file.errorString());
+        return false;
+    }
+    return true;
+}
+
+}
+
+bool LedgerFormat::hasBinaryHeader(const QByteArray &data)
+{
+    return data.size() >= int(sizeof(BINARY_MAGIC))
+        && std::memcmp(data.constData(), BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0;
+}
+
+bool LedgerFormat::isBinaryFile(const QString &filePath)
+{
+    QFile file(filePath);
+    return file.open(QIODevice::ReadOnly) && hasBinaryHeader(file.read(sizeof(BINARY_MAGIC)));
+}
+
+bool LedgerFormat::openBinary(const QString &filePath, LedgerStore &store, QString &errorMessage)
+{
+    // Записи просматриваются в порядке, который выберет пользователь, поэтому упреждающее чтение не нужно
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(filePath, MappedFile::RandomAccess, errorMessage)) {
+        return false;
+    }
+
+    const uchar *data = file->data();
+    if (file->size() < HEADER_SIZE || std::memcmp(data, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+        errorMessage = QString("Файл не является двоичным файлом накладных.");
+        return false;
+    }
+
+    const quint32 version = qFromLittleEndian<quint32>(data + 8);
+    const quint32 recordSize = qFromLittleEndian<quint32>(data + 12);
+    const quint64 recordCount = qFromLittleEndian<quint64>(data + 16);
+    if (version != VERSION || recordSize != quint32(RECORD_SIZE)) {
+        errorMessage = QString("Версия двоичного формата %1 не поддерживается.").arg(version);
+        return false;
+    }
+    if (recordCount > quint64(file->size() - HEADER_SIZE) / RECORD_SIZE) {
+        errorMessage = QString("Двоичный файл повреждён: записей в заголовке больше, чем в файле.");
+        return false;
+    }
+    quint32 hashAlgorithm = 0;
+    if (!decodeHashAlgorithm(data, hashAlgorithm)) {
+        errorMessage = QString("Алгоритм цепочки хешей %1 не поддерживается.").arg(hashAlgorithm);
+        return false;
+    }
+
+    // Исходный текст нестандартных хешей нужен только для отображения и экспорта в JSON
+    QHash<qsizetype, QString> irregularHashes;
+    quint64 tableOffset = qFromLittleEndian<quint64>(data + 24);
+    const quint64 tableCount = qFromLittleEndian<quint64>(data + 32);
+    const quint64 fileSize = quint64(file->size());
+    // Смещения из заголовка сравниваются с остатком файла, а не складываются: сумма со смещением
+    // из повреждённого заголовка может переполниться и пройти проверку
+    for (quint64 i = 0; i < tableCount; ++i) {
+        if (tableOffset > fileSize || fileSize - tableOffset < 12) {
+            errorMessage = QString("Двоичный файл повреждён: таблица нестандартных хешей обрезана.");
+            return false;
+        }
+        const quint64 index = qFromLittleEndian<quint64>(data + tableOffset);
+        const quint32 length = qFromLittleEndian<quint32>(data + tableOffset + 8);
+        tableOffset += 12;
+        if (index >= recordCount || length > fileSize - tableOffset) {
+            errorMessage = QString("Двоичный файл повреждён: таблица нестандартных хешей обрезана.");
+            return false;
+        }
+        irregularHashes.insert(qsizetype(index),
+                               QString::fromUtf8(reinterpret_cast<const char*>(data + tableOffset), int(length)));
+        tableOffset += length;
+    }
+
+    store.setHashAlgorithm(LedgerStore::HashAlgorithm(hashAlgorithm));
+    store.attachMapped(file, data + HEADER_SIZE, qsizetype(recordCount), irregularHashes);
+    return true;
+}
+
+void LedgerFormat::encodeHeader(uchar *out, quint64 recordCount, quint32 hashAlgorithm,
+                                quint64 tableOffset, quint64 tableCount)
+{
+    std::memset(out, 0, HEADER_SIZE);
+    std::memcpy(out, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    qToLittleEndian<quint32>(VERSION, out + 8);
+    qToLittleEndian<quint32>(RECORD_SIZE, out + 12);
+    qToLittleEndian<quint64>(recordCount, out + 16);
+    qToLittleEndian<quint64>(tableOffset, out + 24);
+    qToLittleEndian<quint64>(tableCount, out + 32);
+    qToLittleEndian<quint32>(hashAlgorithm, out + HASH_ALGORITHM_OFFSET);
+}
+
+bool LedgerFormat::decodeHashAlgorithm(const uchar *header, quint32 &hashAlgorithm)
+{
+    hashAlgorithm = qFromLittleEndian<quint32>(header + HASH_ALGORITHM_OFFSET);
+    return hashAlgorithm < quint32(LedgerStore::HashAlgorithmCount);
+}
+
+void LedgerFormat::encodeRecord(uchar *out, quint64 article, qint32 quantity, qint64 timestamp,
+                                quint32 flags, const uchar *hash)
+{
+    qToLittleEndian<quint64>(article, out + ARTICLE_OFFSET);
+    qToLittleEndian<qint64>(timestamp, out + TIMESTAMP_OFFSET);
+    qToLittleEndian<qint32>(quantity, out + QUANTITY_OFFSET);
+    qToLittleEndian<quint32>(flags, out + FLAGS_OFFSET);
+    std::memcpy(out + HASH_OFFSET, hash, LedgerStore::HASH_SIZE);
+}
+
+void LedgerFormat::appendJsonHeader(QByteArray &out, const QString &hashAlgorithmName)
+{
+    out.append("  {\n    \"hashAlgorithm\": ");
+    appendJsonString(out, hashAlgorithmName);
+    out.append("\n  }");
+}
+
+void LedgerFormat::appendJsonRecord(QByteArray &out, quint64 article, qint32 quantity, qint64 timestamp,
+                                    const QString &hashText)
+{
+    char digits[LedgerStore::ARTICLE_DIGITS];
+    LedgerStore::formatArticle(article, digits);
+
+    out.append("  {\n    \"article\": \"");
+    out.append(digits, LedgerStore::ARTICLE_DIGITS);
+    out.append("\",\n    \"quantity\": ");
+    appendNumber(out, quantity);
+    out.append(",\n    \"timestamp\": ");
+    appendNumber(out, timestamp);
+    out.append(",\n    \"hash\": ");
+    appendJsonString(out, hashText);
+    out.append("\n  }");
+}
+
+bool LedgerFormat::writeBinary(const LedgerStore &store, const QString &filePath, QString &errorMessage)
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        errorMessage = QString("Не удалось создать файл: %1").arg(file.errorString());
+        return false;
+    }
+
+    QByteArray buffer;
+    buffer.reserve(WRITE_BUFFER_SIZE + RECORD_SIZE);
+
+    QList<qsizetype> irregularRecords;
+    for (qsizetype i = 0; i < store.size(); ++i) {
+        if (!store.hasCanonicalHash(i)) {
+            irregularRecords.append(i);
+        }
+    }
+
+    uchar header[HEADER_SIZE];
+    if (irregularRecords.isEmpty()) {
+        encodeHeader(header, quint64(store.size()), quint32(store.hashAlgorithm()));
+    } else {
+        encodeHeader(header, quint64(store.size()), quint32(store.hashAlgorithm()),
+                     quint64(HEADER_SIZE) + quint64(store.size()) * RECORD_SIZE, quint64(irregularRecords.size()));
+    }
+    buffer.append(reinterpret_cast<const char*>(header), HEADER_SIZE);
+
+    uchar record[RECORD_SIZE];
+    for (qsizetype i = 0; i < store.size(); ++i) {
+        encodeRecord(record, store.article(i), store.quantity(i), store.timestamp(i),
+                     store.hasCanonicalHash(i) ? 0 : FLAG_IRREGULAR_HASH, store.hash(i));
+        buffer.append(reinterpret_cast<const char*>(record), RECORD_SIZE);
+
+        if (buffer.size() >= WRITE_BUFFER_SIZE && !flushBuffer(file, buffer, errorMessage)) {
+            return false;
+        }
+    }
+
+    for (qsizetype index : irregularRecords) {
+        const QByteArray text = store.hashText(index).toUtf8();
+        uchar entry[12];
+        qToLittleEndian<quint64>(quint64(index), entry);
+        qToLittleEndian<quint32>(quint32(text.size()), entry + 8);
+        buffer.append(reinterpret_cast<const char*>(entry), sizeof(entry));
+        buffer.append(text);
+
+        if (buffer.size() >= WRITE_BUFFER_SIZE && !flushBuffer(file, buffer, errorMessage)) {
+            return false;
+        }
+    }
+
+    return flushBuffer(file, buffer, errorMessage) && commitFile(file, errorMessage);
+}
+
+bool LedgerFormat::writeJson(const LedgerStore &store, const QString &filePath, QString &errorMessage)
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        errorMessage = QString("Не удалось создать файл: %1").arg(file.errorString());
+        return false;
+    }
+
+    QByteArray buffer;
+    buffer.reserve(WRITE_BUFFER_SIZE + 256);
+    buffer.append("[\n");
+    if (store.hashAlgorithm() != LedgerStore::HashMd5) {
+        appendJsonHeader(buffer, LedgerStore::hashAlgorithmName(store.hashAlgorithm()));
+        buffer.append(store.isEmpty() ? "\n" : ",\n");
+    }
+
+    for (qsizetype i = 0; i < store.size(); ++i) {
+        appendJsonRecord(buffer, store.article(i), store.quantity(i), store.timestamp(i), store.hashText(i));
+        buffer.append(i + 1 < store.size() ? ",\n" : "\n");
+
+        if (buffer.size() >= WRITE_BUFFER_SIZE && !flushBuffer(file, buffer, errorMessage)) {
+            return false;
+        }
+    }
+
+    buffer.append("]\n");
+    return flushBuffer(file, buffer, errorMessage) && commitFile(file, errorMessage);
+}
+
+bool LedgerFormat::readFile(const QString &filePath, LedgerStore &store, QString &errorMessage)
+{
+    if (isBinaryFile(filePath)) {
+        return openBinary(filePath, store, errorMessage);
+    }
+
+    MappedFile file;
+    if (!file.open(filePath, MappedFile::SequentialAccess, errorMessage)) {
+        return false;
+    }
+
+    LedgerStore parsed;
+    InvoiceParser parser(parsed);
+    const char *data = reinterpret_cast<const char*>(file.data());
+    for (qint64 offset = 0; offset < file.size(); offset += WRITE_BUFFER_SIZE) {
+        if (!parser.feed(data + offset, qMin<qint64>(WRITE_BUFFER_SIZE, file.size() - offset))) {
+            break;
+        }
+    }
+    if (!parser.errorString().isEmpty() || !parser.finish()) {
+        errorMessage = QString("Ошибка парсинга: %1 (позиция %2)").arg(parser.errorString()).arg(parser.errorOffset());
+        return false;
+    }
+
+    store.swap(parsed);
+    return true;
+}
+
+bool LedgerFormat::convert(const QString &sourcePath, const QString &targetPath, QString &errorMessage)
+{
+    const QString canonicalSource = QFileInfo(sourcePath).canonicalFilePath();
+    if (!canonicalSource.isEmpty() && canonicalSource == QFileInfo(targetPath).canonicalFilePath()) {
+        errorMessage = QString("Исходный и целевой файлы совпадают.");
+        return false;
+    }
+
+    LedgerStore store;
+    if (!readFile(sourcePath, store, errorMessage)) {
+        return false;
+    }
+
+    const bool toBinary = QFileInfo(targetPath).suffix().toLower() == "ldg";
+    qCDebug(lcFormat) << "LedgerFormat::convert:" << sourcePath << "->" << targetPath
+                      << "записей:" << store.size() << (toBinary ? "(двоичный формат)" : "(JSON)");
+
+    return toBinary ? writeBinary(store, targetPath, errorMessage)
+                    : writeJson(store, targetPath, errorMessage);
+}
@@ -0,0 +1,75 @@
+#ifndef LEDGERFORMAT_H
+#define LEDGERFORMAT_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+class LedgerStore;
+
+// Двоичный формат файла накладных (.ldg) и преобразование JSON <-> двоичный формат.
+// Файл состоит из заголовка и записей фиксированного размера, поэтому открывается отображением
+// в память без разбора: запись i находится по смещению HEADER_SIZE + i * RECORD_SIZE.
+//
+// Структура (все целые - little-endian):
+//   заголовок (64 байта): сигнатура "INVLDG01", версия u32, размер записи u32, число записей u64,
+//                         смещение таблицы нестандартных хешей u64, число её элементов u64,
+//                         алгоритм цепочки хешей u32 (LedgerStore::HashAlgorithm, 0 - MD5), резерв
+//   запись (40 байт):     артикул u64, время i64, количество i32, флаги u32, хеш цепочки (16 байт)
+//   таблица нестандартных хешей (после записей): номер записи u64, длина u32, текст хеша в UTF-8
+class LedgerFormat
+{
+public:
+    static const int HEADER_SIZE = 64;
+    static const int RECORD_SIZE = 40;
+    static const quint32 VERSION = 1;
+
+    // Смещения полей внутри записи
+    static const int ARTICLE_OFFSET = 0;
+    static const int TIMESTAMP_OFFSET = 8;
+    static const int QUANTITY_OFFSET = 16;
+    static const int FLAGS_OFFSET = 20;
+    static const int HASH_OFFSET = 24;
+
+    // Смещение алгоритма цепочки в заголовке (в файлах, записанных до его появления, там нули - MD5)
+    static const int HASH_ALGORITHM_OFFSET = 40;
+
+    // Флаг записи: исходный текст хеша не был base64 от 16 байт (хранится как нули)
+    static const quint32 FLAG_IRREGULAR_HASH = 1;
+
+    // Проверяет, начинаются ли данные с заголовка двоичного формата
+    static bool hasBinaryHeader(const QByteArray &data);
+    // Определяет двоичный файл по заголовку
+    static bool isBinaryFile(const QString &filePath);
+
+    // Открывает двоичный файл отображением в память; записи в store читаются прямо из отображения
+    static bool openBinary(const QString &filePath, LedgerStore &store, QString &errorMessage);
+    // Сохраняет записи в двоичный файл
+    static bool writeBinary(const LedgerStore &store, const QString &filePath, QString &errorMessage);
+    // Сохраняет записи в JSON (в том же виде, что и исходные файлы накладных). Для алгоритма
+    // цепочки, отличного от MD5, первым элементом массива записывается заголовок с его именем
+    static bool writeJson(const LedgerStore &store, const QString &filePath, QString &errorMessage);
+
+    // Заголовок двоичного файла (HEADER_SIZE байт) в out
+    static void encodeHeader(uchar *out, quint64 recordCount, quint32 hashAlgorithm,
+                             quint64 tableOffset = 0, quint64 tableCount = 0);
+    // Алгоритм цепочки из заголовка двоичного файла; false - если значение неизвестно
+    static bool decodeHashAlgorithm(const uchar *header, quint32 &hashAlgorithm);
+    // Запись двоичного формата (RECORD_SIZE байт) в out
+    static void encodeRecord(uchar *out, quint64 article, qint32 quantity, qint64 timestamp,
+                             quint32 flags, const uchar *hash);
+    // Текст заголовка JSON с алгоритмом цепочки (без разделителя после '}')
+    static void appendJsonHeader(QByteArray &out, const QString &hashAlgorithmName);
+    // Текст записи JSON в том виде, в котором её сохраняет writeJson (без разделителя после '}')
+    static void appendJsonRecord(QByteArray &out, quint64 article, qint32 quantity, qint64 timestamp,
+                                 const QString &hashText);
+
+    // Преобразование файла: формат источника определяется по заголовку, формат результата -
+    // по расширению (.ldg - двоичный, иначе JSON). Зашифрованные источники не поддерживаются
+    static bool convert(const QString &sourcePath, const QString &targetPath, QString &errorMessage);
+
+    // Чтение незашифрованного файла любого поддерживаемого формата в хранилище
+    static bool readFile(const QString &filePath, LedgerStore &store, QString &errorMessage);
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include "ledgerindex.h"
+#include "ledgerstore.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+const size_t MIN_ARTICLE_SLOTS = 1024;
+
+// Номер ячейки артикула: артикулы - десятичные числа, поэтому младшие биты перемешиваются умножением
+size_t slotOf(quint64 article, size_t mask)
+{
+    return static_cast<size_t>((article * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+}
+
+}
+
+LedgerIndex::LedgerIndex()
+    : articleCount(0)
+    , sortedCount(0)
+    , minTime(MAX_TIME)
+    , maxTime(MIN_TIME)
+{
+}
+
+void LedgerIndex::clear()
+{
+    // Обмен с пустыми векторами освобождает память, а не только обнуляет размер
+    LedgerIndex empty;
+    swap(empty);
+}
+
+void LedgerIndex::swap(LedgerIndex &other)
+{
+    articleSlots.swap(other.articleSlots);
+    std::swap(articleCount, other.articleCount);
+    nextRows.swap(other.nextRows);
+    sortedTimestamps.swap(other.sortedTimestamps);
+    timeOrder.swap(other.timeOrder);
+    std::swap(sortedCount, other.sortedCount);
+    std::swap(minTime, other.minTime);
+    std::swap(maxTime, other.maxTime);
+}
+
+void LedgerIndex::append(const LedgerStore &store)
+{
+    const qsizetype first = size();
+    const qsizetype count = store.size();
+    if (count <= first) {
+        return;
+    }
+
+    // Пачки добавляются часто: ёмкость растёт с запасом, как у самих векторов
+    const size_t n = static_cast<size_t>(count);
+    if (n > nextRows.capacity()) {
+        const size_t capacity = qMax(n, nextRows.capacity() + nextRows.capacity() / 2);
+        nextRows.reserve(capacity);
+        sortedTimestamps.reserve(capacity);
+        timeOrder.reserve(capacity);
+    }
+
+    for (qsizetype row = first; row < count; ++row) {
+        nextRows.push_back(-1);
+        insertArticle(store.article(row), static_cast<int>(row));
+
+        // Журнал обычно дописывается по возрастанию времени: тогда порядок не нарушается
+        // и сортировать нечего
+        const qint64 timestamp = store.timestamp(row);
+        if (sortedCount == static_cast<qsizetype>(sortedTimestamps.size())
+            && (sortedTimestamps.empty() || sortedTimestamps.back() <= timestamp)) {
+            ++sortedCount;
+        }
+        sortedTimestamps.push_back(timestamp);
+        minTime = qMin(minTime, timestamp);
+        maxTime = qMax(maxTime, timestamp);
+        timeOrder.push_back(static_cast<qint32>(row));
+    }
+}
+
+const LedgerIndex::ArticleSlot *LedgerIndex::findSlot(quint64 article) const
+{
+    if (articleSlots.empty()) {
+        return nullptr;
+    }
+    const size_t mask = articleSlots.size() - 1;
+    for (size_t slot = slotOf(article, mask); ; slot = (slot + 1) & mask) {
+        const ArticleSlot &current = articleSlots[slot];
+        if (current.first < 0) {
+            return nullptr;
+        }
+        if (current.article == article) {
+            return &current;
+        }
+    }
+}
+
+void LedgerIndex::insertArticle(quint64 article, int row)
+{
+    // Заполнение не больше 3/4: цепочки проб остаются короткими, а таблица при почти
+    // уникальных артикулах не занимает больше места, чем сами записи
+    if (4 * (articleCount + 1) > 3 * static_cast<qsizetype>(articleSlots.size())) {
+        growArticles();
+    }
+
+    const size_t mask = articleSlots.size() - 1;
+    for (size_t slot = slotOf(article, mask); ; slot = (slot + 1) & mask) {
+        ArticleSlot &current = articleSlots[slot];
+        if (current.first < 0) {
+            current = {article, row, row};
+            ++articleCount;
+            return;
+        }
+        if (current.article == article) {
+            nextRows[static_cast<size_t>(current.last)] = row;
+            current.last = row;
+            return;
+        }
+    }
+}
+
+void LedgerIndex::growArticles()
+{
+    std::vector<ArticleSlot> previous(qMax(MIN_ARTICLE_SLOTS, 2 * articleSlots.size()), ArticleSlot{0, -1, -1});
+    previous.swap(articleSlots);
+
+    const size_t mask = articleSlots.size() - 1;
+    for (const ArticleSlot &entry : previous) {
+        if (entry.first < 0) {
+            continue;
+        }
+        size_t slot = slotOf(entry.article, mask);
+        while (articleSlots[slot].first >= 0) {
+            slot = (slot + 1) & mask;
+        }
+        articleSlots[slot] = entry;
+    }
+}
+
+std::vector<int> LedgerIndex::findArticle(const LedgerStore &store, quint64 article, qint64 from, qint64 to) const
+{
+    std::vector<int> rows;
+    const ArticleSlot *slot = findSlot(article);
+    if (!slot) {
+        return rows;
+    }
+
+    const bool allTime = from == MIN_TIME && to == MAX_TIME;
+    for (int row = slot->first; row >= 0; row = nextRows[static_cast<size_t>(row)]) {
+        if (allTime || (store.timestamp(row) >= from && store.timestamp(row) <= to)) {
+            rows.push_back(row);
+        }
+    }
+    return rows;
+}
+
+const int *LedgerIndex::findTimeRange(qint64 from, qint64 to, qsizetype &count)
+{
+    sortTimestamps();
+
+    const auto begin = std::lower_bound(sortedTimestamps.begin(), sortedTimestamps.end(), from);
+    const auto end = from <= to ? std::upper_bound(begin, sortedTimestamps.end(), to) : begin;
+    count = end - begin;
+    return timeOrder.data() + (begin - sortedTimestamps.begin());
+}
+
+void LedgerIndex::sortTimestamps()
+{
+    const qsizetype total = size();
+    if (sortedCount == total) {
+        return;
+    }
+
+    // Неупорядоченный остаток сортируется отдельно и сливается с упорядоченной частью с конца,
+    // без второго массива на все записи. Номера остатка больше номеров упорядоченной части,
+    // поэтому при равном времени записи упорядоченной части идут первыми
+    std::vector<std::pair<qint64, qint32>> tail;
+    tail.reserve(static_cast<size_t>(total - sortedCount));
+    for (qsizetype i = sortedCount; i < total; ++i) {
+        tail.emplace_back(sortedTimestamps[static_cast<size_t>(i)], timeOrder[static_cast<size_t>(i)]);
+    }
+    std::sort(tail.begin(), tail.end());
+
+    qsizetype head = sortedCount - 1;
+    qsizetype next = static_cast<qsizetype>(tail.size()) - 1;
+    for (qsizetype out = total - 1; next >= 0; --out) {
+        if (head >= 0 && sortedTimestamps[static_cast<size_t>(head)] > tail[static_cast<size_t>(next)].first) {
+            sortedTimestamps[static_cast<size_t>(out)] = sortedTimestamps[static_cast<size_t>(head)];
+            timeOrder[static_cast<size_t>(out)] = timeOrder[static_cast<size_t>(head)];
+            --head;
+        } else {
+            sortedTimestamps[static_cast<size_t>(out)] = tail[static_cast<size_t>(next)].first;
+            timeOrder[static_cast<size_t>(out)] = tail[static_cast<size_t>(next)].second;
+            --next;
+        }
+    }
+    sortedCount = total;
+}
+
+qint64 LedgerIndex::memoryUsage() const
+{
+    return qint64(articleSlots.capacity() * sizeof(ArticleSlot) + nextRows.capacity() * sizeof(qint32)
+                  + sortedTimestamps.capacity() * sizeof(qint64) + timeOrder.capacity() * sizeof(qint32));
+}
@@ -0,0 +1,73 @@
+#ifndef LEDGERINDEX_H
+#define LEDGERINDEX_H
+
+#include <QtGlobal>
+#include <limits>
+#include <vector>
+
+class LedgerStore;
+
+// Индексы записей хранилища для поиска без просмотра всех записей: по артикулу и по времени.
+// Записи не копируются - индекс хранит только номера записей (строк таблицы).
+// По артикулу: хеш-таблица с открытой адресацией "артикул -> первая и последняя запись" и
+// список следующих записей с тем же артикулом (4 байта на запись); поиск стоит O(найденных).
+// По времени: timestamps в порядке возрастания и номера записей в том же порядке (12 байт
+// на запись); диапазон находится двоичным поиском и отдаётся без копирования.
+// Индекс дополняется вместе с хранилищем (пачками при загрузке и при слежении за файлом).
+class LedgerIndex
+{
+public:
+    static const qint64 MIN_TIME = std::numeric_limits<qint64>::min();
+    static const qint64 MAX_TIME = std::numeric_limits<qint64>::max();
+
+    LedgerIndex();
+
+    void clear();
+    void swap(LedgerIndex &other);
+    // Число проиндексированных записей
+    qsizetype size() const { return static_cast<qsizetype>(nextRows.size()); }
+    // Наименьший и наибольший timestamp проиндексированных записей (индекс не пуст)
+    qint64 minTimestamp() const { return minTime; }
+    qint64 maxTimestamp() const { return maxTime; }
+
+    // Индексирование записей store с номерами [size(), store.size()): предыдущие уже в индексе
+    void append(const LedgerStore &store);
+
+    // Номера записей с артикулом article и timestamp в [from, to] по возрастанию;
+    // store - то же хранилище, по которому построен индекс
+    std::vector<int> findArticle(const LedgerStore &store, quint64 article,
+                                 qint64 from = MIN_TIME, qint64 to = MAX_TIME) const;
+    // Записи с timestamp в [from, to] в порядке времени (при равном времени - в порядке файла):
+    // указатель на первый номер записи и их число. Действителен до следующего изменения индекса.
+    // Если записи добавлялись не по порядку времени, при первом поиске они досортировываются
+    const int *findTimeRange(qint64 from, qint64 to, qsizetype &count);
+
+    // Объём памяти, занимаемый индексом (байт)
+    qint64 memoryUsage() const;
+
+private:
+    // Ячейка хеш-таблицы артикулов; first < 0 - ячейка свободна
+    struct ArticleSlot
+    {
+        quint64 article;
+        qint32 first;
+        qint32 last;
+    };
+
+    const ArticleSlot *findSlot(quint64 article) const;
+    void insertArticle(quint64 article, int row);
+    void growArticles();
+    // Слияние записей, добавленных не по порядку времени, с упорядоченной частью
+    void sortTimestamps();
+
+    std::vector<ArticleSlot> articleSlots;  // Размер - степень двойки (или 0)
+    qsizetype articleCount;                 // Число различных артикулов
+    std::vector<qint32> nextRows;           // Следующая запись с тем же артикулом или -1
+    std::vector<qint64> sortedTimestamps;
+    std::vector<qint32> timeOrder;          // Номера записей в порядке sortedTimestamps
+    qsizetype sortedCount;                  // Длина упорядоченной по времени части
+    qint64 minTime;
+    qint64 maxTime;
+};
+
+#endif
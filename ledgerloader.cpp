@@ -0,0 +1,902 @@
+#include "ledgerloader.h"
+#include "encryptionmanager.h"
+#include "hashchainverifier.h"
+#include "invoiceparser.h"
+#include "mappedfile.h"
+#include "ledgerformat.h"
+#include "verificationcache.h"
+#include "processmemory.h"
+#include "ledgerlog.h"
+#include <QThread>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QIODevice>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QJsonArray>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+// Очереди конвейера одной загрузки
+struct LedgerLoader::Pipeline
+{
+    Pipeline()
+        : raw(RAW_QUEUE_CAPACITY)
+        , plain(PLAIN_QUEUE_CAPACITY)
+        , batches(BATCH_QUEUE_CAPACITY)
+        , aborted(false)
+    {
+    }
+
+    void abort()
+    {
+        aborted = true;
+        raw.abort();
+        plain.abort();
+        batches.abort();
+    }
+
+    BoundedQueue<Chunk> raw;            // Чтение -> расшифровка
+    BoundedQueue<Chunk> plain;          // Чтение или расшифровка -> разбор
+    BoundedQueue<LedgerStore> batches;  // Разбор -> проверка цепочки
+    std::atomic<bool> aborted;
+    // Отображение файла: участки в очередях ссылаются на него, поэтому оно живёт до конца конвейера
+    MappedFile source;
+};
+
+namespace {
+
+// Последовательное устройство, читающее фрагменты шифротекста из очереди конвейера:
+// позволяет передать EncryptionManager::decryptStream данные, которые читает другая стадия
+class ChunkQueueDevice : public QIODevice
+{
+public:
+    ChunkQueueDevice(BoundedQueue<LedgerLoader::Chunk> &queue, const std::atomic<bool> &aborted)
+        : queue(queue)
+        , aborted(aborted)
+        , position(0)
+        , exhausted(false)
+    {
+    }
+
+    bool isSequential() const override { return true; }
+    // Позиция в файле после фрагмента, из которого читает расшифровка: стадия чтения может
+    // пропускать участки файла, поэтому число переданных байт с ней не совпадает
+    qint64 sourcePosition() const { return current.sourceEnd; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        qint64 total = 0;
+        while (total < maxSize) {
+            if (position == current.data.size()) {
+                if (exhausted || !queue.pop(current)) {
+                    exhausted = true;
+                    if (aborted.load()) {
+                        return -1;
+                    }
+                    break;
+                }
+                position = 0;
+            }
+            const qint64 count = qMin<qint64>(maxSize - total, current.data.size() - position);
+            std::memcpy(data + total, current.data.constData() + position, size_t(count));
+            position += count;
+            total += count;
+        }
+        return total;
+    }
+
+    qint64 writeData(const char *, qint64) override
+    {
+        return -1;
+    }
+
+private:
+    BoundedQueue<LedgerLoader::Chunk> &queue;
+    const std::atomic<bool> &aborted;
+    LedgerLoader::Chunk current;
+    qint64 position;
+    bool exhausted;
+};
+
+double toSeconds(qint64 ns)
+{
+    return double(ns) / 1e9;
+}
+
+double toMilliseconds(qint64 ns)
+{
+    return double(ns) / 1e6;
+}
+
+// Ключи стадий и причин отбрасывания в экспортируемой статистике: не зависят от языка интерфейса
+const char *const stageKeys[] = {"read", "decrypt", "parse", "verify"};
+const char *const rejectReasonKeys[] = {"notObject", "invalidArticle", "invalidQuantity", "invalidTimestamp", "missingHash"};
+
+}
+
+LedgerLoader::LedgerLoader(QObject *parent)
+    : QObject(parent)
+    , thread(nullptr)
+    , encryption(nullptr)
+    , verifyChain(true)
+    , useCache(true)
+    , cancelled(false)
+    , active(false)
+    , fileSize(0)
+    , lastReportedPercent(-1)
+    , batchLimit(FIRST_BATCH_SIZE)
+    , hasLastHash(false)
+    , chainBroken(false)
+    , parseError(false)
+    , totalRecords(0)
+    , rejectedRecords(0)
+    , firstInvalid(-1)
+    , trustedRecords(0)
+    , heldRecords(0)
+    , recordsEnd(-1)
+    , algorithm(LedgerStore::HashMd5)
+    , totalElapsedNs(0)
+    , peakMemory(0)
+{
+    std::fill(rejectedByReason, rejectedByReason + InvoiceParser::RejectReasonCount, qsizetype(0));
+}
+
+LedgerLoader::~LedgerLoader()
+{
+    cancel();
+    wait();
+    delete thread;
+}
+
+bool LedgerLoader::start(const QString &filePath, const EncryptionManager *encryptionManager)
+{
+    if (active.load()) {
+        return false;
+    }
+
+    if (thread) {
+        thread->wait();
+        delete thread;
+        thread = nullptr;
+    }
+
+    {
+        QMutexLocker locker(&queueMutex);
+        readyBatches.clear();
+    }
+
+    path = filePath;
+    encryption = encryptionManager;
+    cancelled = false;
+    fileSize = 0;
+    lastReportedPercent = -1;
+    currentBatch.clear();
+    batchLimit = FIRST_BATCH_SIZE;
+    hasLastHash = false;
+    chainBroken = false;
+    error.clear();
+    parseError = false;
+    totalRecords = 0;
+    rejectedRecords = 0;
+    std::fill(rejectedByReason, rejectedByReason + InvoiceParser::RejectReasonCount, qsizetype(0));
+    firstInvalid = -1;
+    cacheEntry = VerificationCache::Entry();
+    trustedRecords = 0;
+    heldBatches.clear();
+    heldRecords = 0;
+    recordsEnd = -1;
+    algorithm = LedgerStore::HashMd5;
+    totalElapsedNs = 0;
+    peakMemory = 0;
+    for (int i = 0; i < StageCount; ++i) {
+        stages[i] = StageStats();
+        inputQueues[i] = QueueStats();
+    }
+
+    active = true;
+    thread = QThread::create([this]() { run(); });
+    thread->start();
+    return true;
+}
+
+void LedgerLoader::cancel()
+{
+    cancelled = true;
+}
+
+void LedgerLoader::wait()
+{
+    if (thread) {
+        thread->wait();
+    }
+}
+
+bool LedgerLoader::isRunning() const
+{
+    return active.load();
+}
+
+QList<LedgerStore> LedgerLoader::takeBatches()
+{
+    QMutexLocker locker(&queueMutex);
+    QList<LedgerStore> batches;
+    batches.swap(readyBatches);
+    return batches;
+}
+
+void LedgerLoader::run()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    fileSize = QFileInfo(path).size();
+    const bool encrypted = EncryptionManager::detectFileFormat(path) != EncryptionManager::FormatPlain;
+    bool success = false;
+
+    if (LedgerFormat::isBinaryFile(path)) {
+        // Двоичный файл не разбирается: записи читаются прямо из отображения, остаётся проверить цепочку
+        LedgerStore mapped;
+        QString openError;
+        if (!LedgerFormat::openBinary(path, mapped, openError)) {
+            error = openError;
+        } else {
+            // Отдельное отображение для отпечатка кэша: записи лежат в файле подряд после заголовка
+            MappedFile snapshot;
+            QString mapError;
+            const bool hasSnapshot = snapshot.open(path, MappedFile::RandomAccess, mapError);
+            if (hasSnapshot) {
+                lookupCache(snapshot.data(), snapshot.size());
+            }
+
+            QElapsedTimer verifyTimer;
+            verifyTimer.start();
+            stages[VerifyStage].used = true;
+            stages[VerifyStage].items = mapped.size();
+            algorithm = mapped.hashAlgorithm();
+            publishBatch(mapped);
+            finishHeldBatches();
+            stages[VerifyStage].elapsedNs = verifyTimer.nsecsElapsed();
+            success = !cancelled.load();
+
+            if (success && hasSnapshot) {
+                const qint64 recordsEnd = LedgerFormat::HEADER_SIZE + qint64(verifiedRecordCount()) * LedgerFormat::RECORD_SIZE;
+                storeCache(snapshot.data(), LedgerFormat::HEADER_SIZE, recordsEnd);
+            }
+        }
+    } else if (encrypted && (!encryption || !encryption->isReady())) {
+        error = "Ключ шифрования не загружен. Невозможно расшифровать файл.";
+    } else {
+        if (encrypted) {
+            qCDebug(lcLoader) << "LedgerLoader: Обнаружен зашифрованный файл:" << path;
+        }
+
+        Pipeline pipeline;
+        BoundedQueue<Chunk> &readOutput = encrypted ? pipeline.raw : pipeline.plain;
+
+        // Файл отображается до запуска стадий: по отображению проверяется кэш проверки
+        QString mapError;
+        if (pipeline.source.open(path, MappedFile::SequentialAccess, mapError)) {
+            lookupCache(pipeline.source.data(), pipeline.source.size());
+        } else {
+            qCDebug(lcLoader) << "LedgerLoader: Файл читается без отображения в память:" << mapError;
+        }
+
+        std::unique_ptr<QThread> reader(QThread::create([this, &pipeline, &readOutput]() {
+            readStage(pipeline, readOutput);
+        }));
+        std::unique_ptr<QThread> decryptor;
+        if (encrypted) {
+            decryptor.reset(QThread::create([this, &pipeline]() { decryptStage(pipeline); }));
+        }
+        std::unique_ptr<QThread> verifier(QThread::create([this, &pipeline]() { verifyStage(pipeline); }));
+
+        reader->start();
+        if (decryptor) {
+            decryptor->start();
+        }
+        verifier->start();
+
+        // Разбор выполняется в потоке загрузчика
+        parseStage(pipeline);
+
+        reader->wait();
+        if (decryptor) {
+            decryptor->wait();
+        }
+        verifier->wait();
+
+        stages[ReadStage].outputWaitNs = readOutput.stats().producerWaitNs;
+        if (encrypted) {
+            inputQueues[DecryptStage] = pipeline.raw.stats();
+            stages[DecryptStage].inputWaitNs = inputQueues[DecryptStage].consumerWaitNs;
+            stages[DecryptStage].outputWaitNs = pipeline.plain.stats().producerWaitNs;
+        }
+        inputQueues[ParseStage] = pipeline.plain.stats();
+        stages[ParseStage].inputWaitNs = inputQueues[ParseStage].consumerWaitNs;
+        stages[ParseStage].outputWaitNs = pipeline.batches.stats().producerWaitNs;
+        inputQueues[VerifyStage] = pipeline.batches.stats();
+        stages[VerifyStage].inputWaitNs = inputQueues[VerifyStage].consumerWaitNs;
+
+        success = !pipeline.aborted.load() && error.isEmpty() && !cancelled.load();
+
+        if (success && pipeline.source.isOpen()) {
+            // Зашифрованный файл не дописывается по частям, поэтому отпечаток берётся по всему файлу.
+            // У открытого JSON - по тексту до конца последней записи: при дописывании меняется только хвост
+            storeCache(pipeline.source.data(), 0, encrypted ? pipeline.source.size() : recordsEnd);
+        }
+        if (encrypted) {
+            recordsEnd = -1;
+        }
+    }
+
+    if (cancelled.load()) {
+        success = false;
+        error = QString("Загрузка отменена.");
+    }
+
+    totalElapsedNs = timer.nsecsElapsed();
+    peakMemory = ProcessMemory::peakResidentBytes();
+
+    if (success) {
+        reportProgress(fileSize, true);
+        qCDebug(lcLoader) << "LedgerLoader: Загружено записей:" << totalRecords
+                          << "отброшено:" << rejectedRecords
+                          << "первая невалидная:" << firstInvalid
+                          << "время (с):" << toSeconds(totalElapsedNs);
+        qCInfo(lcLoader).noquote() << statsReport();
+    }
+
+    active = false;
+    emit finished(success);
+}
+
+void LedgerLoader::readStage(Pipeline &pipeline, BoundedQueue<Chunk> &output)
+{
+    QElapsedTimer timer;
+    timer.start();
+    StageStats &stats = stages[ReadStage];
+    stats.used = true;
+
+    // Контейнер v2 читается участками по его индексу: после дописываний в файле остаются
+    // заменённые кадры и прежние индексы, которых расшифровка не должна видеть.
+    // Остальные файлы читаются целиком (пустой список участков)
+    QVector<EncryptionManager::FileRange> ranges;
+    if (EncryptionManager::detectFileFormat(path) == EncryptionManager::FormatV2) {
+        QFile file(path);
+        QString rangesError;
+        if (!file.open(QIODevice::ReadOnly)) {
+            rangesError = file.errorString();
+        } else {
+            encryption->readV2Ranges(&file, ranges, rangesError);
+        }
+        if (ranges.isEmpty()) {
+            fail(pipeline, QString("Не удалось прочитать индекс контейнера: %1").arg(rangesError), false);
+            stats.elapsedNs = timer.nsecsElapsed();
+            return;
+        }
+    }
+
+    // Файл отображён в память (см. run()): следующим стадиям передаются участки отображения без
+    // копирования, а стадия чтения заранее обращается к каждой странице, чтобы разбор не ждал подкачки
+    if (pipeline.source.isOpen()) {
+        const uchar *data = pipeline.source.data();
+        const qint64 size = pipeline.source.size();
+        const int pageSize = MappedFile::pageSize();
+        if (ranges.isEmpty()) {
+            ranges.append({0, size});
+        }
+        int next = 0;
+        qint64 offset = 0;
+        qint64 end = 0;
+
+        while (!pipeline.aborted.load()) {
+            if (cancelled.load()) {
+                pipeline.abort();
+                break;
+            }
+            if (offset >= end) {
+                if (next == ranges.size()) {
+                    output.close();
+                    break;
+                }
+                offset = qMin(ranges[next].offset, size);
+                end = qMin(ranges[next].offset + ranges[next].length, size);
+                ++next;
+                continue;
+            }
+
+            const qint64 length = qMin<qint64>(EncryptionManager::STREAM_CHUNK_SIZE, end - offset);
+            uchar touched = 0;
+            for (qint64 page = 0; page < length; page += pageSize) {
+                touched ^= static_cast<const volatile uchar *>(data)[offset + page];
+            }
+            Q_UNUSED(touched);
+
+            Chunk chunk;
+            chunk.data = pipeline.source.view(offset, length);
+            offset += length;
+            stats.bytes += length;
+            ++stats.items;
+            chunk.sourceEnd = offset;
+            if (!output.push(std::move(chunk))) {
+                break;
+            }
+        }
+
+        stats.elapsedNs = timer.nsecsElapsed();
+        return;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fail(pipeline, QString("Не удалось открыть файл: %1").arg(file.errorString()), false);
+    } else {
+        int next = 0;
+        qint64 remaining = ranges.isEmpty() ? std::numeric_limits<qint64>::max() : 0;
+
+        while (!pipeline.aborted.load()) {
+            if (cancelled.load()) {
+                pipeline.abort();
+                break;
+            }
+            if (remaining == 0) {
+                if (next == ranges.size()) {
+                    output.close();
+                    break;
+                }
+                if (!file.seek(ranges[next].offset)) {
+                    fail(pipeline, QString("Ошибка чтения файла: %1").arg(file.errorString()), false);
+                    break;
+                }
+                remaining = ranges[next].length;
+                ++next;
+                continue;
+            }
+
+            Chunk chunk;
+            chunk.data.resize(qMin<qint64>(EncryptionManager::STREAM_CHUNK_SIZE, remaining));
+            qint64 bytesRead = file.read(chunk.data.data(), chunk.data.size());
+            if (bytesRead < 0) {
+                fail(pipeline, QString("Ошибка чтения файла: %1").arg(file.errorString()), false);
+                break;
+            }
+            if (bytesRead == 0) {
+                output.close();
+                break;
+            }
+
+            chunk.data.resize(bytesRead);
+            remaining -= bytesRead;
+            stats.bytes += bytesRead;
+            ++stats.items;
+            chunk.sourceEnd = file.pos();
+            if (!output.push(std::move(chunk))) {
+                break;
+            }
+        }
+    }
+
+    stats.elapsedNs = timer.nsecsElapsed();
+}
+
+void LedgerLoader::decryptStage(Pipeline &pipeline)
+{
+    QElapsedTimer timer;
+    timer.start();
+    StageStats &stats = stages[DecryptStage];
+    stats.used = true;
+
+    ChunkQueueDevice device(pipeline.raw, pipeline.aborted);
+    device.open(QIODevice::ReadOnly);
+
+    QString decryptError;
+    bool decrypted = encryption->decryptStream(&device, [this, &pipeline, &device, &stats](const char *data, qsizetype size) {
+        if (cancelled.load()) {
+            pipeline.abort();
+            return false;
+        }
+        Chunk chunk;
+        chunk.data = QByteArray(data, size);
+        chunk.sourceEnd = device.sourcePosition();
+        stats.bytes += size;
+        ++stats.items;
+        return pipeline.plain.push(std::move(chunk));
+    }, decryptError);
+
+    if (decrypted) {
+        pipeline.plain.close();
+    } else if (!pipeline.aborted.load()) {
+        fail(pipeline, QString("Ошибка расшифровки: %1").arg(decryptError), false);
+    }
+
+    stats.elapsedNs = timer.nsecsElapsed();
+}
+
+void LedgerLoader::parseStage(Pipeline &pipeline)
+{
+    QElapsedTimer timer;
+    timer.start();
+    StageStats &stats = stages[ParseStage];
+    stats.used = true;
+
+    InvoiceParser parser(currentBatch);
+    bool ok = true;
+    Chunk chunk;
+
+    while (pipeline.plain.pop(chunk)) {
+        if (cancelled.load()) {
+            pipeline.abort();
+            ok = false;
+            break;
+        }
+
+        if (!parser.feed(chunk.data.constData(), chunk.data.size())) {
+            fail(pipeline, QString("Ошибка парсинга: %1 (позиция %2)").arg(parser.errorString()).arg(parser.errorOffset()), true);
+            ok = false;
+            break;
+        }
+        stats.bytes += chunk.data.size();
+        ++stats.items;
+
+        if (currentBatch.size() >= batchLimit && !pushBatch(pipeline)) {
+            ok = false;
+            break;
+        }
+        reportProgress(chunk.sourceEnd, false);
+    }
+
+    if (ok && !pipeline.aborted.load()) {
+        if (!parser.finish()) {
+            fail(pipeline, QString("Ошибка парсинга: %1 (позиция %2)").arg(parser.errorString()).arg(parser.errorOffset()), true);
+        } else if (pushBatch(pipeline)) {
+            pipeline.batches.close();
+        }
+    }
+    rejectedRecords = parser.rejectedCount();
+    for (int i = 0; i < InvoiceParser::RejectReasonCount; ++i) {
+        rejectedByReason[i] = parser.rejectedCount(InvoiceParser::RejectReason(i));
+    }
+    recordsEnd = parser.elementEndOffset();
+    // Заголовок с алгоритмом разбирается в первую пачку; pushBatch переносит алгоритм на следующие
+    algorithm = currentBatch.hashAlgorithm();
+
+    stats.elapsedNs = timer.nsecsElapsed();
+}
+
+bool LedgerLoader::pushBatch(Pipeline &pipeline)
+{
+    if (currentBatch.isEmpty()) {
+        return !pipeline.aborted.load();
+    }
+
+    LedgerStore batch;
+    batch.swap(currentBatch);
+    currentBatch.setHashAlgorithm(batch.hashAlgorithm());
+    batchLimit = BATCH_SIZE;
+    return pipeline.batches.push(std::move(batch));
+}
+
+void LedgerLoader::verifyStage(Pipeline &pipeline)
+{
+    QElapsedTimer timer;
+    timer.start();
+    StageStats &stats = stages[VerifyStage];
+    stats.used = true;
+
+    LedgerStore batch;
+    while (pipeline.batches.pop(batch)) {
+        if (cancelled.load()) {
+            pipeline.abort();
+            break;
+        }
+        stats.items += batch.size();
+        publishBatch(batch);
+    }
+    if (!pipeline.aborted.load()) {
+        finishHeldBatches();
+    }
+
+    stats.elapsedNs = timer.nsecsElapsed();
+}
+
+void LedgerLoader::publishBatch(LedgerStore &batch)
+{
+    const qsizetype count = batch.size();
+    if (count == 0) {
+        // Пустой двоичный файл
+        return;
+    }
+
+    // Записи префикса из кэша принимаются без пересчёта только после того, как хеш последней
+    // из них совпал с сохранённым: до этого пачки префикса не публикуются
+    if (verifyChain && !chainBroken && trustedRecords > 0) {
+        const qsizetype boundary = trustedRecords - totalRecords - heldRecords;
+        if (batch.hashAlgorithm() != cacheEntry.hashAlgorithm) {
+            // Алгоритм .ldg хранится в заголовке вне участка отпечатка и мог измениться
+            qCDebug(lcLoader) << "LedgerLoader: Кэш проверки получен другим алгоритмом цепочки, записи проверяются заново";
+            trustedRecords = 0;
+        } else if (boundary > count) {
+            heldRecords += count;
+            heldBatches.append(LedgerStore());
+            heldBatches.last().swap(batch);
+            return;
+        } else if (boundary > 0 && std::memcmp(batch.hash(boundary - 1), trustedHash, LedgerStore::HASH_SIZE) != 0) {
+            qCDebug(lcLoader) << "LedgerLoader: Кэш проверки не совпал с файлом, записи проверяются заново";
+            trustedRecords = 0;
+        }
+        releaseHeldBatches();
+    }
+
+    verifyAndPublish(batch);
+}
+
+void LedgerLoader::releaseHeldBatches()
+{
+    QList<LedgerStore> held;
+    held.swap(heldBatches);
+    heldRecords = 0;
+    for (LedgerStore &batch : held) {
+        verifyAndPublish(batch);
+    }
+}
+
+void LedgerLoader::finishHeldBatches()
+{
+    if (heldBatches.isEmpty()) {
+        return;
+    }
+    qCDebug(lcLoader) << "LedgerLoader: Записей меньше, чем в кэше проверки, записи проверяются заново";
+    trustedRecords = 0;
+    releaseHeldBatches();
+}
+
+void LedgerLoader::verifyAndPublish(LedgerStore &batch)
+{
+    const qsizetype count = batch.size();
+
+    // Проверка продолжает цепочку с последнего проверенного хеша предыдущей пачки;
+    // после первого нарушения все последующие записи невалидны
+    if (!verifyChain) {
+        batch.setAllValid();
+    } else if (chainBroken) {
+        batch.markInvalidFrom(0);
+    } else {
+        // Записи, проверенные при прошлом открытии (по кэшу), не пересчитываются: хеш на границе
+        // префикса уже сверен в publishBatch
+        const qsizetype trusted = qBound<qsizetype>(0, trustedRecords - totalRecords, count);
+        const uchar *seed = trusted > 0 ? batch.hash(trusted - 1) : (hasLastHash ? lastHash : nullptr);
+        const qsizetype mismatch = HashChainVerifier::verifyRangeParallel(batch, trusted, count, seed);
+        batch.markInvalidFrom(mismatch);
+        if (mismatch < count) {
+            chainBroken = true;
+            firstInvalid = totalRecords + mismatch;
+            qCDebug(lcLoader) << "LedgerLoader: Обнаружено нарушение целостности в записи #" << (firstInvalid + 1);
+            // lastHash - хеш последней верной записи (для кэша проверки)
+            if (mismatch > 0) {
+                std::memcpy(lastHash, batch.hash(mismatch - 1), LedgerStore::HASH_SIZE);
+                hasLastHash = true;
+            }
+        } else {
+            std::memcpy(lastHash, batch.hash(count - 1), LedgerStore::HASH_SIZE);
+            hasLastHash = true;
+        }
+    }
+
+    totalRecords += count;
+
+    bool notify = false;
+    {
+        QMutexLocker locker(&queueMutex);
+        notify = readyBatches.isEmpty();
+        readyBatches.append(LedgerStore());
+        readyBatches.last().swap(batch);
+    }
+
+    // Интерфейс забирает все накопленные пачки сразу, поэтому сигнал нужен только для первой
+    if (notify) {
+        emit batchesReady();
+    }
+}
+
+qsizetype LedgerLoader::verifiedRecordCount() const
+{
+    return firstInvalid < 0 ? totalRecords : firstInvalid;
+}
+
+void LedgerLoader::lookupCache(const uchar *data, qint64 size)
+{
+    if (!verifyChain || !useCache) {
+        return;
+    }
+    if (!VerificationCache::read(path, cacheEntry)) {
+        return;
+    }
+    const qint64 modified = QFileInfo(path).lastModified().toMSecsSinceEpoch();
+    if (!VerificationCache::matches(cacheEntry, data, size, modified)) {
+        qCDebug(lcLoader) << "LedgerLoader: Файл изменён после прошлой проверки, кэш не используется";
+        return;
+    }
+
+    trustedRecords = qsizetype(cacheEntry.verifiedRecords);
+    std::memcpy(trustedHash, cacheEntry.lastHash, LedgerStore::HASH_SIZE);
+    qCDebug(lcLoader) << "LedgerLoader: По кэшу проверки принято записей:" << trustedRecords
+                      << (size == cacheEntry.fileSize ? "(файл не изменился)" : "(файл дописан)");
+}
+
+void LedgerLoader::storeCache(const uchar *data, qint64 regionBegin, qint64 regionEnd)
+{
+    // Без проверки цепочки сохранять нечего
+    if (!verifyChain || !useCache) {
+        return;
+    }
+    const qsizetype verified = verifiedRecordCount();
+    if (verified == 0 || (verified == trustedRecords && regionEnd == cacheEntry.regionEnd)) {
+        return;
+    }
+
+    VerificationCache::Entry entry;
+    entry.regionBegin = regionBegin;
+    entry.regionEnd = regionEnd;
+    entry.fingerprint = VerificationCache::fingerprint(data + regionBegin, regionEnd - regionBegin);
+    entry.verifiedRecords = verified;
+    entry.hashAlgorithm = algorithm;
+    std::memcpy(entry.lastHash, lastHash, LedgerStore::HASH_SIZE);
+
+    QString cacheError;
+    if (!VerificationCache::write(path, entry, cacheError)) {
+        qCWarning(lcLoader) << "LedgerLoader:" << cacheError;
+    }
+}
+
+void LedgerLoader::fail(Pipeline &pipeline, const QString &message, bool isParseError)
+{
+    {
+        QMutexLocker locker(&errorMutex);
+        if (error.isEmpty()) {
+            error = message;
+            parseError = isParseError;
+        }
+    }
+    pipeline.abort();
+}
+
+void LedgerLoader::reportProgress(qint64 processedBytes, bool force)
+{
+    const qint64 percent = fileSize > 0 ? processedBytes * 100 / fileSize : 100;
+    if (force || percent != lastReportedPercent) {
+        lastReportedPercent = percent;
+        emit progressChanged(processedBytes, fileSize);
+    }
+}
+
+QString LedgerLoader::stageName(Stage stage)
+{
+    switch (stage) {
+    case ReadStage:
+        return QString("чтение");
+    case DecryptStage:
+        return QString("расшифровка");
+    case ParseStage:
+        return QString("разбор");
+    case VerifyStage:
+        return QString("проверка");
+    default:
+        return QString();
+    }
+}
+
+QString LedgerLoader::statsReport() const
+{
+    QStringList lines;
+    lines << QString("LedgerLoader: Статистика конвейера:");
+
+    for (int i = 0; i < StageCount; ++i) {
+        const StageStats &stats = stages[i];
+        if (!stats.used) {
+            continue;
+        }
+
+        const double busy = toSeconds(stats.busyNs());
+        QString line;
+        if (stats.bytes > 0) {
+            const double megabytes = double(stats.bytes) / (1 << 20);
+            line = QString("  %1: %2 МиБ, фрагментов %3, работа %4 с (%5 МиБ/с)")
+                       .arg(stageName(Stage(i)))
+                       .arg(megabytes, 0, 'f', 1)
+                       .arg(stats.items)
+                       .arg(busy, 0, 'f', 3)
+                       .arg(busy > 0 ? megabytes / busy : 0.0, 0, 'f', 1);
+        } else {
+            line = QString("  %1: записей %2, работа %3 с (%4 записей/с)")
+                       .arg(stageName(Stage(i)))
+                       .arg(stats.items)
+                       .arg(busy, 0, 'f', 3)
+                       .arg(busy > 0 ? stats.items / busy : 0.0, 0, 'f', 0);
+        }
+        line += QString(", ожидание входа %1 с, выхода %2 с")
+                    .arg(toSeconds(stats.inputWaitNs), 0, 'f', 3)
+                    .arg(toSeconds(stats.outputWaitNs), 0, 'f', 3);
+
+        const QueueStats &queue = inputQueues[i];
+        if (queue.capacity > 0) {
+            line += QString("; очередь на входе: макс. %1 из %2, средняя %3")
+                        .arg(queue.maxDepth)
+                        .arg(queue.capacity)
+                        .arg(queue.averageDepth(), 0, 'f', 1);
+        }
+        lines << line;
+    }
+
+    if (rejectedRecords > 0) {
+        QStringList reasons;
+        for (int i = 0; i < InvoiceParser::RejectReasonCount; ++i) {
+            if (rejectedByReason[i] > 0) {
+                reasons << QString("%1 - %2")
+                               .arg(InvoiceParser::rejectReasonName(InvoiceParser::RejectReason(i)))
+                               .arg(rejectedByReason[i]);
+            }
+        }
+        lines << QString("  Отброшено записей: %1 (%2)").arg(rejectedRecords).arg(reasons.join(", "));
+    }
+
+    return lines.join('\n');
+}
+
+QJsonObject LedgerLoader::statsJson() const
+{
+    static_assert(sizeof(stageKeys) / sizeof(stageKeys[0]) == StageCount, "ключ для каждой стадии");
+    static_assert(sizeof(rejectReasonKeys) / sizeof(rejectReasonKeys[0]) == InvoiceParser::RejectReasonCount,
+                  "ключ для каждой причины отбрасывания");
+
+    QJsonObject reasons;
+    for (int i = 0; i < InvoiceParser::RejectReasonCount; ++i) {
+        reasons[rejectReasonKeys[i]] = qint64(rejectedByReason[i]);
+    }
+
+    QJsonArray stageList;
+    for (int i = 0; i < StageCount; ++i) {
+        const StageStats &stats = stages[i];
+        if (!stats.used) {
+            continue;
+        }
+        QJsonObject stage;
+        stage["name"] = stageKeys[i];
+        stage["items"] = stats.items;
+        stage["bytes"] = stats.bytes;
+        stage["elapsedMs"] = toMilliseconds(stats.elapsedNs);
+        stage["busyMs"] = toMilliseconds(stats.busyNs());
+        stage["inputWaitMs"] = toMilliseconds(stats.inputWaitNs);
+        stage["outputWaitMs"] = toMilliseconds(stats.outputWaitNs);
+        const QueueStats &queue = inputQueues[i];
+        if (queue.capacity > 0) {
+            QJsonObject queueObject;
+            queueObject["capacity"] = queue.capacity;
+            queueObject["maxDepth"] = queue.maxDepth;
+            queueObject["averageDepth"] = queue.averageDepth();
+            stage["queue"] = queueObject;
+        }
+        stageList.append(stage);
+    }
+
+    QJsonObject object;
+    object["file"] = path;
+    object["fileSize"] = fileSize;
+    object["records"] = qint64(totalRecords);
+    object["hashAlgorithm"] = LedgerStore::hashAlgorithmName(algorithm);
+    object["cachedRecords"] = qint64(trustedRecords);
+    object["rejected"] = qint64(rejectedRecords);
+    object["rejectedByReason"] = reasons;
+    object["firstInvalidIndex"] = qint64(firstInvalid);
+    object["elapsedMs"] = toMilliseconds(totalElapsedNs);
+    object["peakMemoryBytes"] = peakMemory;
+    object["stages"] = stageList;
+    if (!error.isEmpty()) {
+        object["error"] = error;
+    }
+    return object;
+}
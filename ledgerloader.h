@@ -0,0 +1,195 @@
+#ifndef LEDGERLOADER_H
+#define LEDGERLOADER_H
+
+#include "ledgerstore.h"
+#include "boundedqueue.h"
+#include "verificationcache.h"
+#include "invoiceparser.h"
+#include <QObject>
+#include <QJsonObject>
+#include <QMutex>
+#include <QList>
+#include <QString>
+#include <atomic>
+
+class QThread;
+class EncryptionManager;
+
+// Фоновая загрузка файла с накладными в виде конвейера: чтение -> расшифровка -> разбор ->
+// проверка цепочки. Каждая стадия работает в своём потоке и связана со следующей ограниченной
+// очередью, поэтому время загрузки определяется самой медленной стадией, а не суммой всех.
+// Проверенные записи передаются в поток интерфейса пачками (первая пачка - небольшая, чтобы
+// строки появились сразу), ход загрузки сообщается сигналом progressChanged, а загрузку можно
+// прервать через cancel().
+class LedgerLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LedgerLoader(QObject *parent = nullptr);
+    ~LedgerLoader();
+
+    // Запуск загрузки; encryptionManager должен существовать до завершения загрузки.
+    // Возвращает false, если предыдущая загрузка ещё выполняется
+    bool start(const QString &filePath, const EncryptionManager *encryptionManager);
+    // Проверка цепочки хешей при загрузке (включена по умолчанию; задаётся до start()). Без неё
+    // все записи считаются валидными, а кэш проверки не используется: цепочку проверяет
+    // вызывающий, например BatchChainVerifier сразу для нескольких файлов
+    void setChainVerification(bool enabled) { verifyChain = enabled; }
+    // Использование кэша проверки <файл>.vcache (включено по умолчанию; задаётся до start()).
+    // Без него цепочка проверяется полностью, а файл кэша не читается и не создаётся
+    void setCacheEnabled(bool enabled) { useCache = enabled; }
+    // Запрос на прерывание загрузки (завершение придёт сигналом finished)
+    void cancel();
+    // Ожидание завершения рабочего потока
+    void wait();
+    bool isRunning() const;
+
+    // Забирает накопленные пачки записей (вызывается из потока интерфейса)
+    QList<LedgerStore> takeBatches();
+
+    // Результаты последней загрузки (действительны после сигнала finished)
+    QString filePath() const { return path; }
+    QString errorMessage() const { return error; }
+    bool isParseError() const { return parseError; }
+    bool wasCancelled() const { return cancelled.load(); }
+    qsizetype recordCount() const { return totalRecords; }
+    qsizetype rejectedCount() const { return rejectedRecords; }
+    qsizetype rejectedCount(InvoiceParser::RejectReason reason) const { return rejectedByReason[reason]; }
+    // Записи, принятые по кэшу проверки без пересчёта хешей
+    qsizetype cachedRecordCount() const { return trustedRecords; }
+    // Индекс первой записи с нарушенной цепочкой или -1, если цепочка цела
+    qsizetype firstInvalidIndex() const { return firstInvalid; }
+    // Смещение в файле сразу после последней записи (только для незашифрованного JSON, иначе -1):
+    // с него продолжается чтение дописанных записей
+    qint64 recordsEndOffset() const { return recordsEnd; }
+    // Алгоритм цепочки хешей файла (из заголовка; MD5, если его нет)
+    LedgerStore::HashAlgorithm hashAlgorithm() const { return algorithm; }
+    qint64 fileSizeBytes() const { return fileSize; }
+    // Время загрузки целиком и пиковый объём памяти процесса после неё
+    qint64 elapsedNs() const { return totalElapsedNs; }
+    qint64 peakMemoryBytes() const { return peakMemory; }
+
+    // Стадии конвейера загрузки
+    enum Stage {
+        ReadStage = 0,
+        DecryptStage,   // Только для зашифрованных файлов
+        ParseStage,
+        VerifyStage,
+        StageCount
+    };
+
+    // Статистика стадии за последнюю загрузку
+    struct StageStats
+    {
+        bool used = false;          // Стадия участвовала в загрузке
+        qint64 items = 0;           // Обработано фрагментов (для проверки - записей)
+        qint64 bytes = 0;           // Обработано байт (для проверки не учитывается)
+        qint64 elapsedNs = 0;       // Время работы потока стадии
+        qint64 inputWaitNs = 0;     // Ожидание данных от предыдущей стадии
+        qint64 outputWaitNs = 0;    // Ожидание места в очереди следующей стадии
+
+        qint64 busyNs() const { return qMax<qint64>(0, elapsedNs - inputWaitNs - outputWaitNs); }
+    };
+
+    StageStats stageStats(Stage stage) const { return stages[stage]; }
+    // Статистика очереди на входе стадии (у стадии чтения входной очереди нет)
+    QueueStats inputQueueStats(Stage stage) const { return inputQueues[stage]; }
+    static QString stageName(Stage stage);
+    // Сводка по стадиям и очередям для журнала: стадия с наименьшим ожиданием - узкое место
+    QString statsReport() const;
+    // Та же статистика вместе с итогами загрузки и причинами отбрасывания записей - для экспорта
+    QJsonObject statsJson() const;
+
+    // Фрагмент данных между стадиями; sourceEnd - позиция в файле после фрагмента (для хода загрузки)
+    struct Chunk
+    {
+        QByteArray data;
+        qint64 sourceEnd = 0;
+    };
+
+    static const int FIRST_BATCH_SIZE = 4096;   // Первая пачка - для быстрого появления строк
+    static const int BATCH_SIZE = 1 << 18;      // Последующие пачки
+    static const int RAW_QUEUE_CAPACITY = 8;    // Фрагментов файла (по STREAM_CHUNK_SIZE) перед расшифровкой
+    static const int PLAIN_QUEUE_CAPACITY = 8;  // Фрагментов открытого текста перед разбором
+    static const int BATCH_QUEUE_CAPACITY = 4;  // Пачек записей перед проверкой цепочки
+
+signals:
+    void progressChanged(qint64 processedBytes, qint64 totalBytes);
+    void batchesReady();
+    void finished(bool success);
+
+private:
+    struct Pipeline;
+
+    // Тело рабочего потока: запускает стадии и сам выполняет разбор
+    void run();
+    // Стадии конвейера
+    void readStage(Pipeline &pipeline, BoundedQueue<Chunk> &output);
+    void decryptStage(Pipeline &pipeline);
+    void parseStage(Pipeline &pipeline);
+    void verifyStage(Pipeline &pipeline);
+    // Передача накопленной пачки на проверку; возвращает false, если конвейер прерван
+    bool pushBatch(Pipeline &pipeline);
+    // Проверка цепочки в пачке и передача её в очередь для интерфейса. Пачки, целиком лежащие
+    // в проверенном по кэшу префиксе, откладываются до сверки хеша на границе префикса
+    void publishBatch(LedgerStore &batch);
+    // Публикация отложенных пачек: проверенными по кэшу или, если кэш отвергнут, после проверки
+    void releaseHeldBatches();
+    // Конец записей до границы префикса: хеш на границе не сверен, кэш не используется
+    void finishHeldBatches();
+    // Проверка цепочки в пачке (записи префикса из кэша не пересчитываются) и её публикация
+    void verifyAndPublish(LedgerStore &batch);
+    // Число записей с начала файла, прошедших проверку
+    qsizetype verifiedRecordCount() const;
+    // Кэш проверки: поиск проверенного префикса по отображению файла до проверки
+    // и сохранение результата после неё (отпечаток берётся по участку [regionBegin, regionEnd))
+    void lookupCache(const uchar *data, qint64 size);
+    void storeCache(const uchar *data, qint64 regionBegin, qint64 regionEnd);
+    // Запись первой ошибки и прерывание всех стадий
+    void fail(Pipeline &pipeline, const QString &message, bool isParseError);
+    void reportProgress(qint64 processedBytes, bool force);
+
+    QThread *thread;
+    const EncryptionManager *encryption;
+    bool verifyChain;
+    bool useCache;
+    std::atomic<bool> cancelled;
+    std::atomic<bool> active;
+
+    QMutex queueMutex;
+    QList<LedgerStore> readyBatches;
+    QMutex errorMutex;
+
+    // Состояние рабочего потока
+    QString path;
+    qint64 fileSize;
+    qint64 lastReportedPercent;
+    LedgerStore currentBatch;
+    qsizetype batchLimit;
+    uchar lastHash[LedgerStore::HASH_SIZE];
+    bool hasLastHash;
+    bool chainBroken;
+    // Проверенный префикс из кэша: записи [0, trustedRecords) не пересчитываются
+    VerificationCache::Entry cacheEntry;
+    qsizetype trustedRecords;
+    uchar trustedHash[LedgerStore::HASH_SIZE];
+    QList<LedgerStore> heldBatches;     // Пачки префикса, ожидающие сверки хеша на его границе
+    qsizetype heldRecords;
+
+    // Результаты
+    QString error;
+    bool parseError;
+    qsizetype totalRecords;
+    qsizetype rejectedRecords;
+    qsizetype rejectedByReason[InvoiceParser::RejectReasonCount];
+    qsizetype firstInvalid;
+    qint64 recordsEnd;
+    LedgerStore::HashAlgorithm algorithm;
+    qint64 totalElapsedNs;
+    qint64 peakMemory;
+    StageStats stages[StageCount];
+    QueueStats inputQueues[StageCount];
+};
+
+#endif
@@ -0,0 +1,9 @@
+#include "ledgerlog.h"
+
+Q_LOGGING_CATEGORY(lcLoader, "ledger.loader")
+Q_LOGGING_CATEGORY(lcParser, "ledger.parser", QtInfoMsg)
+Q_LOGGING_CATEGORY(lcCrypto, "ledger.crypto")
+Q_LOGGING_CATEGORY(lcFormat, "ledger.format")
+Q_LOGGING_CATEGORY(lcCache, "ledger.cache")
+Q_LOGGING_CATEGORY(lcTail, "ledger.tail")
+Q_LOGGING_CATEGORY(lcWriter, "ledger.writer")
@@ -0,0 +1,19 @@
+#ifndef LEDGERLOG_H
+#define LEDGERLOG_H
+
+#include <QLoggingCategory>
+
+// Категории журнала ядра. Сообщения пишутся через qCDebug/qCInfo/qCWarning: при выключенной
+// категории сообщение не форматируется, поэтому проверка стоит одного сравнения даже в циклах
+// по записям. Отладочные сообщения разборщика (по одному на отброшенную запись) по умолчанию
+// выключены и включаются правилом QT_LOGGING_RULES="ledger.parser.debug=true";
+// все сообщения ядра отключаются правилом "ledger.*=false"
+Q_DECLARE_LOGGING_CATEGORY(lcLoader)    // ledger.loader - загрузка и её статистика
+Q_DECLARE_LOGGING_CATEGORY(lcParser)    // ledger.parser - разбор JSON
+Q_DECLARE_LOGGING_CATEGORY(lcCrypto)    // ledger.crypto - ключ и шифрование
+Q_DECLARE_LOGGING_CATEGORY(lcFormat)    // ledger.format - форматы файлов и отображение в память
+Q_DECLARE_LOGGING_CATEGORY(lcCache)     // ledger.cache - кэш проверки
+Q_DECLARE_LOGGING_CATEGORY(lcTail)      // ledger.tail - слежение за файлом
+Q_DECLARE_LOGGING_CATEGORY(lcWriter)    // ledger.writer - дописывание записей
+
+#endif
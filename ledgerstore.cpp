@@ -0,0 +1,351 @@
+#include "ledgerstore.h"
+#include "mappedfile.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+const int ENCODED_HASH_SIZE = 24;  // base64 от 16 байт: 22 значащих символа и "=="
+
+// Таблица обратного преобразования base64 (-1 - символ вне алфавита)
+struct Base64DecodeTable
+{
+    signed char values[256];
+
+    Base64DecodeTable()
+    {
+        std::memset(values, -1, sizeof(values));
+        for (int i = 0; i < 64; ++i) {
+            values[static_cast<uchar>(BASE64_ALPHABET[i])] = static_cast<signed char>(i);
+        }
+    }
+};
+
+const Base64DecodeTable DECODE_TABLE;
+
+}
+
+LedgerStore::LedgerStore()
+    : mappedRecords(nullptr)
+    , mappedCount(0)
+    , algorithm(HashMd5)
+{
+}
+
+QString LedgerStore::hashAlgorithmName(HashAlgorithm hashAlgorithm)
+{
+    switch (hashAlgorithm) {
+    case HashSha256:
+        return QString("sha256");
+    case HashBlake2s:
+        return QString("blake2s");
+    default:
+        return QString("md5");
+    }
+}
+
+bool LedgerStore::parseHashAlgorithm(const QString &name, HashAlgorithm &hashAlgorithm)
+{
+    for (int i = 0; i < HashAlgorithmCount; ++i) {
+        if (name.compare(hashAlgorithmName(HashAlgorithm(i)), Qt::CaseInsensitive) == 0) {
+            hashAlgorithm = HashAlgorithm(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void LedgerStore::clear()
+{
+    mappedFile.reset();
+    mappedRecords = nullptr;
+    mappedCount = 0;
+    articles.clear();
+    quantities.clear();
+    timestamps.clear();
+    hashes.clear();
+    validBits.clear();
+    irregularBits.clear();
+    irregularHashes.clear();
+    algorithm = HashMd5;
+}
+
+void LedgerStore::reserve(qsizetype count)
+{
+    if (mappedRecords) {
+        return;
+    }
+    const size_t n = static_cast<size_t>(count);
+    articles.reserve(n);
+    quantities.reserve(n);
+    timestamps.reserve(n);
+    hashes.reserve(n * HASH_SIZE);
+    validBits.reserve((n + 63) / 64);
+    irregularBits.reserve((n + 63) / 64);
+}
+
+void LedgerStore::swap(LedgerStore &other)
+{
+    articles.swap(other.articles);
+    quantities.swap(other.quantities);
+    timestamps.swap(other.timestamps);
+    hashes.swap(other.hashes);
+    validBits.swap(other.validBits);
+    irregularBits.swap(other.irregularBits);
+    irregularHashes.swap(other.irregularHashes);
+    mappedFile.swap(other.mappedFile);
+    std::swap(mappedRecords, other.mappedRecords);
+    std::swap(mappedCount, other.mappedCount);
+    std::swap(algorithm, other.algorithm);
+}
+
+void LedgerStore::attachMapped(std::shared_ptr<const MappedFile> file, const uchar *records, qsizetype count,
+                               const QHash<qsizetype, QString> &irregularHashText)
+{
+    const HashAlgorithm hashAlgorithm = algorithm;
+    clear();
+    algorithm = hashAlgorithm;
+    if (count <= 0) {
+        return;
+    }
+
+    mappedFile = std::move(file);
+    mappedRecords = records;
+    mappedCount = count;
+    validBits.assign(static_cast<size_t>(count + 63) / 64, ~quint64(0));
+    irregularHashes = irregularHashText;
+}
+
+void LedgerStore::detach()
+{
+    if (!mappedRecords) {
+        return;
+    }
+
+    const qsizetype count = mappedCount;
+    std::vector<quint64> newArticles(static_cast<size_t>(count));
+    std::vector<qint32> newQuantities(static_cast<size_t>(count));
+    std::vector<qint64> newTimestamps(static_cast<size_t>(count));
+    std::vector<uchar> newHashes(static_cast<size_t>(count) * HASH_SIZE);
+    std::vector<quint64> newIrregularBits(validBits.size(), 0);
+
+    for (qsizetype i = 0; i < count; ++i) {
+        newArticles[i] = article(i);
+        newQuantities[i] = quantity(i);
+        newTimestamps[i] = timestamp(i);
+        std::memcpy(newHashes.data() + i * HASH_SIZE, hash(i), HASH_SIZE);
+        if (!hasCanonicalHash(i)) {
+            assignBit(newIrregularBits, i, true);
+        }
+    }
+
+    articles.swap(newArticles);
+    quantities.swap(newQuantities);
+    timestamps.swap(newTimestamps);
+    hashes.swap(newHashes);
+    irregularBits.swap(newIrregularBits);
+    mappedFile.reset();
+    mappedRecords = nullptr;
+    mappedCount = 0;
+}
+
+void LedgerStore::assignBit(std::vector<quint64> &bits, qsizetype index, bool value)
+{
+    const quint64 mask = quint64(1) << (index & 63);
+    quint64 &word = bits[static_cast<size_t>(index) >> 6];
+    word = value ? (word | mask) : (word & ~mask);
+}
+
+void LedgerStore::append(quint64 article, qint32 quantity, qint64 timestamp, const char *hashText, qsizetype hashLength)
+{
+    detach();
+    const qsizetype index = size();
+    if ((index & 63) == 0) {
+        validBits.push_back(0);
+        irregularBits.push_back(0);
+    }
+
+    articles.push_back(article);
+    quantities.push_back(quantity);
+    timestamps.push_back(timestamp);
+
+    hashes.resize(hashes.size() + HASH_SIZE);
+    uchar *hashOut = hashes.data() + index * HASH_SIZE;
+    if (!decodeHash(hashText, hashLength, hashOut)) {
+        // Хеш не является base64 от 16 байт: запись заведомо не пройдёт проверку цепочки,
+        // исходный текст сохраняется отдельно только для отображения
+        std::memset(hashOut, 0, HASH_SIZE);
+        assignBit(irregularBits, index, true);
+        irregularHashes.insert(index, QString::fromUtf8(hashText, static_cast<int>(hashLength)));
+    }
+
+    assignBit(validBits, index, true);
+}
+
+void LedgerStore::append(const InvoiceRecord &record)
+{
+    const QByteArray hashText = record.hash.toUtf8();
+    append(record.article.toULongLong(), record.quantity, record.timestamp, hashText.constData(), hashText.size());
+    setValid(size() - 1, record.valid);
+}
+
+void LedgerStore::append(const LedgerStore &other)
+{
+    if (other.isEmpty()) {
+        return;
+    }
+    if (isEmpty()) {
+        algorithm = other.algorithm;
+    }
+    if (isEmpty() && other.isMapped()) {
+        // Пустое хранилище может ссылаться на то же отображение без копирования
+        *this = other;
+        return;
+    }
+
+    detach();
+    const qsizetype offset = size();
+    const qsizetype total = offset + other.size();
+
+    if (other.isMapped()) {
+        for (qsizetype i = 0; i < other.size(); ++i) {
+            articles.push_back(other.article(i));
+            quantities.push_back(other.quantity(i));
+            timestamps.push_back(other.timestamp(i));
+            hashes.insert(hashes.end(), other.hash(i), other.hash(i) + HASH_SIZE);
+        }
+    } else {
+        articles.insert(articles.end(), other.articles.begin(), other.articles.end());
+        quantities.insert(quantities.end(), other.quantities.begin(), other.quantities.end());
+        timestamps.insert(timestamps.end(), other.timestamps.begin(), other.timestamps.end());
+        hashes.insert(hashes.end(), other.hashes.begin(), other.hashes.end());
+    }
+    validBits.resize(static_cast<size_t>(total + 63) / 64, 0);
+    irregularBits.resize(static_cast<size_t>(total + 63) / 64, 0);
+
+    for (qsizetype i = 0; i < other.size(); ++i) {
+        assignBit(validBits, offset + i, other.isValid(i));
+        assignBit(irregularBits, offset + i, !other.hasCanonicalHash(i));
+    }
+    for (auto it = other.irregularHashes.cbegin(); it != other.irregularHashes.cend(); ++it) {
+        irregularHashes.insert(offset + it.key(), it.value());
+    }
+}
+
+QString LedgerStore::articleText(qsizetype index) const
+{
+    char buffer[ARTICLE_DIGITS];
+    formatArticle(article(index), buffer);
+    return QString::fromLatin1(buffer, ARTICLE_DIGITS);
+}
+
+QString LedgerStore::hashText(qsizetype index) const
+{
+    if (!hasCanonicalHash(index)) {
+        return irregularHashes.value(index);
+    }
+    char buffer[ENCODED_HASH_SIZE];
+    encodeHash(hash(index), buffer);
+    return QString::fromLatin1(buffer, ENCODED_HASH_SIZE);
+}
+
+InvoiceRecord LedgerStore::record(qsizetype index) const
+{
+    InvoiceRecord result;
+    result.article = articleText(index);
+    result.quantity = quantity(index);
+    result.timestamp = timestamp(index);
+    result.hash = hashText(index);
+    result.valid = isValid(index);
+    return result;
+}
+
+void LedgerStore::setValid(qsizetype index, bool valid)
+{
+    assignBit(validBits, index, valid);
+}
+
+void LedgerStore::setAllValid()
+{
+    std::fill(validBits.begin(), validBits.end(), ~quint64(0));
+}
+
+void LedgerStore::markInvalidFrom(qsizetype first)
+{
+    setAllValid();
+    if (first >= size()) {
+        return;
+    }
+    first = qMax<qsizetype>(0, first);
+
+    size_t word = static_cast<size_t>(first) >> 6;
+    validBits[word] &= (quint64(1) << (first & 63)) - 1;
+    std::fill(validBits.begin() + word + 1, validBits.end(), quint64(0));
+}
+
+qint64 LedgerStore::memoryUsage() const
+{
+    qint64 total = qint64(articles.capacity()) * sizeof(quint64)
+                 + qint64(quantities.capacity()) * sizeof(qint32)
+                 + qint64(timestamps.capacity()) * sizeof(qint64)
+                 + qint64(hashes.capacity())
+                 + qint64(validBits.capacity() + irregularBits.capacity()) * sizeof(quint64);
+    for (auto it = irregularHashes.cbegin(); it != irregularHashes.cend(); ++it) {
+        total += qint64(sizeof(qsizetype)) + it.value().size() * qint64(sizeof(QChar));
+    }
+    // Отображение файла не занимает кучу: его страницы принадлежат кэшу страниц
+    return total;
+}
+
+void LedgerStore::formatArticle(quint64 article, char *out)
+{
+    for (int i = ARTICLE_DIGITS - 1; i >= 0; --i) {
+        out[i] = char('0' + article % 10);
+        article /= 10;
+    }
+}
+
+bool LedgerStore::decodeHash(const char *text, qsizetype length, uchar *out)
+{
+    if (length != ENCODED_HASH_SIZE || text[22] != '=' || text[23] != '=') {
+        return false;
+    }
+
+    int values[22];
+    for (int i = 0; i < 22; ++i) {
+        values[i] = DECODE_TABLE.values[static_cast<uchar>(text[i])];
+        if (values[i] < 0) {
+            return false;
+        }
+    }
+    // В канонической записи неиспользуемые младшие 4 бита последнего символа равны нулю
+    if (values[21] & 0x0F) {
+        return false;
+    }
+
+    int o = 0;
+    for (int i = 0; i < 20; i += 4) {
+        out[o++] = uchar((values[i] << 2) | (values[i + 1] >> 4));
+        out[o++] = uchar((values[i + 1] << 4) | (values[i + 2] >> 2));
+        out[o++] = uchar((values[i + 2] << 6) | values[i + 3]);
+    }
+    out[o] = uchar((values[20] << 2) | (values[21] >> 4));
+    return true;
+}
+
+void LedgerStore::encodeHash(const uchar *hash, char *out)
+{
+    int o = 0;
+    for (int i = 0; i < 15; i += 3) {
+        const quint32 triple = (quint32(hash[i]) << 16) | (quint32(hash[i + 1]) << 8) | hash[i + 2];
+        out[o++] = BASE64_ALPHABET[(triple >> 18) & 0x3F];
+        out[o++] = BASE64_ALPHABET[(triple >> 12) & 0x3F];
+        out[o++] = BASE64_ALPHABET[(triple >> 6) & 0x3F];
+        out[o++] = BASE64_ALPHABET[triple & 0x3F];
+    }
+    out[o++] = BASE64_ALPHABET[hash[15] >> 2];
+    out[o++] = BASE64_ALPHABET[(hash[15] & 0x03) << 4];
+    out[o++] = '=';
+    out[o++] = '=';
+}
@@ -0,0 +1,146 @@
+#ifndef LEDGERSTORE_H
+#define LEDGERSTORE_H
+
+#include "invoicerecord.h"
+#include "ledgerformat.h"
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QtGlobal>
+#include <QtEndian>
+#include <memory>
+#include <vector>
+
+class MappedFile;
+
+// Компактное хранилище записей накладных в виде набора столбцов (struct-of-arrays).
+// Артикул хранится как целое число, хеш - как 16 байт дайджеста без base64, признак валидности -
+// как битовая карта. Запись занимает 36 байт без отдельных выделений памяти, а проход по одному
+// полю (например, проверка цепочки хешей) читает память последовательно.
+class LedgerStore
+{
+public:
+    static const int HASH_SIZE = 16;      // Размер хеша цепочки в байтах
+    static const int ARTICLE_DIGITS = 10; // Количество цифр в артикуле
+
+    // Алгоритм хеширования цепочки. Значения записываются в файлы, менять их нельзя.
+    // Для SHA-256 и BLAKE2s хранятся первые HASH_SIZE байт дайджеста
+    enum HashAlgorithm {
+        HashMd5 = 0,        // Исходный формат
+        HashSha256 = 1,
+        HashBlake2s = 2,
+        HashAlgorithmCount
+    };
+
+    LedgerStore();
+
+    // Алгоритм цепочки хешей записей хранилища (по умолчанию MD5)
+    HashAlgorithm hashAlgorithm() const { return algorithm; }
+    void setHashAlgorithm(HashAlgorithm hashAlgorithm) { algorithm = hashAlgorithm; }
+    // Имя алгоритма для файлов и командной строки: md5, sha256, blake2s
+    static QString hashAlgorithmName(HashAlgorithm hashAlgorithm);
+    // Разбор имени алгоритма (без учёта регистра); false - если имя неизвестно
+    static bool parseHashAlgorithm(const QString &name, HashAlgorithm &hashAlgorithm);
+
+    qsizetype size() const { return mappedRecords ? mappedCount : static_cast<qsizetype>(timestamps.size()); }
+    bool isEmpty() const { return size() == 0; }
+    void clear();
+    void reserve(qsizetype count);
+    void swap(LedgerStore &other);
+
+    // Добавление записи; hashText - хеш в исходном текстовом виде (base64)
+    void append(quint64 article, qint32 quantity, qint64 timestamp, const char *hashText, qsizetype hashLength);
+    // Добавление записи из структуры InvoiceRecord (артикул должен состоять из 10 цифр)
+    void append(const InvoiceRecord &record);
+    // Добавление всех записей другого хранилища (вместе с признаками валидности).
+    // Пустое хранилище перенимает алгоритм цепочки другого
+    void append(const LedgerStore &other);
+
+    // Подключение count записей двоичного формата, расположенных в отображении file начиная с records;
+    // irregularHashText - исходный текст нестандартных хешей по номерам записей.
+    // Отображение остаётся открытым, пока на него ссылается хранилище; все записи считаются валидными.
+    // Алгоритм цепочки сохраняется
+    void attachMapped(std::shared_ptr<const MappedFile> file, const uchar *records, qsizetype count,
+                      const QHash<qsizetype, QString> &irregularHashText = QHash<qsizetype, QString>());
+    // Записи читаются из отображения файла (добавление записей копирует их в память)
+    bool isMapped() const { return mappedRecords != nullptr; }
+
+    quint64 article(qsizetype index) const
+    {
+        return mappedRecords ? qFromLittleEndian<quint64>(mappedRecord(index) + LedgerFormat::ARTICLE_OFFSET)
+                             : articles[index];
+    }
+    qint32 quantity(qsizetype index) const
+    {
+        return mappedRecords ? qFromLittleEndian<qint32>(mappedRecord(index) + LedgerFormat::QUANTITY_OFFSET)
+                             : quantities[index];
+    }
+    qint64 timestamp(qsizetype index) const
+    {
+        return mappedRecords ? qFromLittleEndian<qint64>(mappedRecord(index) + LedgerFormat::TIMESTAMP_OFFSET)
+                             : timestamps[index];
+    }
+    // Хеш записи (16 байт). Для нестандартного текста хеша (не base64 от 16 байт) содержит нули
+    const uchar *hash(qsizetype index) const
+    {
+        return mappedRecords ? mappedRecord(index) + LedgerFormat::HASH_OFFSET : hashes.data() + index * HASH_SIZE;
+    }
+    // Признак того, что текст хеша - каноническая запись base64 ровно 16 байт
+    bool hasCanonicalHash(qsizetype index) const
+    {
+        if (mappedRecords) {
+            return !(qFromLittleEndian<quint32>(mappedRecord(index) + LedgerFormat::FLAGS_OFFSET)
+                     & LedgerFormat::FLAG_IRREGULAR_HASH);
+        }
+        return !testBit(irregularBits, index);
+    }
+
+    // Представление полей для отображения
+    QString articleText(qsizetype index) const;
+    QString hashText(qsizetype index) const;
+    // Сборка записи целиком (для совместимости с кодом, работающим с InvoiceRecord)
+    InvoiceRecord record(qsizetype index) const;
+
+    bool isValid(qsizetype index) const { return testBit(validBits, index); }
+    void setValid(qsizetype index, bool valid);
+    // Все записи валидны
+    void setAllValid();
+    // Записи начиная с first (и все последующие) невалидны, предшествующие - валидны
+    void markInvalidFrom(qsizetype first);
+
+    // Объём памяти, занимаемый данными хранилища (байт)
+    qint64 memoryUsage() const;
+
+    // Форматирование артикула в 10 цифр с ведущими нулями; out должен вмещать ARTICLE_DIGITS байт
+    static void formatArticle(quint64 article, char *out);
+    // Разбор хеша base64; возвращает true, если текст - каноническая запись base64 ровно 16 байт
+    static bool decodeHash(const char *text, qsizetype length, uchar *out);
+    // Кодирование 16 байт хеша в base64 (24 символа); out должен вмещать 24 байта
+    static void encodeHash(const uchar *hash, char *out);
+
+private:
+    static bool testBit(const std::vector<quint64> &bits, qsizetype index)
+    {
+        return (bits[static_cast<size_t>(index) >> 6] >> (index & 63)) & 1u;
+    }
+    static void assignBit(std::vector<quint64> &bits, qsizetype index, bool value);
+    const uchar *mappedRecord(qsizetype index) const { return mappedRecords + index * LedgerFormat::RECORD_SIZE; }
+    // Копирование записей из отображения в столбцы перед изменением набора записей
+    void detach();
+
+    std::vector<quint64> articles;
+    std::vector<qint32> quantities;
+    std::vector<qint64> timestamps;
+    std::vector<uchar> hashes;              // HASH_SIZE байт на запись
+    std::vector<quint64> validBits;         // Битовая карта валидности
+    std::vector<quint64> irregularBits;     // Битовая карта нестандартных хешей
+    QHash<qsizetype, QString> irregularHashes; // Исходный текст нестандартных хешей
+
+    std::shared_ptr<const MappedFile> mappedFile;  // Отображение двоичного файла
+    const uchar *mappedRecords;                    // Первая запись в отображении или nullptr
+    qsizetype mappedCount;
+
+    HashAlgorithm algorithm;
+};
+
+#endif
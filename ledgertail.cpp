@@ -0,0 +1,197 @@
+#include "ledgertail.h"
+#include "invoiceparser.h"
+#include "hashchainverifier.h"
+#include "ledgerlog.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <cstring>
+
+LedgerTail::LedgerTail(QObject *parent)
+    : QObject(parent)
+    , watcher(new QFileSystemWatcher(this))
+    , settleTimer(new QTimer(this))
+    , pollTimer(new QTimer(this))
+    , active(false)
+    , recordsEnd(0)
+    , observedSize(0)
+    , nextElement(0)
+    , recordCount(0)
+    , hasLastHash(false)
+    , chainBroken(false)
+    , firstInvalid(-1)
+    , hashAlgorithm(LedgerStore::HashMd5)
+{
+    settleTimer->setSingleShot(true);
+    settleTimer->setInterval(SETTLE_DELAY_MS);
+    pollTimer->setInterval(POLL_INTERVAL_MS);
+
+    connect(watcher, &QFileSystemWatcher::fileChanged, this, &LedgerTail::onFileChanged);
+    connect(settleTimer, &QTimer::timeout, this, &LedgerTail::readAppended);
+    connect(pollTimer, &QTimer::timeout, this, &LedgerTail::onFileChanged);
+}
+
+bool LedgerTail::start(const QString &filePath, qint64 recordsEndOffset, const LedgerStore &records)
+{
+    stop();
+
+    QFile file(filePath);
+    if (recordsEndOffset < 0 || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const qint64 checkSize = qMin<qint64>(TAIL_CHECK_SIZE, recordsEndOffset);
+    if (!file.seek(recordsEndOffset - checkSize)) {
+        return false;
+    }
+
+    path = filePath;
+    recordsEnd = recordsEndOffset;
+    tailCheck = file.read(checkSize);
+    observedSize = -1;
+    nextElement = records.size();
+    recordCount = records.size();
+    hashAlgorithm = records.hashAlgorithm();
+    appended.clear();
+
+    // Цепочка продолжается от сохранённого хеша последней записи; если она уже нарушена,
+    // все дописанные записи невалидны
+    firstInvalid = -1;
+    hasLastHash = !records.isEmpty();
+    chainBroken = hasLastHash && !records.isValid(records.size() - 1);
+    if (hasLastHash) {
+        std::memcpy(lastHash, records.hash(records.size() - 1), LedgerStore::HASH_SIZE);
+    }
+
+    watcher->addPath(path);
+    pollTimer->start();
+    active = true;
+    qCDebug(lcTail) << "LedgerTail::start: Слежение за файлом:" << path << "с позиции" << recordsEnd;
+
+    // Записи могли быть дописаны, пока шла загрузка
+    settleTimer->start();
+    return true;
+}
+
+void LedgerTail::stop()
+{
+    if (!active) {
+        return;
+    }
+    active = false;
+    settleTimer->stop();
+    pollTimer->stop();
+    if (!watcher->files().isEmpty()) {
+        watcher->removePaths(watcher->files());
+    }
+    qCDebug(lcTail) << "LedgerTail::stop: Слежение за файлом остановлено:" << path;
+}
+
+LedgerStore LedgerTail::takeRecords()
+{
+    LedgerStore result;
+    result.swap(appended);
+    return result;
+}
+
+void LedgerTail::onFileChanged()
+{
+    if (!active) {
+        return;
+    }
+    // При атомарной замене файла путь пропадает из наблюдения: возвращаем его
+    if (watcher->files().isEmpty() && QFile::exists(path)) {
+        watcher->addPath(path);
+    }
+    if (!settleTimer->isActive() && QFileInfo(path).size() != observedSize) {
+        settleTimer->start();
+    }
+}
+
+void LedgerTail::readAppended()
+{
+    if (!active) {
+        return;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        // Файл может временно отсутствовать при замене; проверим при следующем изменении
+        return;
+    }
+
+    // Перезапись обнаруживается по размеру и по байтам перед последней загруженной записью
+    const qint64 size = file.size();
+    observedSize = size;
+    if (size < recordsEnd || !file.seek(recordsEnd - tailCheck.size()) || file.read(tailCheck.size()) != tailCheck) {
+        qCDebug(lcTail) << "LedgerTail::readAppended: Файл перезаписан:" << path;
+        stop();
+        emit fileReplaced();
+        return;
+    }
+    if (size == recordsEnd) {
+        return;
+    }
+
+    const QByteArray data = file.read(qMin<qint64>(size - recordsEnd, READ_LIMIT));
+
+    // Разбор продолжается с позиции после последней записи; незавершённая запись в конце
+    // не разбирается и будет прочитана заново, когда её допишут
+    LedgerStore batch;
+    batch.setHashAlgorithm(hashAlgorithm);
+    InvoiceParser parser(batch);
+    parser.resumeAfterElement(recordsEnd, nextElement);
+    if (!parser.feed(data)) {
+        const QString message = QString("Ошибка парсинга дописанных данных: %1 (позиция %2)")
+                                    .arg(parser.errorString()).arg(parser.errorOffset());
+        qCDebug(lcTail) << "LedgerTail::readAppended:" << message;
+        stop();
+        emit failed(message);
+        return;
+    }
+
+    const qint64 parsedEnd = parser.elementEndOffset();
+    const bool truncatedRead = recordsEnd + data.size() < size;
+    if (parsedEnd == recordsEnd) {
+        if (truncatedRead) {
+            const QString message = QString("Запись в позиции %1 превышает %2 байт").arg(recordsEnd).arg(READ_LIMIT);
+            stop();
+            emit failed(message);
+        }
+        return;
+    }
+
+    tailCheck = (tailCheck + data.left(int(parsedEnd - recordsEnd))).right(TAIL_CHECK_SIZE);
+    recordsEnd = parsedEnd;
+    nextElement += parser.acceptedCount() + parser.rejectedCount();
+
+    const qsizetype count = batch.size();
+    if (count > 0) {
+        if (chainBroken) {
+            batch.markInvalidFrom(0);
+        } else {
+            const qsizetype mismatch = HashChainVerifier::verifyRangeParallel(batch, 0, count,
+                                                                              hasLastHash ? lastHash : nullptr);
+            batch.markInvalidFrom(mismatch);
+            if (mismatch < count) {
+                chainBroken = true;
+                firstInvalid = recordCount + mismatch;
+                qCDebug(lcTail) << "LedgerTail::readAppended: Обнаружено нарушение целостности в записи #" << (firstInvalid + 1);
+            }
+        }
+        std::memcpy(lastHash, batch.hash(count - 1), LedgerStore::HASH_SIZE);
+        hasLastHash = true;
+        recordCount += count;
+
+        const bool notify = appended.isEmpty();
+        appended.append(batch);
+        if (notify) {
+            emit recordsAppended();
+        }
+    }
+
+    // Оставшийся хвост дочитывается сразу, не дожидаясь следующего уведомления
+    if (truncatedRead) {
+        QTimer::singleShot(0, this, &LedgerTail::readAppended);
+    }
+}
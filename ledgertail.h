@@ -0,0 +1,75 @@
+#ifndef LEDGERTAIL_H
+#define LEDGERTAIL_H
+
+#include "ledgerstore.h"
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+
+class QFileSystemWatcher;
+class QTimer;
+
+// Слежение за дописываемым файлом накладных (JSON без шифрования).
+// После полной загрузки файла читаются только байты после последней загруженной записи:
+// новые записи разбираются, цепочка хешей продолжается от хеша последней записи,
+// а результат передаётся интерфейсу пачкой. Изменения файла отслеживаются QFileSystemWatcher,
+// а на случай, когда уведомления не приходят (сетевые диски), размер файла дополнительно
+// проверяется по таймеру. Усечение файла или изменение байтов перед последней загруженной
+// записью означает, что файл перезаписан, и сообщается сигналом fileReplaced.
+class LedgerTail : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LedgerTail(QObject *parent = nullptr);
+
+    // Начало слежения. recordsEnd - смещение в файле сразу после последней загруженной записи
+    // (LedgerLoader::recordsEndOffset()), records - загруженные записи: от последней из них
+    // продолжается цепочка хешей их алгоритмом. Возвращает false, если файл не удалось открыть
+    bool start(const QString &filePath, qint64 recordsEnd, const LedgerStore &records);
+    void stop();
+    bool isActive() const { return active; }
+
+    // Смещение в файле после последней прочитанной записи
+    qint64 recordsEndOffset() const { return recordsEnd; }
+    // Забирает записи, дописанные с прошлого вызова (уже проверенные)
+    LedgerStore takeRecords();
+    // Индекс (от начала файла) первой дописанной записи с нарушенной цепочкой или -1
+    qsizetype firstInvalidIndex() const { return firstInvalid; }
+
+    static const int SETTLE_DELAY_MS = 20;      // Объединение серии уведомлений об изменении
+    static const int POLL_INTERVAL_MS = 500;    // Проверка размера без уведомлений
+    static const int READ_LIMIT = 8 << 20;      // Байт за одно чтение: крупный хвост читается по частям
+    static const int TAIL_CHECK_SIZE = 64;      // Байт перед последней записью для обнаружения перезаписи
+
+signals:
+    void recordsAppended();
+    // Файл усечён или перезаписан: дописанные записи больше не продолжают загруженные
+    void fileReplaced();
+    // Дописанные данные не разбираются; слежение остановлено
+    void failed(const QString &errorMessage);
+
+private:
+    void onFileChanged();
+    void readAppended();
+
+    QFileSystemWatcher *watcher;
+    QTimer *settleTimer;
+    QTimer *pollTimer;
+    bool active;
+
+    QString path;
+    qint64 recordsEnd;          // Смещение после последней прочитанной записи
+    qint64 observedSize;        // Размер файла при последнем чтении
+    qint64 nextElement;         // Номер следующего элемента массива (для сообщений разборщика)
+    qsizetype recordCount;      // Число записей с начала файла
+    QByteArray tailCheck;       // Байты файла перед recordsEnd
+    uchar lastHash[LedgerStore::HASH_SIZE];
+    bool hasLastHash;
+    bool chainBroken;           // Цепочка нарушена в загруженных или дописанных записях
+    qsizetype firstInvalid;
+    LedgerStore::HashAlgorithm hashAlgorithm;   // Алгоритм цепочки загруженных записей
+    LedgerStore appended;
+};
+
+#endif
@@ -0,0 +1,432 @@
+#include "ledgerwriter.h"
+#include "ledgerformat.h"
+#include "encryptionmanager.h"
+#include "invoiceparser.h"
+#include "ledgerlog.h"
+#include <QFileInfo>
+#include <QtEndian>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <io.h>
+#endif
+
+namespace {
+
+// Закрывающая часть массива JSON, которая дописывается после каждой группы
+const char JSON_CLOSING[] = "\n]\n";
+const int JSON_CLOSING_SIZE = 3;
+
+// Размер порции чтения при разборе существующего файла
+const qint64 READ_CHUNK_SIZE = 4 << 20;
+
+}
+
+LedgerWriter::LedgerWriter()
+    : encryption(nullptr)
+    , fileFormat(JsonFormat)
+    , newFileAlgorithm(LedgerStore::HashMd5)
+    , hasLastDigest(false)
+    , hasRecords(false)
+    , dataEnd(0)
+    , committedRecords(0)
+    , pendingRecords(0)
+    , maxPendingRecords(DEFAULT_COMMIT_RECORDS)
+    , maxPendingDelayMs(DEFAULT_COMMIT_DELAY_MS)
+    , syncEnabled(true)
+    , appended(0)
+    , commits(0)
+{
+}
+
+LedgerWriter::~LedgerWriter()
+{
+    QString errorMessage;
+    if (isOpen() && !close(errorMessage)) {
+        qCWarning(lcWriter) << "LedgerWriter: Не удалось зафиксировать записи при закрытии:" << errorMessage;
+    }
+}
+
+bool LedgerWriter::open(const QString &filePath, QString &errorMessage, const EncryptionManager *encryptionManager)
+{
+    if (isOpen() && !close(errorMessage)) {
+        return false;
+    }
+
+    encryption = encryptionManager;
+    hasLastDigest = false;
+    hasRecords = false;
+    dataEnd = 0;
+    committedRecords = 0;
+    pending.clear();
+    pendingRecords = 0;
+    appended = 0;
+    commits = 0;
+
+    const QFileInfo info(filePath);
+    const bool isNew = !info.exists() || info.size() == 0;
+    const QString suffix = info.suffix().toLower();
+    if (isNew) {
+        fileFormat = suffix == "ldg" ? BinaryFormat : (suffix == "enc" ? EncryptedFormat : JsonFormat);
+    } else if (LedgerFormat::isBinaryFile(filePath)) {
+        fileFormat = BinaryFormat;
+    } else {
+        switch (EncryptionManager::detectFileFormat(filePath)) {
+        case EncryptionManager::FormatV2:
+            fileFormat = EncryptedFormat;
+            break;
+        case EncryptionManager::FormatV1:
+            errorMessage = QString("Дописывание поддерживается только для зашифрованных файлов формата v2.");
+            return false;
+        default:
+            fileFormat = JsonFormat;
+            break;
+        }
+    }
+
+    if (fileFormat == EncryptedFormat && (!encryption || !encryption->isReady())) {
+        errorMessage = "Ключ шифрования не загружен. Невозможно дописать зашифрованный файл.";
+        return false;
+    }
+
+    file.setFileName(filePath);
+    if (!file.open(QIODevice::ReadWrite)) {
+        errorMessage = QString("Не удалось открыть файл: %1").arg(file.errorString());
+        return false;
+    }
+
+    bool opened = true;
+    if (isNew) {
+        hasher.setAlgorithm(newFileAlgorithm);
+        if (fileFormat == BinaryFormat) {
+            // Заголовок с нулевым числом записей: записи дописываются после него
+            uchar header[LedgerFormat::HEADER_SIZE];
+            LedgerFormat::encodeHeader(header, 0, quint32(newFileAlgorithm));
+            opened = file.write(reinterpret_cast<const char*>(header), sizeof(header)) == qint64(sizeof(header))
+                && syncFile(errorMessage);
+        } else {
+            // Массив открывается первой фиксацией
+            pending = "[";
+            if (newFileAlgorithm != LedgerStore::HashMd5) {
+                pending.append("\n");
+                LedgerFormat::appendJsonHeader(pending, LedgerStore::hashAlgorithmName(newFileAlgorithm));
+                hasRecords = true;
+            }
+        }
+    } else {
+        opened = fileFormat == BinaryFormat ? openBinaryTail(errorMessage) : openJsonTail(errorMessage);
+    }
+
+    if (!opened) {
+        if (errorMessage.isEmpty()) {
+            errorMessage = QString("Ошибка записи файла: %1").arg(file.errorString());
+        }
+        file.close();
+        return false;
+    }
+
+    qCDebug(lcWriter) << "LedgerWriter::open: Файл открыт для дописывания:" << filePath
+                      << (isNew ? "(новый)" : "") << "формат:" << int(fileFormat)
+                      << "алгоритм:" << LedgerStore::hashAlgorithmName(hasher.algorithm());
+    return true;
+}
+
+bool LedgerWriter::close(QString &errorMessage)
+{
+    if (!isOpen()) {
+        return true;
+    }
+    const bool committed = commit(errorMessage);
+    file.close();
+    return committed;
+}
+
+void LedgerWriter::setCommitPolicy(int maxRecords, int maxDelayMs)
+{
+    maxPendingRecords = qMax(1, maxRecords);
+    maxPendingDelayMs = qMax(0, maxDelayMs);
+}
+
+bool LedgerWriter::append(quint64 article, qint32 quantity, qint64 timestamp, QString &errorMessage)
+{
+    if (!isOpen()) {
+        errorMessage = QString("Файл не открыт для записи.");
+        return false;
+    }
+    // Те же правила, по которым записи принимает InvoiceParser
+    if (article == 0 || article > 9999999999ULL || quantity <= 0 || timestamp <= 0) {
+        errorMessage = QString("Некорректная запись: артикул %1, количество %2, timestamp %3")
+                           .arg(article).arg(quantity).arg(timestamp);
+        return false;
+    }
+
+    uchar digest[LedgerStore::HASH_SIZE];
+    if (!hasher.computeDigest(article, quantity, timestamp, hasLastDigest ? lastDigest : nullptr, digest)) {
+        errorMessage = QString("Ошибка вычисления хеша %1.").arg(LedgerStore::hashAlgorithmName(hasher.algorithm()));
+        return false;
+    }
+
+    if (fileFormat == BinaryFormat) {
+        uchar record[LedgerFormat::RECORD_SIZE];
+        LedgerFormat::encodeRecord(record, article, quantity, timestamp, 0, digest);
+        pending.append(reinterpret_cast<const char*>(record), sizeof(record));
+    } else {
+        char encoded[24];
+        LedgerStore::encodeHash(digest, encoded);
+        pending.append(hasRecords ? ",\n" : "\n");
+        LedgerFormat::appendJsonRecord(pending, article, quantity, timestamp,
+                                       QString::fromLatin1(encoded, sizeof(encoded)));
+        hasRecords = true;
+    }
+
+    std::memcpy(lastDigest, digest, LedgerStore::HASH_SIZE);
+    hasLastDigest = true;
+    ++appended;
+    if (++pendingRecords == 1) {
+        pendingTimer.start();
+    }
+
+    if (pendingRecords >= maxPendingRecords || pendingTimer.elapsed() >= maxPendingDelayMs) {
+        return commit(errorMessage);
+    }
+    return true;
+}
+
+bool LedgerWriter::append(const QVector<InvoiceRecord> &invoices, QString &errorMessage)
+{
+    for (const InvoiceRecord &invoice : invoices) {
+        bool ok = invoice.article.size() == LedgerStore::ARTICLE_DIGITS;
+        const quint64 article = ok ? invoice.article.toULongLong(&ok) : 0;
+        if (!ok) {
+            errorMessage = QString("Некорректный артикул: %1").arg(invoice.article);
+            return false;
+        }
+        if (!append(article, invoice.quantity, invoice.timestamp, errorMessage)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LedgerWriter::commit(QString &errorMessage)
+{
+    if (!isOpen()) {
+        errorMessage = QString("Файл не открыт для записи.");
+        return false;
+    }
+    if (pending.isEmpty()) {
+        return true;
+    }
+
+    // При ошибке состояние не меняется: повторная фиксация перезапишет тот же участок файла,
+    // а в контейнер v2 допишет кадры заново после незафиксированных
+    bool written = false;
+    switch (fileFormat) {
+    case JsonFormat: {
+        const qint64 end = dataEnd + pending.size() + JSON_CLOSING_SIZE;
+        written = file.seek(dataEnd)
+            && file.write(pending) == pending.size()
+            && file.write(JSON_CLOSING, JSON_CLOSING_SIZE) == JSON_CLOSING_SIZE
+            && (file.size() <= end || file.resize(end))
+            && syncFile(errorMessage);
+        break;
+    }
+    case EncryptedFormat:
+        // Группа шифруется своими кадрами, закрывающая скобка - отдельным последним кадром,
+        // который заменяется следующей фиксацией. Новые кадры и индекс сбрасываются на диск
+        // до записи окончания, окончание - после
+        written = encryption->appendV2(&file, dataEnd, pending, QByteArray::fromRawData(JSON_CLOSING, JSON_CLOSING_SIZE),
+                                       errorMessage, [this](QString &message) { return syncFile(message); })
+            && syncFile(errorMessage);
+        break;
+    case BinaryFormat: {
+        // Сначала записи, затем число записей в заголовке: при сбое между ними заголовок
+        // описывает прежние записи, а лишние байты после них перезапишет следующая фиксация
+        const qint64 count = committedRecords + pendingRecords;
+        const qint64 end = LedgerFormat::HEADER_SIZE + count * LedgerFormat::RECORD_SIZE;
+        uchar countField[8];
+        qToLittleEndian<quint64>(quint64(count), countField);
+        written = file.seek(LedgerFormat::HEADER_SIZE + committedRecords * LedgerFormat::RECORD_SIZE)
+            && file.write(pending) == pending.size()
+            && (file.size() <= end || file.resize(end))
+            && syncFile(errorMessage)
+            && file.seek(16)
+            && file.write(reinterpret_cast<const char*>(countField), sizeof(countField)) == qint64(sizeof(countField))
+            && syncFile(errorMessage);
+        break;
+    }
+    }
+
+    if (!written) {
+        if (errorMessage.isEmpty()) {
+            errorMessage = QString("Ошибка записи файла: %1").arg(file.errorString());
+        }
+        return false;
+    }
+
+    if (fileFormat == BinaryFormat) {
+        committedRecords += pendingRecords;
+    } else {
+        dataEnd += pending.size();
+    }
+    pending.clear();
+    pendingRecords = 0;
+    ++commits;
+    return true;
+}
+
+QString LedgerWriter::lastHash() const
+{
+    if (!hasLastDigest) {
+        return QString();
+    }
+    char encoded[24];
+    LedgerStore::encodeHash(lastDigest, encoded);
+    return QString::fromLatin1(encoded, sizeof(encoded));
+}
+
+bool LedgerWriter::openBinaryTail(QString &errorMessage)
+{
+    QByteArray header = file.read(LedgerFormat::HEADER_SIZE);
+    const uchar *data = reinterpret_cast<const uchar*>(header.constData());
+    if (header.size() != LedgerFormat::HEADER_SIZE || !LedgerFormat::hasBinaryHeader(header)
+        || qFromLittleEndian<quint32>(data + 8) != LedgerFormat::VERSION
+        || qFromLittleEndian<quint32>(data + 12) != quint32(LedgerFormat::RECORD_SIZE)) {
+        errorMessage = QString("Версия двоичного формата не поддерживается.");
+        return false;
+    }
+
+    const quint64 count = qFromLittleEndian<quint64>(data + 16);
+    if (count > quint64(file.size() - LedgerFormat::HEADER_SIZE) / LedgerFormat::RECORD_SIZE) {
+        errorMessage = QString("Двоичный файл повреждён: записей в заголовке больше, чем в файле.");
+        return false;
+    }
+    // Таблица нестандартных хешей лежит сразу после записей и была бы перезаписана
+    if (qFromLittleEndian<quint64>(data + 32) != 0) {
+        errorMessage = QString("Дописывание в двоичный файл с нестандартными хешами не поддерживается. "
+                               "Пересохраните файл в формате JSON.");
+        return false;
+    }
+    quint32 algorithm = 0;
+    if (!LedgerFormat::decodeHashAlgorithm(data, algorithm)) {
+        errorMessage = QString("Алгоритм цепочки хешей %1 не поддерживается.").arg(algorithm);
+        return false;
+    }
+    hasher.setAlgorithm(LedgerStore::HashAlgorithm(algorithm));
+
+    committedRecords = qint64(count);
+    if (count > 0) {
+        const qint64 lastRecord = LedgerFormat::HEADER_SIZE + (committedRecords - 1) * LedgerFormat::RECORD_SIZE;
+        QByteArray hash;
+        if (file.seek(lastRecord + LedgerFormat::HASH_OFFSET)) {
+            hash = file.read(LedgerStore::HASH_SIZE);
+        }
+        if (hash.size() != LedgerStore::HASH_SIZE) {
+            errorMessage = QString("Не удалось прочитать последнюю запись: %1").arg(file.errorString());
+            return false;
+        }
+        std::memcpy(lastDigest, hash.constData(), LedgerStore::HASH_SIZE);
+        hasLastDigest = true;
+    }
+    return true;
+}
+
+QByteArray LedgerWriter::readText(qint64 offset, qint64 length, QString &errorMessage)
+{
+    if (fileFormat == EncryptedFormat) {
+        return encryption->readV2Range(&file, offset, length, errorMessage);
+    }
+    if (!file.seek(offset)) {
+        errorMessage = QString("Ошибка чтения файла: %1").arg(file.errorString());
+        return QByteArray();
+    }
+    return file.read(length);
+}
+
+bool LedgerWriter::openJsonTail(QString &errorMessage)
+{
+    qint64 textSize = file.size();
+    if (fileFormat == EncryptedFormat) {
+        textSize = encryption->plainSizeV2(&file, errorMessage);
+        if (textSize < 0) {
+            return false;
+        }
+    }
+
+    // Файл разбирается целиком тем же парсером, что и при загрузке: только так конец последнего
+    // элемента определяется надёжно (вложенные значения, скобки внутри строк). Записи каждой
+    // порции отбрасываются, сохраняется лишь хеш последней принятой - затравка цепочки
+    LedgerStore records;
+    InvoiceParser parser(records);
+    qint64 arrayStart = -1;
+    for (qint64 offset = 0; offset < textSize; ) {
+        const qint64 length = qMin<qint64>(textSize - offset, READ_CHUNK_SIZE);
+        const QByteArray text = readText(offset, length, errorMessage);
+        if (text.size() != length) {
+            if (errorMessage.isEmpty()) {
+                errorMessage = QString("Ошибка чтения файла: %1").arg(file.errorString());
+            }
+            return false;
+        }
+        if (offset == 0) {
+            arrayStart = text.indexOf('[');
+        }
+        if (!parser.feed(text)) {
+            errorMessage = QString("Ошибка парсинга: %1 (позиция %2)").arg(parser.errorString()).arg(parser.errorOffset());
+            return false;
+        }
+
+        // Алгоритм из заголовка сохраняется при очистке порции
+        const LedgerStore::HashAlgorithm algorithm = records.hashAlgorithm();
+        if (!records.isEmpty()) {
+            std::memcpy(lastDigest, records.hash(records.size() - 1), LedgerStore::HASH_SIZE);
+            hasLastDigest = true;
+        }
+        records.clear();
+        records.setHashAlgorithm(algorithm);
+        offset += length;
+    }
+    hasher.setAlgorithm(records.hashAlgorithm());
+
+    // Данные после последнего элемента - закрывающая скобка или незавершённая запись прерванной
+    // фиксации; новые записи пишутся поверх них
+    const qint64 elementEnd = parser.elementEndOffset();
+    if (elementEnd >= 0) {
+        hasRecords = true;
+        dataEnd = elementEnd;
+    } else if (arrayStart >= 0) {
+        dataEnd = arrayStart + 1;
+    } else {
+        errorMessage = QString("Файл не является массивом накладных JSON.");
+        return false;
+    }
+    if (elementEnd < textSize && !parser.finish()) {
+        qCDebug(lcWriter) << "LedgerWriter::openJsonTail: Отброшена незавершённая запись с позиции" << dataEnd;
+    }
+    return true;
+}
+
+bool LedgerWriter::syncFile(QString &errorMessage)
+{
+    if (!file.flush()) {
+        errorMessage = QString("Ошибка записи файла: %1").arg(file.errorString());
+        return false;
+    }
+    if (!syncEnabled) {
+        return true;
+    }
+#ifdef Q_OS_UNIX
+    if (::fsync(file.handle()) != 0) {
+        errorMessage = QString("Не удалось сбросить данные на диск (fsync).");
+        return false;
+    }
+#elif defined(Q_OS_WIN)
+    if (::_commit(file.handle()) != 0) {
+        errorMessage = QString("Не удалось сбросить данные на диск.");
+        return false;
+    }
+#endif
+    return true;
+}
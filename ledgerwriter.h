@@ -0,0 +1,108 @@
+#ifndef LEDGERWRITER_H
+#define LEDGERWRITER_H
+
+#include "invoicerecord.h"
+#include "ledgerstore.h"
+#include "hashchainverifier.h"
+#include <QFile>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+class EncryptionManager;
+
+// Дописывание накладных в конец файла с вычислением цепочки хешей.
+// Хеш каждой новой записи вычисляется HashChainVerifier алгоритмом цепочки файла от хеша
+// последней записи, поэтому дописанный файл проходит проверку целостности.
+// Записи накапливаются в памяти и фиксируются группами: одна запись в файл и один fsync
+// на группу (в двоичном формате и контейнере v2 - два: до и после записи, делающей группу
+// действующей), размер и задержка группы задаются setCommitPolicy(). Существующая часть файла
+// не перезаписывается: в JSON заменяется только закрывающая скобка массива, в двоичном
+// формате - число записей в заголовке, а в зашифрованный контейнер v2 кадры группы, новый
+// короткий кадр с закрывающей скобкой, индекс и окончание дописываются после конца файла
+// (когда заменённые кадры и индексы занимают больше половины файла, контейнер уплотняется).
+// Класс не потокобезопасен.
+class LedgerWriter
+{
+public:
+    enum Format {
+        JsonFormat,
+        BinaryFormat,       // .ldg
+        EncryptedFormat     // Контейнер v2 с JSON внутри
+    };
+
+    LedgerWriter();
+    ~LedgerWriter();
+
+    // Открытие файла для дописывания (файл создаётся, если его нет). Формат существующего файла
+    // определяется по содержимому, нового - по расширению (.ldg, .enc, иначе JSON).
+    // Для зашифрованного файла нужен encryptionManager с загруженным ключом
+    bool open(const QString &filePath, QString &errorMessage, const EncryptionManager *encryptionManager = nullptr);
+    // Фиксация накопленных записей и закрытие файла
+    bool close(QString &errorMessage);
+    bool isOpen() const { return file.isOpen(); }
+    Format format() const { return fileFormat; }
+
+    // Алгоритм цепочки хешей для новых файлов (задаётся до open(), по умолчанию MD5).
+    // Существующий файл дописывается алгоритмом, указанным в нём самом
+    void setHashAlgorithm(LedgerStore::HashAlgorithm algorithm) { newFileAlgorithm = algorithm; }
+    // Алгоритм цепочки открытого файла
+    LedgerStore::HashAlgorithm hashAlgorithm() const { return hasher.algorithm(); }
+
+    // Группа фиксируется, как только в ней maxRecords записей или с добавления её первой записи
+    // прошло maxDelayMs (проверяется при добавлении; при простое нужно вызвать commit())
+    void setCommitPolicy(int maxRecords, int maxDelayMs);
+    // fsync после каждой фиксации (включён по умолчанию)
+    void setSyncEnabled(bool enabled) { syncEnabled = enabled; }
+
+    // Добавление записи; хеш вычисляется по цепочке
+    bool append(quint64 article, qint32 quantity, qint64 timestamp, QString &errorMessage);
+    // Добавление пачки записей (поля hash и valid не используются)
+    bool append(const QVector<InvoiceRecord> &invoices, QString &errorMessage);
+    // Немедленная фиксация накопленных записей
+    bool commit(QString &errorMessage);
+
+    qint64 appendedCount() const { return appended; }
+    qint64 pendingCount() const { return pendingRecords; }
+    qint64 commitCount() const { return commits; }
+    // Хеш последней записи файла (base64), включая ещё не зафиксированные
+    QString lastHash() const;
+
+    static const int DEFAULT_COMMIT_RECORDS = 65536;
+    static const int DEFAULT_COMMIT_DELAY_MS = 200;
+
+private:
+    Q_DISABLE_COPY(LedgerWriter)
+
+    // Поиск конца последнего элемента массива и хеша последней принятой записи в существующем файле
+    bool openJsonTail(QString &errorMessage);
+    bool openBinaryTail(QString &errorMessage);
+    // Фрагмент открытого текста JSON (для зашифрованного файла - после расшифровки) начиная с offset
+    QByteArray readText(qint64 offset, qint64 length, QString &errorMessage);
+    bool syncFile(QString &errorMessage);
+
+    QFile file;
+    const EncryptionManager *encryption;
+    Format fileFormat;
+    HashChainVerifier hasher;
+    LedgerStore::HashAlgorithm newFileAlgorithm;
+
+    uchar lastDigest[LedgerStore::HASH_SIZE];
+    bool hasLastDigest;
+    bool hasRecords;            // В массиве JSON уже есть записи (нужен разделитель)
+    qint64 dataEnd;             // JSON: смещение (в открытом тексте) после последней записи
+    qint64 committedRecords;    // Двоичный формат: число записей в заголовке
+
+    QByteArray pending;         // Сериализованные нефиксированные записи
+    qint64 pendingRecords;
+    QElapsedTimer pendingTimer;
+    int maxPendingRecords;
+    int maxPendingDelayMs;
+    bool syncEnabled;
+
+    qint64 appended;
+    qint64 commits;
+};
+
+#endif
@@ -1,7 +1,9 @@
 #include "mainwindow.h"
 #include "integritycheck.h"
+#include "integrityservice.h"
 #include <QApplication>
 #include <QMessageBox>
+#include <QDebug>
 
 int main(int argc, char *argv[])
 {
@@ -16,6 +18,24 @@ int main(int argc, char *argv[])
             "Приложение будет закрыто для защиты данных.");
         return 1;
     }
+
+    // Код проверен при запуске; дальше он перепроверяется по страницам небольшими порциями,
+    // не задерживая операции. Период обхода и таймера настраиваются переменными окружения
+    IntegrityService integrityService;
+    QObject::connect(&integrityService, &IntegrityService::violationDetected, []() {
+        QMessageBox::critical(nullptr, "Обнаружена атака",
+            "Обнаружена модификация кода приложения во время работы!\n\n"
+            "Сегмент .text в памяти не совпадает с проверенным при запуске.\n\n"
+            "Приложение будет закрыто для защиты данных.");
+        QApplication::exit(1);
+    });
+    const int coveragePeriodMs = qEnvironmentVariableIntValue("LEDGER_INTEGRITY_PERIOD_MS");
+    const int tickIntervalMs = qEnvironmentVariableIntValue("LEDGER_INTEGRITY_TICK_MS");
+    integrityService.start(coveragePeriodMs > 0 ? coveragePeriodMs : IntegrityService::DEFAULT_COVERAGE_PERIOD_MS,
+                           tickIntervalMs > 0 ? tickIntervalMs : IntegrityService::DEFAULT_TICK_INTERVAL_MS);
+    QObject::connect(&a, &QCoreApplication::aboutToQuit, [&integrityService]() {
+        qDebug().noquote() << "Проверка кода во время работы:" << integrityService.metricsReport();
+    });
 #endif
 
     MainWindow w;
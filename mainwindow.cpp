@@ -1,10 +1,29 @@
 #include "mainwindow.h"
 #include "encryptionmanager.h"
 #include "integritycheck.h"
-#include <QGridLayout>
-#include <QLabel>
+#include "invoicetablemodel.h"
+#include "invoiceitemdelegate.h"
+#include "invoiceparser.h"
+#include "hashchainverifier.h"
+#include "merkletree.h"
+#include "ledgerloader.h"
+#include "ledgertail.h"
+#include "ledgerformat.h"
+#include "processmemory.h"
+#include <QTableView>
+#include <QHeaderView>
 #include <QWidget>
 #include <QPushButton>
+#include <QProgressBar>
+#include <QLabel>
+#include <QLineEdit>
+#include <QCheckBox>
+#include <QDateTimeEdit>
+#include <QRegularExpressionValidator>
+#include <QSignalBlocker>
+#include <QElapsedTimer>
+#include <QStatusBar>
+#include <QScrollBar>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 #include <QDebug>
@@ -12,17 +31,31 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QCoreApplication>
-#include <QJsonDocument>
-#include <QJsonArray>
-#include <QJsonObject>
-#include <QDateTime>
 #include <QMessageBox>
 #include <QFileDialog>
-#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QSaveFile>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
+    , tableView(nullptr)
+    , tableModel(nullptr)
+    , saveButton(nullptr)
+    , cancelButton(nullptr)
+    , followButton(nullptr)
+    , progressBar(nullptr)
+    , articleFilterEdit(nullptr)
+    , fromFilterCheck(nullptr)
+    , fromFilterEdit(nullptr)
+    , toFilterCheck(nullptr)
+    , toFilterEdit(nullptr)
+    , resetFilterButton(nullptr)
+    , filterLabel(nullptr)
+    , recordsReplaced(false)
+    , currentRecordsEnd(-1)
     , encryptionManager(nullptr)
+    , loader(nullptr)
+    , tail(nullptr)
 {
     setWindowTitle("211_331_Kuznetsov — Товарные накладные");
     setMinimumSize(800, 600);
@@ -54,12 +87,37 @@ MainWindow::MainWindow(QWidget *parent)
         qDebug() << "MainWindow::MainWindow: Ключ шифрования успешно загружен из:" << keyPath;
     }
     
+    loader = new LedgerLoader(this);
+    connect(loader, &LedgerLoader::batchesReady, this, &MainWindow::onLoaderBatchesReady);
+    connect(loader, &LedgerLoader::progressChanged, this, &MainWindow::onLoaderProgress);
+    connect(loader, &LedgerLoader::finished, this, &MainWindow::onLoaderFinished);
+    
+    tail = new LedgerTail(this);
+    connect(tail, &LedgerTail::recordsAppended, this, &MainWindow::onTailRecordsAppended);
+    connect(tail, &LedgerTail::fileReplaced, this, [this]() {
+        // Дописанные записи не продолжают загруженные: файл загружается заново
+        openLedger(currentFilePath);
+    });
+    connect(tail, &LedgerTail::failed, this, [this](const QString &errorMessage) {
+        followButton->setChecked(false);
+        QMessageBox::warning(this, "Ошибка слежения за файлом",
+                            "Не удалось прочитать дописанные записи.\n\n"
+                            "Файл: " + currentFilePath + "\n\n"
+                            "Ошибка: " + errorMessage);
+    });
+    
     setupUI();
     loadDataFromFile();
 }
 
 MainWindow::~MainWindow()
 {
+    // Рабочий поток загрузчика использует менеджер шифрования, поэтому дожидаемся его завершения
+    if (loader) {
+        loader->cancel();
+        loader->wait();
+    }
+    
     if (encryptionManager) {
         delete encryptionManager;
         encryptionManager = nullptr;
@@ -80,37 +138,97 @@ void MainWindow::setupUI()
     openButton->setMinimumWidth(100);
     connect(openButton, &QPushButton::clicked, this, &MainWindow::onOpenButtonClicked);
     buttonLayout->addWidget(openButton);
+    
+    saveButton = new QPushButton("Сохранить как", centralWidget);
+    saveButton->setMinimumWidth(100);
+    connect(saveButton, &QPushButton::clicked, this, &MainWindow::onSaveButtonClicked);
+    buttonLayout->addWidget(saveButton);
+    
+    followButton = new QPushButton("Следить за файлом", centralWidget);
+    followButton->setCheckable(true);
+    followButton->setToolTip("Показывать записи, дописываемые в открытый файл JSON (без шифрования)");
+    connect(followButton, &QPushButton::toggled, this, &MainWindow::onFollowToggled);
+    buttonLayout->addWidget(followButton);
+    
+    progressBar = new QProgressBar(centralWidget);
+    progressBar->setRange(0, 100);
+    progressBar->setVisible(false);
+    buttonLayout->addWidget(progressBar, 1);
+    
+    cancelButton = new QPushButton("Отмена", centralWidget);
+    cancelButton->setVisible(false);
+    connect(cancelButton, &QPushButton::clicked, loader, &LedgerLoader::cancel);
+    buttonLayout->addWidget(cancelButton);
     buttonLayout->addStretch();
     mainLayout->addLayout(buttonLayout);
     
-    gridWidget = new QWidget(centralWidget);
-    gridLayout = new QGridLayout(gridWidget);
-    gridLayout->setSpacing(5);
-    gridLayout->setContentsMargins(0, 0, 0, 0);
-    
-    QLabel *articleHeader = new QLabel("Артикул", gridWidget);
-    QLabel *quantityHeader = new QLabel("Количество", gridWidget);
-    QLabel *dateHeader = new QLabel("Дата отгрузки", gridWidget);
-    QLabel *hashHeader = new QLabel("Хеш", gridWidget);
-    
-    articleHeader->setStyleSheet("font-weight: bold; font-size: 12pt; padding: 5px;");
-    quantityHeader->setStyleSheet("font-weight: bold; font-size: 12pt; padding: 5px;");
-    dateHeader->setStyleSheet("font-weight: bold; font-size: 12pt; padding: 5px;");
-    hashHeader->setStyleSheet("font-weight: bold; font-size: 12pt; padding: 5px;");
-    
-    gridLayout->addWidget(articleHeader, 0, 0);
-    gridLayout->addWidget(quantityHeader, 0, 1);
-    gridLayout->addWidget(dateHeader, 0, 2);
-    gridLayout->addWidget(hashHeader, 0, 3);
-    
-    gridLayout->setColumnStretch(0, 1);
-    gridLayout->setColumnStretch(1, 1);
-    gridLayout->setColumnStretch(2, 2);
-    gridLayout->setColumnStretch(3, 3);
-    
-    mainLayout->addWidget(gridWidget, 1);
-    
-    qDebug() << "MainWindow::setupUI: Интерфейс с QGridLayout успешно настроен";
+    // Строка поиска: строки находятся по индексам, записи не копируются и не просматриваются целиком
+    QHBoxLayout *filterLayout = new QHBoxLayout();
+    filterLayout->addWidget(new QLabel("Артикул:", centralWidget));
+    articleFilterEdit = new QLineEdit(centralWidget);
+    articleFilterEdit->setPlaceholderText("10 цифр");
+    articleFilterEdit->setClearButtonEnabled(true);
+    articleFilterEdit->setValidator(new QRegularExpressionValidator(QRegularExpression("\\d{0,10}"), articleFilterEdit));
+    articleFilterEdit->setMaximumWidth(160);
+    connect(articleFilterEdit, &QLineEdit::textChanged, this, &MainWindow::onFilterChanged);
+    filterLayout->addWidget(articleFilterEdit);
+    
+    fromFilterCheck = new QCheckBox("с", centralWidget);
+    connect(fromFilterCheck, &QCheckBox::toggled, this, &MainWindow::onFilterChanged);
+    filterLayout->addWidget(fromFilterCheck);
+    fromFilterEdit = new QDateTimeEdit(centralWidget);
+    fromFilterEdit->setDisplayFormat("dd.MM.yyyy hh:mm:ss");
+    fromFilterEdit->setCalendarPopup(true);
+    fromFilterEdit->setEnabled(false);
+    connect(fromFilterEdit, &QDateTimeEdit::dateTimeChanged, this, &MainWindow::onFilterChanged);
+    filterLayout->addWidget(fromFilterEdit);
+    
+    toFilterCheck = new QCheckBox("по", centralWidget);
+    connect(toFilterCheck, &QCheckBox::toggled, this, &MainWindow::onFilterChanged);
+    filterLayout->addWidget(toFilterCheck);
+    toFilterEdit = new QDateTimeEdit(centralWidget);
+    toFilterEdit->setDisplayFormat("dd.MM.yyyy hh:mm:ss");
+    toFilterEdit->setCalendarPopup(true);
+    toFilterEdit->setEnabled(false);
+    connect(toFilterEdit, &QDateTimeEdit::dateTimeChanged, this, &MainWindow::onFilterChanged);
+    filterLayout->addWidget(toFilterEdit);
+    
+    resetFilterButton = new QPushButton("Сбросить", centralWidget);
+    connect(resetFilterButton, &QPushButton::clicked, this, &MainWindow::onResetFilterClicked);
+    filterLayout->addWidget(resetFilterButton);
+    filterLabel = new QLabel(centralWidget);
+    filterLayout->addWidget(filterLabel);
+    filterLayout->addStretch();
+    mainLayout->addLayout(filterLayout);
+    
+    tableModel = new InvoiceTableModel(this);
+    tableModel->setRecords(&records);
+    
+    tableView = new QTableView(centralWidget);
+    tableView->setModel(tableModel);
+    tableView->setItemDelegate(new InvoiceItemDelegate(tableView));
+    tableView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    tableView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    tableView->setWordWrap(false);
+    tableView->verticalHeader()->setVisible(false);
+    // Фиксированная высота строк: представлению не нужно опрашивать модель
+    // по каждой строке для вычисления геометрии прокрутки
+    tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    tableView->verticalHeader()->setDefaultSectionSize(tableView->fontMetrics().height() + 10);
+    tableView->horizontalHeader()->setStyleSheet("QHeaderView::section { font-weight: bold; font-size: 12pt; padding: 5px; }");
+    tableView->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    
+    mainLayout->addWidget(tableView, 1);
+    
+    statsLabel = new QLabel(this);
+    statusBar()->addWidget(statsLabel, 1);
+    exportStatsButton = new QPushButton("Экспорт статистики", this);
+    exportStatsButton->setToolTip("Сохранить статистику последней загрузки в файл JSON");
+    exportStatsButton->setEnabled(false);
+    connect(exportStatsButton, &QPushButton::clicked, this, &MainWindow::onExportStatsClicked);
+    statusBar()->addPermanentWidget(exportStatsButton);
+    
+    qDebug() << "MainWindow::setupUI: Интерфейс с QTableView успешно настроен";
 }
 
 QString MainWindow::getDataFilePath()
@@ -137,270 +255,469 @@ QString MainWindow::getDataFilePath()
     return fallback;
 }
 
-bool MainWindow::isEncryptedFile(const QString &filePath) const
-{
-    QFileInfo fileInfo(filePath);
-    QString suffix = fileInfo.suffix().toLower();
-    return suffix == "enc";
-}
-
-QByteArray MainWindow::loadAndDecryptFile(const QString &filePath, QString &errorMessage)
+bool MainWindow::openLedger(const QString &filePath)
 {
 #ifndef _DEBUG
-    if (!IntegrityCheck::verifyTextSegment()) {
-        errorMessage = "Обнаружена модификация исполняемого файла. Операция заблокирована.";
-        return QByteArray();
+    if (!IntegrityCheck::isIntact()) {
+        QMessageBox::warning(this, "Ошибка загрузки",
+                            "Не удалось загрузить данные из файла.\n\n"
+                            "Файл: " + filePath + "\n\n"
+                            "Ошибка: Обнаружена модификация исполняемого файла. Операция заблокирована.");
+        return false;
     }
 #endif
     
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        errorMessage = QString("Не удалось открыть файл: %1").arg(file.errorString());
-        return QByteArray();
+    if (!loader->start(filePath, encryptionManager)) {
+        qDebug() << "MainWindow::openLedger: Предыдущая загрузка ещё выполняется";
+        return false;
     }
     
-    QByteArray data = file.readAll();
-    file.close();
+    tail->stop();
+    recordsReplaced = false;
+    setLoadingState(true);
+    qDebug() << "MainWindow::openLedger: Начата фоновая загрузка файла:" << filePath;
+    return true;
+}
+
+void MainWindow::onLoaderBatchesReady()
+{
+    QList<LedgerStore> batches = loader->takeBatches();
     
-    if (isEncryptedFile(filePath)) {
-        qDebug() << "MainWindow::loadAndDecryptFile: Обнаружен зашифрованный файл:" << filePath;
-        
-        if (!encryptionManager || !encryptionManager->isReady()) {
-            errorMessage = "Ключ шифрования не загружен. Невозможно расшифровать файл.";
-            return QByteArray();
+    for (LedgerStore &batch : batches) {
+        if (batch.isEmpty()) {
+            continue;
         }
         
-        QString decryptError;
-        QByteArray decryptedData = encryptionManager->decrypt(data, decryptError);
-        
-        if (decryptedData.isEmpty()) {
-            errorMessage = QString("Ошибка расшифровки: %1").arg(decryptError);
-            return QByteArray();
+        if (!recordsReplaced) {
+            // Первая пачка заменяет текущие записи; прежние сохраняются до конца загрузки,
+            // чтобы вернуть их при ошибке или отмене
+            tableModel->beginReplaceRecords();
+            previousRecords.swap(records);
+            records.swap(batch);
+            previousIndex.swap(recordIndex);
+            recordIndex.append(records);
+            updateFilterRows();
+            tableModel->endReplaceRecords();
+            tableView->scrollToTop();
+            recordsReplaced = true;
+        } else {
+            appendRecords(batch);
         }
-        
-        qDebug() << "MainWindow::loadAndDecryptFile: Файл успешно расшифрован, размер данных:" << decryptedData.size();
-        return decryptedData;
-    } else {
-        qDebug() << "MainWindow::loadAndDecryptFile: Файл не зашифрован, загружаем как обычный JSON";
-        return data;
     }
 }
 
-void MainWindow::loadDataFromFile()
+void MainWindow::onLoaderProgress(qint64 processedBytes, qint64 totalBytes)
 {
-#ifndef _DEBUG
-    if (!IntegrityCheck::verifyTextSegment()) {
-        QMessageBox::critical(this, "Обнаружена атака",
-                            "Обнаружена модификация исполняемого файла!\n\n"
-                            "Загрузка данных заблокирована.");
+    progressBar->setValue(totalBytes > 0 ? static_cast<int>(processedBytes * 100 / totalBytes) : 100);
+}
+
+void MainWindow::onLoaderFinished(bool success)
+{
+    onLoaderBatchesReady();
+    setLoadingState(false);
+    
+    if (!loader->wasCancelled()) {
+        updateLoadStatistics();
+    }
+    
+    const QString filePath = loader->filePath();
+    QString errorMessage = loader->errorMessage();
+    bool parseError = loader->isParseError();
+    
+    // Пустые пачки не публикуются, поэтому без записей в файле прежние записи не заменены
+    // и остаются в records: такая загрузка - ошибка, а не успех с записями прежнего файла
+    if (success && !recordsReplaced) {
+        success = false;
+        parseError = true;
+        errorMessage = "Файл не содержит ни одной корректной записи.";
+    }
+    
+    if (!success) {
+        if (recordsReplaced) {
+            tableModel->beginReplaceRecords();
+            records.swap(previousRecords);
+            recordIndex.swap(previousIndex);
+            updateFilterRows();
+            tableModel->endReplaceRecords();
+        }
+        previousRecords.clear();
+        previousIndex.clear();
+        recordsReplaced = false;
+        
+        // Прежние записи восстановлены: слежение за прежним файлом продолжается. Если не удалось
+        // заново загрузить сам этот файл (после его перезаписи), слежение выключается, иначе
+        // перезагрузка повторялась бы снова и снова
+        if (filePath != currentFilePath) {
+            startFollowing();
+        } else {
+            followButton->setChecked(false);
+        }
+        
+        if (loader->wasCancelled()) {
+            qDebug() << "MainWindow::onLoaderFinished: Загрузка отменена, восстановлены прежние записи";
+        } else if (parseError) {
+            QMessageBox::warning(this, "Ошибка парсинга",
+                                "Не удалось распарсить данные из файла.\n\n"
+                                "Файл: " + filePath + "\n\n"
+                                "Ошибка: " + errorMessage);
+        } else {
+            QMessageBox::warning(this, "Ошибка загрузки",
+                                "Не удалось загрузить данные из файла.\n\n"
+                                "Файл: " + filePath + "\n\n"
+                                "Ошибка: " + errorMessage);
+        }
         return;
     }
-#endif
     
-    QString filePath = getDataFilePath();
-    qDebug() << "MainWindow::loadDataFromFile: Попытка загрузить данные из файла:" << filePath;
-    qDebug() << "MainWindow::loadDataFromFile: Файл существует:" << QFile::exists(filePath);
+    previousRecords.clear();
+    previousIndex.clear();
+    recordsReplaced = false;
+    currentFilePath = filePath;
+    currentRecordsEnd = loader->recordsEndOffset();
     
-    if (!QFile::exists(filePath)) {
-        QMessageBox::warning(this, "Файл не найден",
-                            "Не удалось найти файл с данными.\n\n"
-                            "Ожидаемый путь: " + filePath + "\n\n"
-                            "Убедитесь, что файл data/invoices_valid.json существует.");
+    qDebug() << "MainWindow::onLoaderFinished: Успешно загружено записей:" << records.size()
+             << "отброшено:" << loader->rejectedCount()
+             << "память хранилища (байт):" << records.memoryUsage();
+    
+    if (loader->firstInvalidIndex() >= 0) {
+        reportChainBreak(loader->firstInvalidIndex());
+    }
+    verifyMerkleTree(filePath);
+    updateFilterDateRange();
+    displayRecords();
+    startFollowing();
+}
+
+void MainWindow::updateLoadStatistics()
+{
+    lastLoadStats = loader->statsJson();
+    lastLoadStats["storeMemoryBytes"] = qint64(records.memoryUsage());
+    lastLoadStats["indexMemoryBytes"] = recordIndex.memoryUsage();
+    exportStatsButton->setEnabled(true);
+    
+    QStringList parts;
+    QString recordsText = QString("Записей: %1").arg(loader->recordCount());
+    if (loader->cachedRecordCount() > 0) {
+        recordsText += QString(" (по кэшу: %1)").arg(loader->cachedRecordCount());
+    }
+    parts << recordsText + QString(", отброшено: %1").arg(loader->rejectedCount());
+    
+    QStringList stageTimes;
+    for (int i = 0; i < LedgerLoader::StageCount; ++i) {
+        const LedgerLoader::Stage stage = LedgerLoader::Stage(i);
+        const LedgerLoader::StageStats stats = loader->stageStats(stage);
+        if (stats.used) {
+            stageTimes << QString("%1 %2 с").arg(LedgerLoader::stageName(stage)).arg(stats.busyNs() / 1e9, 0, 'f', 2);
+        }
+    }
+    if (!stageTimes.isEmpty()) {
+        parts << stageTimes.join(", ");
+    }
+    parts << QString("всего %1 с").arg(loader->elapsedNs() / 1e9, 0, 'f', 2);
+    parts << QString("пик памяти %1 МиБ").arg(double(loader->peakMemoryBytes()) / (1 << 20), 0, 'f', 1);
+    statsLabel->setText(parts.join("  |  "));
+    
+    // Причины отбрасывания записей - во всплывающей подсказке, чтобы не перегружать строку состояния
+    QStringList reasons;
+    for (int i = 0; i < InvoiceParser::RejectReasonCount; ++i) {
+        const InvoiceParser::RejectReason reason = InvoiceParser::RejectReason(i);
+        if (loader->rejectedCount(reason) > 0) {
+            reasons << QString("%1: %2").arg(InvoiceParser::rejectReasonName(reason)).arg(loader->rejectedCount(reason));
+        }
+    }
+    statsLabel->setToolTip(reasons.isEmpty() ? QString("Отброшенных записей нет")
+                                             : "Отброшено записей:\n" + reasons.join('\n'));
+}
+
+void MainWindow::onExportStatsClicked()
+{
+    if (lastLoadStats.isEmpty()) {
         return;
     }
     
-    QString errorMessage;
-    QByteArray data = loadAndDecryptFile(filePath, errorMessage);
+    QString initialDir = currentFilePath.isEmpty() ? QDir::homePath() : QFileInfo(currentFilePath).absolutePath();
+    QString targetPath = QFileDialog::getSaveFileName(
+        this,
+        "Экспорт статистики загрузки",
+        QDir(initialDir).filePath("load_stats.json"),
+        "JSON файлы (*.json)"
+    );
     
-    if (data.isEmpty()) {
-        QMessageBox::warning(this, "Ошибка загрузки",
-                            "Не удалось загрузить данные из файла.\n\n"
-                            "Файл: " + filePath + "\n\n"
-                            "Ошибка: " + errorMessage);
+    if (targetPath.isEmpty()) {
         return;
     }
     
-    if (!parseJsonData(data)) {
-        QMessageBox::warning(this, "Ошибка парсинга",
-                            "Не удалось распарсить данные из файла.\n\n"
-                            "Файл: " + filePath + "\n\n"
-                            "Проверьте, что файл имеет правильный формат JSON.");
+    // Текущий объём памяти процесса: после загрузки освобождены буферы конвейера, остались записи
+    QJsonObject stats = lastLoadStats;
+    stats["residentMemoryBytes"] = ProcessMemory::residentBytes();
+    const QByteArray json = QJsonDocument(stats).toJson(QJsonDocument::Indented);
+    
+    QSaveFile file(targetPath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size() || !file.commit()) {
+        QMessageBox::warning(this, "Ошибка экспорта",
+                            "Не удалось сохранить статистику.\n\n"
+                            "Файл: " + targetPath + "\n\n"
+                            "Ошибка: " + file.errorString());
         return;
     }
     
-    qDebug() << "MainWindow::loadDataFromFile: Успешно загружено записей:" << records.size();
+    qDebug() << "MainWindow::onExportStatsClicked: Статистика загрузки сохранена в файл:" << targetPath;
+}
+
+void MainWindow::onFollowToggled(bool enabled)
+{
+    if (enabled) {
+        startFollowing();
+    } else {
+        tail->stop();
+    }
+}
+
+void MainWindow::startFollowing()
+{
+    // Во время загрузки слежение не запускается: оно начнётся после её завершения
+    if (!followButton->isChecked() || loader->isRunning() || currentFilePath.isEmpty()) {
+        return;
+    }
     
-    verifyHashChain();
-    displayRecords();
-    currentFilePath = filePath;
+    if (currentRecordsEnd < 0 || !tail->start(currentFilePath, currentRecordsEnd, records)) {
+        qDebug() << "MainWindow::startFollowing: Слежение возможно только за незашифрованным файлом JSON:" << currentFilePath;
+    }
 }
 
-bool MainWindow::parseJsonData(const QByteArray &data)
+void MainWindow::onTailRecordsAppended()
 {
-    QJsonParseError parseError;
-    QJsonDocument document = QJsonDocument::fromJson(data, &parseError);
+    LedgerStore batch = tail->takeRecords();
+    if (batch.isEmpty()) {
+        return;
+    }
     
-    if (parseError.error != QJsonParseError::NoError) {
-        qDebug() << "MainWindow::parseJsonData: Ошибка парсинга JSON:" << parseError.errorString()
-                 << "позиция:" << parseError.offset;
-        return false;
+    // Если таблица прокручена до конца, она остаётся в конце и после добавления строк
+    QScrollBar *scrollBar = tableView->verticalScrollBar();
+    const bool atBottom = scrollBar->value() == scrollBar->maximum();
+    const qsizetype firstAppended = records.size();
+    
+    appendRecords(batch);
+    currentRecordsEnd = tail->recordsEndOffset();
+    
+    if (tail->firstInvalidIndex() >= firstAppended) {
+        reportChainBreak(tail->firstInvalidIndex());
+    }
+    if (atBottom) {
+        tableView->scrollToBottom();
     }
     
-    if (!document.isArray()) {
-        qDebug() << "MainWindow::parseJsonData: Документ не является массивом";
-        return false;
+    qDebug() << "MainWindow::onTailRecordsAppended: Дописано записей:" << batch.size() << "всего:" << records.size();
+}
+
+void MainWindow::appendRecords(LedgerStore &batch)
+{
+    if (!tableModel->isFiltered()) {
+        tableModel->beginAppendRecords(batch.size());
+        records.append(batch);
+        recordIndex.append(records);
+        tableModel->endAppendRecords();
+        return;
     }
     
-    QJsonArray array = document.array();
-    records.clear();
-    records.reserve(array.size());
+    // Новые записи могут попасть в любое место результата поиска (например, по дате)
+    tableModel->beginReplaceRecords();
+    records.append(batch);
+    recordIndex.append(records);
+    updateFilterRows();
+    tableModel->endReplaceRecords();
+}
+
+void MainWindow::onFilterChanged()
+{
+    fromFilterEdit->setEnabled(fromFilterCheck->isChecked());
+    toFilterEdit->setEnabled(toFilterCheck->isChecked());
     
-    for (int i = 0; i < array.size(); ++i) {
-        QJsonValue value = array.at(i);
-        if (!value.isObject()) {
-            qDebug() << "MainWindow::parseJsonData: Элемент #" << i << "не является объектом";
-            continue;
-        }
-        
-        QJsonObject obj = value.toObject();
-        InvoiceRecord record;
-        
-        record.article = obj.value("article").toString();
-        if (record.article.length() != 10 || !record.article.toLongLong()) {
-            qDebug() << "MainWindow::parseJsonData: Некорректный артикул в записи #" << i;
-            continue;
-        }
-        
-        record.quantity = obj.value("quantity").toInt();
-        if (record.quantity <= 0) {
-            qDebug() << "MainWindow::parseJsonData: Некорректное количество в записи #" << i;
-            continue;
-        }
-        
-        record.timestamp = obj.value("timestamp").toVariant().toLongLong();
-        if (record.timestamp <= 0) {
-            qDebug() << "MainWindow::parseJsonData: Некорректный timestamp в записи #" << i;
-            continue;
-        }
-        
-        record.hash = obj.value("hash").toString();
-        if (record.hash.isEmpty()) {
-            qDebug() << "MainWindow::parseJsonData: Отсутствует хеш в записи #" << i;
-            continue;
-        }
-        
-        record.valid = true;
-        records.append(record);
+    tableModel->beginReplaceRecords();
+    updateFilterRows();
+    tableModel->endReplaceRecords();
+    tableView->scrollToTop();
+}
+
+void MainWindow::onResetFilterClicked()
+{
+    {
+        const QSignalBlocker articleBlocker(articleFilterEdit);
+        const QSignalBlocker fromBlocker(fromFilterCheck);
+        const QSignalBlocker toBlocker(toFilterCheck);
+        articleFilterEdit->clear();
+        fromFilterCheck->setChecked(false);
+        toFilterCheck->setChecked(false);
     }
-    
-    qDebug() << "MainWindow::parseJsonData: Успешно распарсено записей:" << records.size();
-    return !records.isEmpty();
+    updateFilterDateRange();
+    onFilterChanged();
 }
 
-bool MainWindow::parseJsonFile(const QString &filePath)
+void MainWindow::updateFilterRows()
 {
-    QString errorMessage;
-    QByteArray data = loadAndDecryptFile(filePath, errorMessage);
+    const QString articleText = articleFilterEdit->text();
+    const bool byDate = fromFilterCheck->isChecked() || toFilterCheck->isChecked();
+    if (articleText.isEmpty() && !byDate) {
+        tableModel->clearRowFilter();
+        filteredRows = std::vector<int>();
+        filterLabel->clear();
+        return;
+    }
     
-    if (data.isEmpty()) {
-        qDebug() << "MainWindow::parseJsonFile: Не удалось загрузить файл:" << errorMessage;
-        return false;
+    QElapsedTimer timer;
+    timer.start();
+    
+    const qint64 from = fromFilterCheck->isChecked() ? fromFilterEdit->dateTime().toSecsSinceEpoch() : LedgerIndex::MIN_TIME;
+    const qint64 to = toFilterCheck->isChecked() ? toFilterEdit->dateTime().toSecsSinceEpoch() : LedgerIndex::MAX_TIME;
+    if (!articleText.isEmpty()) {
+        // Артикул хранится числом, поэтому ведущие нули можно не вводить
+        filteredRows = recordIndex.findArticle(records, articleText.toULongLong(), from, to);
+        tableModel->setRowFilter(filteredRows.data(), static_cast<qsizetype>(filteredRows.size()));
+    } else {
+        // Строки диапазона берутся прямо из индекса, в порядке времени
+        qsizetype count = 0;
+        const int *rows = recordIndex.findTimeRange(from, to, count);
+        filteredRows = std::vector<int>();
+        tableModel->setRowFilter(rows, count);
     }
     
-    return parseJsonData(data);
+    const int found = tableModel->rowCount();
+    filterLabel->setText(QString("Найдено: %1 из %2 (%3 мс)")
+                         .arg(found).arg(records.size()).arg(timer.nsecsElapsed() / 1e6, 0, 'f', 2));
+    qDebug() << "MainWindow::updateFilterRows: Найдено записей:" << found << "за (мс):" << timer.nsecsElapsed() / 1e6;
 }
 
-QString MainWindow::computeHash(const InvoiceRecord &record, const QString &previousHash)
+void MainWindow::updateFilterDateRange()
 {
-    QString data = record.article + 
-                   QString::number(record.quantity) + 
-                   QString::number(record.timestamp) + 
-                   previousHash;
-    
-    QCryptographicHash hash(QCryptographicHash::Md5);
-    hash.addData(data.toUtf8());
-    QByteArray hashResult = hash.result();
+    if (recordIndex.size() == 0) {
+        return;
+    }
     
-    return hashResult.toBase64();
+    // Поля даты, которые не участвуют в поиске, показывают границы загруженных записей,
+    // чтобы при включении фильтра диапазон сразу охватывал все записи
+    const QSignalBlocker fromBlocker(fromFilterEdit);
+    const QSignalBlocker toBlocker(toFilterEdit);
+    if (!fromFilterCheck->isChecked()) {
+        fromFilterEdit->setDateTime(QDateTime::fromSecsSinceEpoch(recordIndex.minTimestamp()));
+    }
+    if (!toFilterCheck->isChecked()) {
+        toFilterEdit->setDateTime(QDateTime::fromSecsSinceEpoch(recordIndex.maxTimestamp()));
+    }
+}
+
+void MainWindow::setLoadingState(bool loading)
+{
+    openButton->setEnabled(!loading);
+    saveButton->setEnabled(!loading);
+    progressBar->setValue(0);
+    progressBar->setVisible(loading);
+    cancelButton->setVisible(loading);
 }
 
-void MainWindow::verifyHashChain()
+void MainWindow::loadDataFromFile()
 {
-    QString previousHash;
+#ifndef _DEBUG
+    if (!IntegrityCheck::isIntact()) {
+        QMessageBox::critical(this, "Обнаружена атака",
+                            "Обнаружена модификация исполняемого файла!\n\n"
+                            "Загрузка данных заблокирована.");
+        return;
+    }
+#endif
     
-    for (int i = 0; i < records.size(); ++i) {
-        InvoiceRecord &record = records[i];
-        
-        QString expectedHash = computeHash(record, previousHash);
-        
-        if (record.hash == expectedHash) {
-            record.valid = true;
-            previousHash = record.hash;
-        } else {
-            record.valid = false;
-            qDebug() << "MainWindow::verifyHashChain: Обнаружено нарушение целостности в записи #" << (i + 1)
-                     << "Ожидаемый хеш:" << expectedHash
-                     << "Хеш из файла:" << record.hash;
-            
-            for (int j = i + 1; j < records.size(); ++j) {
-                records[j].valid = false;
-            }
-            break;
-        }
+    QString filePath = getDataFilePath();
+    qDebug() << "MainWindow::loadDataFromFile: Попытка загрузить данные из файла:" << filePath;
+    qDebug() << "MainWindow::loadDataFromFile: Файл существует:" << QFile::exists(filePath);
+    
+    if (!QFile::exists(filePath)) {
+        QMessageBox::warning(this, "Файл не найден",
+                            "Не удалось найти файл с данными.\n\n"
+                            "Ожидаемый путь: " + filePath + "\n\n"
+                            "Убедитесь, что файл data/invoices_valid.json существует.");
+        return;
     }
     
-    qDebug() << "MainWindow::verifyHashChain: Проверка целостности завершена";
+    openLedger(filePath);
 }
 
-void MainWindow::displayRecords()
+void MainWindow::reportChainBreak(qsizetype firstInvalid)
 {
-    int headerCount = 4;
-    int currentCount = gridLayout->count();
-    
-    for (int i = currentCount - 1; i >= headerCount; --i) {
-        QLayoutItem *item = gridLayout->takeAt(i);
-        if (item) {
-            if (QWidget *widget = item->widget()) {
-                widget->deleteLater();
-            }
-            delete item;
-        }
+    HashChainVerifier verifier(records.hashAlgorithm());
+    uchar expectedHash[HashChainVerifier::HASH_SIZE];
+    char encodedHash[24];
+    verifier.computeDigest(records.article(firstInvalid),
+                           records.quantity(firstInvalid),
+                           records.timestamp(firstInvalid),
+                           firstInvalid > 0 ? records.hash(firstInvalid - 1) : nullptr,
+                           expectedHash);
+    LedgerStore::encodeHash(expectedHash, encodedHash);
+    
+    qDebug() << "MainWindow::reportChainBreak: Обнаружено нарушение целостности в записи #" << (firstInvalid + 1)
+             << "Алгоритм:" << LedgerStore::hashAlgorithmName(records.hashAlgorithm())
+             << "Ожидаемый хеш:" << QString::fromLatin1(encodedHash, sizeof(encodedHash))
+             << "Хеш из файла:" << records.hashText(firstInvalid);
+}
+
+void MainWindow::verifyMerkleTree(const QString &filePath)
+{
+    const QString treePath = MerkleTree::sidecarPath(filePath);
+    if (!QFile::exists(treePath)) {
+        return;
     }
     
-    for (int i = 0; i < records.size(); ++i) {
-        const InvoiceRecord &record = records[i];
-        int row = i + 1;
-        
-        QLabel *articleLabel = new QLabel(record.article, gridWidget);
-        QLabel *quantityLabel = new QLabel(QString::number(record.quantity), gridWidget);
-        
-        QDateTime dateTime = QDateTime::fromSecsSinceEpoch(record.timestamp);
-        QLabel *dateLabel = new QLabel(dateTime.toString("dd.MM.yyyy hh:mm:ss"), gridWidget);
-        
-        QLabel *hashLabel = new QLabel(record.hash, gridWidget);
-        hashLabel->setWordWrap(true);
-        
-        if (!record.valid) {
-            QString invalidStyle = "background-color: #dc3545; color: white; padding: 5px;";
-            articleLabel->setStyleSheet(invalidStyle);
-            quantityLabel->setStyleSheet(invalidStyle);
-            dateLabel->setStyleSheet(invalidStyle);
-            hashLabel->setStyleSheet(invalidStyle);
-        }
-        
-        gridLayout->addWidget(articleLabel, row, 0);
-        gridLayout->addWidget(quantityLabel, row, 1);
-        gridLayout->addWidget(dateLabel, row, 2);
-        gridLayout->addWidget(hashLabel, row, 3);
+    MerkleTree tree;
+    QString errorMessage;
+    if (!tree.load(treePath, errorMessage)) {
+        QMessageBox::warning(this, "Ошибка проверки",
+                            "Не удалось прочитать дерево Меркла.\n\n"
+                            "Файл: " + treePath + "\n\n"
+                            "Ошибка: " + errorMessage);
+        return;
     }
     
-    qDebug() << "MainWindow::displayRecords: Отображено записей в сетке:" << records.size();
+    const QVector<qsizetype> tampered = tree.findTampered(records);
+    for (qsizetype index : tampered) {
+        records.setValid(index, false);
+    }
+    const qsizetype missing = tree.leafCount() - records.size();
+    
+    qDebug() << "MainWindow::verifyMerkleTree: Листьев:" << tree.leafCount()
+             << "изменённых записей:" << tampered.size()
+             << "записей вне дерева:" << qMax<qsizetype>(0, records.size() - tree.leafCount());
+    
+    if (tampered.isEmpty() && missing <= 0) {
+        return;
+    }
+    
+    QStringList numbers;
+    for (qsizetype i = 0; i < qMin<qsizetype>(tampered.size(), 10); ++i) {
+        numbers << QString("#%1").arg(tampered.at(i) + 1);
+    }
+    if (tampered.size() > numbers.size()) {
+        numbers << QString("... (всего %1)").arg(tampered.size());
+    }
+    QString message = "Записи не совпадают с деревом Меркла.\n\n";
+    if (!numbers.isEmpty()) {
+        message += "Изменённые записи: " + numbers.join(", ") + "\n";
+    }
+    if (missing > 0) {
+        message += QString("Записей в файле меньше, чем в дереве, на %1.\n").arg(missing);
+    }
+    QMessageBox::warning(this, "Нарушение целостности", message + "\nФайл: " + filePath);
+}
+
+void MainWindow::displayRecords()
+{
+    tableModel->reload();
+    tableView->scrollToTop();
+    
+    qDebug() << "MainWindow::displayRecords: Отображено записей в таблице:" << records.size();
 }
 
 void MainWindow::onOpenButtonClicked()
 {
 #ifndef _DEBUG
-    if (!IntegrityCheck::verifyTextSegment()) {
+    if (!IntegrityCheck::isIntact()) {
         QMessageBox::critical(this, "Обнаружена атака",
                             "Обнаружена модификация исполняемого файла!\n\n"
                             "Операция заблокирована.");
@@ -429,7 +746,8 @@ void MainWindow::onOpenButtonClicked()
         this,
         "Выбор файла с данными",
         initialDir,
-        "Все поддерживаемые файлы (*.json *.enc);;JSON файлы (*.json);;Зашифрованные файлы (*.enc);;Все файлы (*.*)",
+        "Все поддерживаемые файлы (*.json *.enc *.ldg);;JSON файлы (*.json);;Зашифрованные файлы (*.enc);;"
+        "Двоичные файлы накладных (*.ldg);;Все файлы (*.*)",
         nullptr,
         QFileDialog::DontResolveSymlinks
     );
@@ -440,28 +758,48 @@ void MainWindow::onOpenButtonClicked()
     
     qDebug() << "MainWindow::onOpenButtonClicked: Выбран файл:" << selectedFile;
     
-    QString errorMessage;
-    QByteArray data = loadAndDecryptFile(selectedFile, errorMessage);
-    
-    if (data.isEmpty()) {
-        QMessageBox::warning(this, "Ошибка загрузки",
-                            "Не удалось загрузить данные из файла.\n\n"
-                            "Файл: " + selectedFile + "\n\n"
-                            "Ошибка: " + errorMessage);
+    openLedger(selectedFile);
+}
+
+void MainWindow::onSaveButtonClicked()
+{
+    if (records.isEmpty()) {
+        QMessageBox::information(this, "Сохранение", "Нет записей для сохранения.");
         return;
     }
     
-    if (!parseJsonData(data)) {
-        QMessageBox::warning(this, "Ошибка парсинга",
-                            "Не удалось распарсить данные из файла.\n\n"
-                            "Файл: " + selectedFile + "\n\n"
-                            "Проверьте, что файл имеет правильный формат JSON.");
+    QString initialDir = currentFilePath.isEmpty() ? QDir::homePath() : QFileInfo(currentFilePath).absolutePath();
+    QString selectedFilter;
+    QString targetPath = QFileDialog::getSaveFileName(
+        this,
+        "Сохранение записей",
+        initialDir,
+        "Двоичные файлы накладных (*.ldg);;JSON файлы (*.json)",
+        &selectedFilter
+    );
+    
+    if (targetPath.isEmpty()) {
         return;
     }
     
-    qDebug() << "MainWindow::onOpenButtonClicked: Успешно загружено записей:" << records.size();
+    QString suffix = QFileInfo(targetPath).suffix().toLower();
+    if (suffix != "ldg" && suffix != "json") {
+        suffix = selectedFilter.contains("*.json") ? "json" : "ldg";
+        targetPath += "." + suffix;
+    }
     
-    verifyHashChain();
-    displayRecords();
-    currentFilePath = selectedFile;
+    QString errorMessage;
+    bool saved = suffix == "ldg"
+        ? LedgerFormat::writeBinary(records, targetPath, errorMessage)
+        : LedgerFormat::writeJson(records, targetPath, errorMessage);
+    
+    if (!saved) {
+        QMessageBox::warning(this, "Ошибка сохранения",
+                            "Не удалось сохранить записи.\n\n"
+                            "Файл: " + targetPath + "\n\n"
+                            "Ошибка: " + errorMessage);
+        return;
+    }
+    
+    qDebug() << "MainWindow::onSaveButtonClicked: Сохранено записей:" << records.size() << "в файл:" << targetPath;
 }
@@ -1,32 +1,25 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
+#include "ledgerstore.h"
+#include "ledgerindex.h"
 #include <QMainWindow>
 #include <QString>
-#include <QList>
+#include <QJsonObject>
+#include <vector>
 
-class QGridLayout;
+class QTableView;
 class QWidget;
-class QLabel;
 class QPushButton;
+class QLabel;
+class QProgressBar;
+class QLineEdit;
+class QCheckBox;
+class QDateTimeEdit;
 class EncryptionManager;
-
-// Структура записи товарной накладной
-struct InvoiceRecord
-{
-    QString article;        // Артикул товара (10 цифр)
-    int quantity;           // Количество единиц товара
-    qint64 timestamp;      // Дата и время отгрузки (unix timestamp)
-    QString hash;          // Хеш MD5 в кодировке base64
-    bool valid;            // Признак валидности записи (для подсветки)
-    
-    InvoiceRecord()
-        : quantity(0)
-        , timestamp(0)
-        , valid(true)
-    {
-    }
-};
+class InvoiceTableModel;
+class LedgerLoader;
+class LedgerTail;
 
 class MainWindow : public QMainWindow
 {
@@ -37,36 +30,85 @@ public:
     ~MainWindow();
 
 private:
-    // Настройка интерфейса с QGridLayout для отображения данных
+    // Настройка интерфейса с QTableView для отображения данных
     void setupUI();
     // Загрузка данных из JSON файла при старте приложения
     void loadDataFromFile();
     // Получение пути к файлу с данными
     QString getDataFilePath();
-    // Загрузка и расшифровка файла (если зашифрован)
-    QByteArray loadAndDecryptFile(const QString &filePath, QString &errorMessage);
-    // Проверка, является ли файл зашифрованным (по расширению .enc)
-    bool isEncryptedFile(const QString &filePath) const;
-    // Парсинг JSON данных из байтового массива
-    bool parseJsonData(const QByteArray &data);
-    // Парсинг JSON файла и заполнение списка записей (устаревший метод, используйте loadAndDecryptFile + parseJsonData)
-    bool parseJsonFile(const QString &filePath);
-    // Проверка цепочки хешей MD5 для всех записей
-    void verifyHashChain();
-    // Вычисление MD5 хеша записи по формуле: hash_i = MD5(article + quantity + timestamp + hash_i-1)
-    QString computeHash(const InvoiceRecord &record, const QString &previousHash);
-    // Отображение всех записей в сетке QGridLayout
+    // Запуск фоновой загрузки файла с накладными (LedgerLoader); возвращает false,
+    // если загрузка не может быть начата
+    bool openLedger(const QString &filePath);
+    // Приём очередных проверенных пачек записей от загрузчика
+    void onLoaderBatchesReady();
+    // Обновление индикатора хода загрузки
+    void onLoaderProgress(qint64 processedBytes, qint64 totalBytes);
+    // Завершение загрузки: при ошибке или отмене восстанавливаются прежние записи
+    void onLoaderFinished(bool success);
+    // Сохранение статистики последней загрузки и её сводка в строке состояния
+    void updateLoadStatistics();
+    // Обработчик нажатия кнопки "Экспорт статистики": сохранение статистики загрузки в JSON
+    void onExportStatsClicked();
+    // Включение и выключение слежения за дописываемым файлом (кнопка "Следить за файлом")
+    void onFollowToggled(bool enabled);
+    // Запуск слежения за текущим файлом, если оно включено и формат файла это позволяет
+    void startFollowing();
+    // Приём записей, дописанных в файл, за которым ведётся слежение
+    void onTailRecordsAppended();
+    // Добавление пачки в конец записей и индекса; при включённом фильтре строки фильтра пересчитываются
+    void appendRecords(LedgerStore &batch);
+    // Применение фильтра после изменения полей поиска
+    void onFilterChanged();
+    // Обработчик нажатия кнопки "Сбросить": показ всех записей
+    void onResetFilterClicked();
+    // Поиск строк по полям фильтра через индекс и передача их модели;
+    // вызывается между beginReplaceRecords и endReplaceRecords модели
+    void updateFilterRows();
+    // Границы полей даты по времени загруженных записей (если фильтр по дате не включён)
+    void updateFilterDateRange();
+    // Переключение интерфейса между режимом загрузки и обычным режимом
+    void setLoadingState(bool loading);
+    // Вывод в журнал ожидаемого и фактического хеша первой записи с нарушенной цепочкой
+    void reportChainBreak(qsizetype firstInvalid);
+    // Сверка записей с деревом Меркла (<файл>.merkle), если оно есть: все записи, не совпавшие
+    // с деревом, помечаются невалидными, а не только записи после первого разрыва цепочки
+    void verifyMerkleTree(const QString &filePath);
+    // Обновление табличного представления записей
     void displayRecords();
     // Обработчик нажатия кнопки "Открыть"
     void onOpenButtonClicked();
+    // Обработчик нажатия кнопки "Сохранить как": сохранение записей в двоичном формате или JSON
+    void onSaveButtonClicked();
 
     QWidget *centralWidget;
-    QWidget *gridWidget;
-    QGridLayout *gridLayout;
+    QTableView *tableView;
+    InvoiceTableModel *tableModel;
     QPushButton *openButton;
-    QList<InvoiceRecord> records;
+    QPushButton *saveButton;
+    QPushButton *cancelButton;
+    QPushButton *followButton;
+    QProgressBar *progressBar;
+    QLabel *statsLabel;             // Сводка последней загрузки в строке состояния
+    QPushButton *exportStatsButton;
+    QLineEdit *articleFilterEdit;   // Поиск по артикулу
+    QCheckBox *fromFilterCheck;     // Ограничение по дате "с"
+    QDateTimeEdit *fromFilterEdit;
+    QCheckBox *toFilterCheck;       // Ограничение по дате "по"
+    QDateTimeEdit *toFilterEdit;
+    QPushButton *resetFilterButton;
+    QLabel *filterLabel;            // Число найденных записей и время поиска
+    std::vector<int> filteredRows;  // Найденные по артикулу строки (поиск по дате отдаёт строки индекса)
+    QJsonObject lastLoadStats;      // Статистика последней загрузки для экспорта
+    LedgerStore records;
+    LedgerStore previousRecords;    // Записи до начала текущей загрузки (для восстановления)
+    LedgerIndex recordIndex;        // Индексы записей по артикулу и по времени
+    LedgerIndex previousIndex;      // Индекс прежних записей на время загрузки
+    bool recordsReplaced;           // Первая пачка текущей загрузки уже заменила записи
     QString currentFilePath;
+    qint64 currentRecordsEnd;       // Смещение после последней записи текущего файла (-1 - слежение невозможно)
     EncryptionManager *encryptionManager;  // Менеджер шифрования для расшифровки файлов
+    LedgerLoader *loader;                  // Фоновый загрузчик файлов
+    LedgerTail *tail;                      // Слежение за дописываемым файлом
 };
 
 #endif
@@ -0,0 +1,92 @@
+#include "mappedfile.h"
+#include "ledgerlog.h"
+#include <limits>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+    : mapped(nullptr)
+    , length(0)
+    , opened(false)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const QString &filePath, AccessPattern pattern, QString &errorMessage)
+{
+    close();
+
+    file.setFileName(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        errorMessage = QString("Не удалось открыть файл: %1").arg(file.errorString());
+        return false;
+    }
+
+    length = file.size();
+    if (length > 0) {
+        mapped = file.map(0, length);
+        if (!mapped) {
+            errorMessage = QString("Не удалось отобразить файл в память: %1").arg(file.errorString());
+            file.close();
+            length = 0;
+            return false;
+        }
+
+#ifdef Q_OS_UNIX
+        // Подсказка ядру: при последовательном проходе читать с упреждением и освобождать
+        // прочитанные страницы в первую очередь, при произвольном - не читать лишнего
+        if (madvise(mapped, size_t(length), pattern == SequentialAccess ? MADV_SEQUENTIAL : MADV_RANDOM) != 0) {
+            qCDebug(lcFormat) << "MappedFile::open: madvise не поддерживается для" << filePath;
+        }
+#else
+        Q_UNUSED(pattern);
+#endif
+    }
+
+    opened = true;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mapped) {
+        file.unmap(mapped);
+        mapped = nullptr;
+    }
+    if (file.isOpen()) {
+        file.close();
+    }
+    length = 0;
+    opened = false;
+}
+
+QByteArray MappedFile::view(qint64 offset, qint64 size) const
+{
+    if (!mapped || offset < 0 || size < 0 || offset + size > length) {
+        return QByteArray();
+    }
+#if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
+    // В Qt 5 размер QByteArray ограничен int
+    if (size > std::numeric_limits<int>::max()) {
+        return QByteArray();
+    }
+#endif
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(mapped + offset), size);
+}
+
+int MappedFile::pageSize()
+{
+#ifdef Q_OS_UNIX
+    static const int size = int(sysconf(_SC_PAGESIZE));
+    return size > 0 ? size : 4096;
+#else
+    return 4096;
+#endif
+}
@@ -0,0 +1,49 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+// Файл, отображённый в память только для чтения (QFile::map).
+// Данные доступны без копирования в кучу: страницы подгружаются системой по мере обращения
+// и остаются в кэше страниц между открытиями файла.
+class MappedFile
+{
+public:
+    // Ожидаемый порядок доступа (подсказка системе для упреждающего чтения)
+    enum AccessPattern {
+        SequentialAccess,
+        RandomAccess
+    };
+
+    MappedFile();
+    ~MappedFile();
+
+    // Открытие и отображение файла; false - если файл не открыт или не может быть отображён
+    // (например, это канал или устройство), тогда его следует читать обычным способом
+    bool open(const QString &filePath, AccessPattern pattern, QString &errorMessage);
+    void close();
+
+    bool isOpen() const { return opened; }
+    const uchar *data() const { return mapped; }
+    qint64 size() const { return length; }
+
+    // Участок файла в виде QByteArray без копирования (QByteArray::fromRawData).
+    // Действителен, пока файл открыт
+    QByteArray view(qint64 offset, qint64 size) const;
+
+    // Размер страницы памяти (для предварительной подгрузки страниц)
+    static int pageSize();
+
+private:
+    Q_DISABLE_COPY(MappedFile)
+
+    QFile file;
+    uchar *mapped;
+    qint64 length;
+    bool opened;
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include "md5multibuffer.h"
+#include <QtEndian>
+#include <cstring>
+
+// GCC на x86-64 Linux собирает ядро в вариантах для AVX-512, AVX2 и базового набора (SSE2);
+// подходящий вариант выбирается при загрузке программы по возможностям процессора;
+// вспомогательные функции встраиваются принудительно, иначе они остались бы собранными
+// для базового набора. Другие компиляторы векторизуют ядро под набор инструкций, заданный при сборке
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define MD5_LANE_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#define MD5_INLINE inline __attribute__((always_inline))
+#else
+#define MD5_LANE_TARGETS
+#define MD5_INLINE inline
+#endif
+
+namespace {
+
+const int LANES = Md5MultiBuffer::LANES;
+
+typedef quint32 Lanes[LANES];
+
+const quint32 K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+const int S[4][4] = {
+    {7, 12, 17, 22},
+    {5, 9, 14, 20},
+    {4, 11, 16, 23},
+    {6, 10, 15, 21}
+};
+
+// Нелинейная функция раунда
+template <int Round>
+MD5_INLINE quint32 mix(quint32 b, quint32 c, quint32 d)
+{
+    if (Round == 0) {
+        return (b & c) | (~b & d);
+    }
+    if (Round == 1) {
+        return (b & d) | (c & ~d);
+    }
+    if (Round == 2) {
+        return b ^ c ^ d;
+    }
+    return c ^ (b | ~d);
+}
+
+// Номер слова блока для шага i раунда
+template <int Round>
+MD5_INLINE int wordIndex(int i)
+{
+    if (Round == 0) {
+        return i & 15;
+    }
+    if (Round == 1) {
+        return (5 * i + 1) & 15;
+    }
+    if (Round == 2) {
+        return (3 * i + 5) & 15;
+    }
+    return (7 * i) & 15;
+}
+
+// Шаг MD5 сразу для всех дорожек: a = b + ((a + mix(b, c, d) + k + x) <<< s)
+template <int Round>
+MD5_INLINE void step(Lanes a, const Lanes b, const Lanes c, const Lanes d, const Lanes x, quint32 k, int s)
+{
+    for (int lane = 0; lane < LANES; ++lane) {
+        const quint32 t = a[lane] + mix<Round>(b[lane], c[lane], d[lane]) + k + x[lane];
+        a[lane] = b[lane] + ((t << s) | (t >> (32 - s)));
+    }
+}
+
+template <int Round>
+MD5_INLINE void round(Lanes a, Lanes b, Lanes c, Lanes d, const Lanes *words)
+{
+    for (int i = Round * 16; i < Round * 16 + 16; i += 4) {
+        step<Round>(a, b, c, d, words[wordIndex<Round>(i)], K[i], S[Round][0]);
+        step<Round>(d, a, b, c, words[wordIndex<Round>(i + 1)], K[i + 1], S[Round][1]);
+        step<Round>(c, d, a, b, words[wordIndex<Round>(i + 2)], K[i + 2], S[Round][2]);
+        step<Round>(b, c, d, a, words[wordIndex<Round>(i + 3)], K[i + 3], S[Round][3]);
+    }
+}
+
+// Обработка одного блока всех дорожек; words - 16 слов блока, по LANES значений в каждом
+MD5_INLINE void compress(Lanes *state, const Lanes *words)
+{
+    Lanes a, b, c, d;
+    std::memcpy(a, state[0], sizeof(Lanes));
+    std::memcpy(b, state[1], sizeof(Lanes));
+    std::memcpy(c, state[2], sizeof(Lanes));
+    std::memcpy(d, state[3], sizeof(Lanes));
+
+    round<0>(a, b, c, d, words);
+    round<1>(a, b, c, d, words);
+    round<2>(a, b, c, d, words);
+    round<3>(a, b, c, d, words);
+
+    for (int lane = 0; lane < LANES; ++lane) {
+        state[0][lane] += a[lane];
+        state[1][lane] += b[lane];
+        state[2][lane] += c[lane];
+        state[3][lane] += d[lane];
+    }
+}
+
+// Слова блока block всех дорожек в порядке "слово, затем дорожка"
+MD5_INLINE void transpose(const uchar (*blocks)[2 * Md5MultiBuffer::BLOCK_SIZE], int block, Lanes *words)
+{
+    for (int lane = 0; lane < LANES; ++lane) {
+        const uchar *data = blocks[lane] + block * Md5MultiBuffer::BLOCK_SIZE;
+        for (int word = 0; word < 16; ++word) {
+            words[word][lane] = qFromLittleEndian<quint32>(data + 4 * word);
+        }
+    }
+}
+
+MD5_INLINE void storeDigest(const Lanes *state, int lane, uchar *out)
+{
+    for (int i = 0; i < 4; ++i) {
+        qToLittleEndian<quint32>(state[i][lane], out + 4 * i);
+    }
+}
+
+}
+
+Md5MultiBuffer::Md5MultiBuffer()
+{
+    std::memset(blocks, 0, sizeof(blocks));
+    std::memset(lengths, 0, sizeof(lengths));
+    std::memset(digests, 0, sizeof(digests));
+}
+
+MD5_LANE_TARGETS
+void Md5MultiBuffer::compute(int laneCount)
+{
+    // Дополнение: 0x80, нули и длина в битах (little-endian) в конце последнего блока
+    bool hasTwoBlocks = false;
+    bool twoBlocks[LANES] = {};
+    for (int lane = 0; lane < laneCount; ++lane) {
+        const int length = lengths[lane];
+        const int total = length + 9 <= BLOCK_SIZE ? BLOCK_SIZE : 2 * BLOCK_SIZE;
+        blocks[lane][length] = 0x80;
+        std::memset(blocks[lane] + length + 1, 0, size_t(total - length - 9));
+        qToLittleEndian<quint64>(quint64(length) * 8, blocks[lane] + total - 8);
+        twoBlocks[lane] = total > BLOCK_SIZE;
+        hasTwoBlocks = hasTwoBlocks || twoBlocks[lane];
+    }
+
+    Lanes state[4];
+    for (int lane = 0; lane < LANES; ++lane) {
+        state[0][lane] = 0x67452301;
+        state[1][lane] = 0xefcdab89;
+        state[2][lane] = 0x98badcfe;
+        state[3][lane] = 0x10325476;
+    }
+
+    // Неиспользуемые дорожки вычисляются вместе с остальными: векторная ширина всё равно занята
+    Lanes words[16];
+    transpose(blocks, 0, words);
+    compress(state, words);
+    for (int lane = 0; lane < laneCount; ++lane) {
+        if (!twoBlocks[lane]) {
+            storeDigest(state, lane, digests[lane]);
+        }
+    }
+
+    if (hasTwoBlocks) {
+        transpose(blocks, 1, words);
+        compress(state, words);
+        for (int lane = 0; lane < laneCount; ++lane) {
+            if (twoBlocks[lane]) {
+                storeDigest(state, lane, digests[lane]);
+            }
+        }
+    }
+}
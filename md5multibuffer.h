@@ -0,0 +1,38 @@
+#ifndef MD5MULTIBUFFER_H
+#define MD5MULTIBUFFER_H
+
+#include <QtGlobal>
+
+// Одновременное вычисление MD5 нескольких независимых коротких сообщений (multi-buffer).
+// Одно сообщение MD5 вычисляется строго последовательно, но сообщения разных дорожек (lanes)
+// не зависят друг от друга: состояние хранится по дорожкам в соседних словах, и каждый
+// шаг алгоритма выполняется сразу для всех дорожек одним циклом, который компилятор
+// переводит в векторные инструкции (SSE2 - по 4 дорожки, AVX2 - по 8, AVX-512 - по 16).
+// Рассчитан на сообщения цепочки хешей: не длиннее MAX_MESSAGE_SIZE, т.е. один или два блока.
+// Объект не потокобезопасен: для параллельной работы каждому потоку нужен свой экземпляр.
+class Md5MultiBuffer
+{
+public:
+    static const int LANES = 16;
+    static const int DIGEST_SIZE = 16;
+    static const int BLOCK_SIZE = 64;
+    // Сообщение с дополнением (0x80 и длина, 9 байт) помещается в два блока
+    static const int MAX_MESSAGE_SIZE = 2 * BLOCK_SIZE - 9;
+
+    Md5MultiBuffer();
+
+    // Буфер сообщения дорожки lane (не менее MAX_MESSAGE_SIZE байт) и его длина
+    char *message(int lane) { return reinterpret_cast<char*>(blocks[lane]); }
+    void setLength(int lane, int length) { lengths[lane] = length; }
+
+    // Вычисление MD5 сообщений дорожек [0, laneCount); буферы сообщений после вызова не сохраняются
+    void compute(int laneCount);
+    const uchar *digest(int lane) const { return digests[lane]; }
+
+private:
+    alignas(64) uchar blocks[LANES][2 * BLOCK_SIZE];
+    int lengths[LANES];
+    uchar digests[LANES][DIGEST_SIZE];
+};
+
+#endif
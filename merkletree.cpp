@@ -0,0 +1,337 @@
+#include "merkletree.h"
+#include "ledgerstore.h"
+#include "ledgerlog.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QThread>
+#include <QtEndian>
+#include <QtConcurrent/QtConcurrentMap>
+#include <openssl/evp.h>
+#include <cstring>
+
+namespace {
+
+const char TREE_MAGIC[8] = {'I', 'N', 'V', 'M', 'T', '0', '0', '1'};
+const quint32 TREE_VERSION = 1;
+const int TREE_HEADER_SIZE = 8 + 4 + 4 + 8 + MerkleTree::DIGEST_SIZE;
+
+// Префиксы разделяют листья и узлы: лист нельзя выдать за внутренний узел и наоборот
+const uchar LEAF_PREFIX = 0x00;
+const uchar NODE_PREFIX = 0x01;
+
+// Содержимое листа: артикул (8) + количество (4) + timestamp (8) + хеш цепочки (16)
+const int LEAF_MESSAGE_SIZE = 8 + 4 + 8 + LedgerStore::HASH_SIZE;
+
+// Переиспользуемый контекст SHA-256 (один на поток)
+class Sha256
+{
+public:
+    Sha256()
+        : context(EVP_MD_CTX_new())
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        , sha256(EVP_MD_fetch(nullptr, "SHA256", nullptr))
+#else
+        , sha256(const_cast<EVP_MD*>(EVP_sha256()))
+#endif
+    {
+    }
+
+    ~Sha256()
+    {
+        EVP_MD_CTX_free(context);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        EVP_MD_free(sha256);
+#endif
+    }
+
+    Sha256(const Sha256 &) = delete;
+    Sha256 &operator=(const Sha256 &) = delete;
+
+    void digest(uchar prefix, const uchar *data, size_t length, uchar *out)
+    {
+        unsigned int digestLength = 0;
+        EVP_DigestInit_ex(context, sha256, nullptr);
+        EVP_DigestUpdate(context, &prefix, 1);
+        EVP_DigestUpdate(context, data, length);
+        EVP_DigestFinal_ex(context, out, &digestLength);
+    }
+
+    void leaf(const LedgerStore &store, qsizetype index, uchar *out)
+    {
+        uchar message[LEAF_MESSAGE_SIZE];
+        qToLittleEndian<quint64>(store.article(index), message);
+        qToLittleEndian<qint32>(store.quantity(index), message + 8);
+        qToLittleEndian<qint64>(store.timestamp(index), message + 12);
+        std::memcpy(message + 20, store.hash(index), LedgerStore::HASH_SIZE);
+        digest(LEAF_PREFIX, message, sizeof(message), out);
+    }
+
+    // Родитель двух соседних узлов: в уровне они лежат подряд, 2 * DIGEST_SIZE байт
+    void node(const uchar *children, uchar *out)
+    {
+        digest(NODE_PREFIX, children, 2 * MerkleTree::DIGEST_SIZE, out);
+    }
+
+    void node(const uchar *left, const uchar *right, uchar *out)
+    {
+        uchar children[2 * MerkleTree::DIGEST_SIZE];
+        std::memcpy(children, left, MerkleTree::DIGEST_SIZE);
+        std::memcpy(children + MerkleTree::DIGEST_SIZE, right, MerkleTree::DIGEST_SIZE);
+        node(children, out);
+    }
+
+private:
+    EVP_MD_CTX *context;
+    EVP_MD *sha256;
+};
+
+struct Range
+{
+    qsizetype begin;
+    qsizetype end;
+    int number;     // Порядковый номер диапазона
+};
+
+// Делит [0, count) на диапазоны не меньше minSize по числу потоков
+QVector<Range> splitRange(qsizetype count, int threadCount, qsizetype minSize)
+{
+    if (threadCount <= 0) {
+        threadCount = QThread::idealThreadCount();
+    }
+    const qsizetype rangeSize = qMax<qsizetype>(minSize, (count + threadCount - 1) / qMax(1, threadCount));
+
+    QVector<Range> ranges;
+    for (qsizetype begin = 0; begin < count; begin += rangeSize) {
+        ranges.append({begin, qMin(count, begin + rangeSize), int(ranges.size())});
+    }
+    return ranges;
+}
+
+// Выполняет body для каждого диапазона: один диапазон - в текущем потоке, несколько - параллельно
+template <typename Body>
+void forEachRange(QVector<Range> ranges, Body body)
+{
+    if (ranges.size() == 1) {
+        body(ranges.first());
+    } else if (ranges.size() > 1) {
+        QtConcurrent::blockingMap(ranges, body);
+    }
+}
+
+}
+
+MerkleTree::MerkleTree()
+{
+}
+
+void MerkleTree::clear()
+{
+    levels.clear();
+}
+
+void MerkleTree::build(const LedgerStore &store, int threadCount)
+{
+    levels.clear();
+    const qsizetype count = store.size();
+    if (count == 0) {
+        return;
+    }
+
+    QByteArray leaves(count * DIGEST_SIZE, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar*>(leaves.data());
+    forEachRange(splitRange(count, threadCount, MIN_PARALLEL_NODES), [&store, out](const Range &range) {
+        Sha256 hash;
+        for (qsizetype i = range.begin; i < range.end; ++i) {
+            hash.leaf(store, i, out + i * DIGEST_SIZE);
+        }
+    });
+
+    levels.push_back(leaves);
+    buildLevels(threadCount);
+}
+
+void MerkleTree::buildLevels(int threadCount)
+{
+    levels.resize(1);
+    while (levels.back().size() > DIGEST_SIZE) {
+        const QByteArray &children = levels.back();
+        const qsizetype childCount = children.size() / DIGEST_SIZE;
+        const qsizetype parentCount = (childCount + 1) / 2;
+
+        QByteArray parents(parentCount * DIGEST_SIZE, Qt::Uninitialized);
+        const uchar *in = reinterpret_cast<const uchar*>(children.constData());
+        uchar *out = reinterpret_cast<uchar*>(parents.data());
+        forEachRange(splitRange(parentCount, threadCount, MIN_PARALLEL_NODES), [in, out, childCount](const Range &range) {
+            Sha256 hash;
+            for (qsizetype i = range.begin; i < range.end; ++i) {
+                if (2 * i + 1 < childCount) {
+                    hash.node(in + 2 * i * DIGEST_SIZE, out + i * DIGEST_SIZE);
+                } else {
+                    std::memcpy(out + i * DIGEST_SIZE, in + 2 * i * DIGEST_SIZE, DIGEST_SIZE);
+                }
+            }
+        });
+
+        levels.push_back(parents);
+    }
+}
+
+QByteArray MerkleTree::root() const
+{
+    return levels.empty() ? QByteArray() : levels.back();
+}
+
+const uchar *MerkleTree::leaf(qsizetype index) const
+{
+    return reinterpret_cast<const uchar*>(levels.front().constData()) + index * DIGEST_SIZE;
+}
+
+QByteArray MerkleTree::proof(qsizetype index) const
+{
+    QByteArray result;
+    for (size_t level = 0; level + 1 < levels.size(); ++level) {
+        const qsizetype sibling = index ^ 1;
+        if (sibling < levels[level].size() / DIGEST_SIZE) {
+            result.append(levels[level].constData() + sibling * DIGEST_SIZE, DIGEST_SIZE);
+        }
+        index >>= 1;
+    }
+    return result;
+}
+
+bool MerkleTree::verifyProof(const uchar *leafDigest, qsizetype index, qsizetype leafCount,
+                             const QByteArray &proof, const QByteArray &root)
+{
+    if (index < 0 || index >= leafCount || root.size() != DIGEST_SIZE) {
+        return false;
+    }
+
+    Sha256 hash;
+    uchar current[DIGEST_SIZE];
+    std::memcpy(current, leafDigest, DIGEST_SIZE);
+    const uchar *siblings = reinterpret_cast<const uchar*>(proof.constData());
+    qsizetype used = 0;
+
+    for (qsizetype nodeCount = leafCount; nodeCount > 1; nodeCount = (nodeCount + 1) / 2) {
+        const qsizetype sibling = index ^ 1;
+        if (sibling < nodeCount) {
+            if (used + DIGEST_SIZE > proof.size()) {
+                return false;
+            }
+            if (index & 1) {
+                hash.node(siblings + used, current, current);
+            } else {
+                hash.node(current, siblings + used, current);
+            }
+            used += DIGEST_SIZE;
+        }
+        index >>= 1;
+    }
+
+    return used == proof.size() && std::memcmp(current, root.constData(), DIGEST_SIZE) == 0;
+}
+
+void MerkleTree::leafDigest(const LedgerStore &store, qsizetype index, uchar *out)
+{
+    Sha256 hash;
+    hash.leaf(store, index, out);
+}
+
+QVector<qsizetype> MerkleTree::findTampered(const LedgerStore &store, int threadCount) const
+{
+    const qsizetype count = qMin(store.size(), leafCount());
+    const QVector<Range> ranges = splitRange(count, threadCount, MIN_PARALLEL_NODES);
+
+    // Каждый диапазон собирает свои индексы, затем они объединяются по порядку диапазонов
+    QVector<QVector<qsizetype>> found(ranges.size());
+    QVector<qsizetype> *results = found.data();
+    const MerkleTree *tree = this;
+    forEachRange(ranges, [&store, tree, results](const Range &range) {
+        Sha256 hash;
+        uchar digest[DIGEST_SIZE];
+        QVector<qsizetype> &indices = results[range.number];
+        for (qsizetype i = range.begin; i < range.end; ++i) {
+            hash.leaf(store, i, digest);
+            if (std::memcmp(digest, tree->leaf(i), DIGEST_SIZE) != 0) {
+                indices.append(i);
+            }
+        }
+    });
+
+    QVector<qsizetype> tampered;
+    for (const QVector<qsizetype> &indices : found) {
+        tampered += indices;
+    }
+    return tampered;
+}
+
+QString MerkleTree::sidecarPath(const QString &filePath)
+{
+    return filePath + ".merkle";
+}
+
+bool MerkleTree::save(const QString &path, QString &errorMessage) const
+{
+    QByteArray header(TREE_HEADER_SIZE, '\0');
+    uchar *p = reinterpret_cast<uchar*>(header.data());
+    std::memcpy(p, TREE_MAGIC, sizeof(TREE_MAGIC));
+    qToLittleEndian<quint32>(TREE_VERSION, p + 8);
+    qToLittleEndian<qint64>(leafCount(), p + 16);
+    if (!isEmpty()) {
+        std::memcpy(p + 24, levels.back().constData(), DIGEST_SIZE);
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(header) != header.size()
+        || (!isEmpty() && file.write(levels.front()) != levels.front().size()) || !file.commit()) {
+        errorMessage = QString("Не удалось сохранить дерево Меркла: %1").arg(file.errorString());
+        return false;
+    }
+
+    qCDebug(lcCache) << "MerkleTree::save: Сохранено листьев:" << leafCount() << "в файл:" << path;
+    return true;
+}
+
+bool MerkleTree::load(const QString &path, QString &errorMessage)
+{
+    clear();
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        errorMessage = QString("Не удалось открыть файл дерева Меркла: %1").arg(file.errorString());
+        return false;
+    }
+
+    const QByteArray header = file.read(TREE_HEADER_SIZE);
+    const uchar *p = reinterpret_cast<const uchar*>(header.constData());
+    if (header.size() != TREE_HEADER_SIZE || std::memcmp(p, TREE_MAGIC, sizeof(TREE_MAGIC)) != 0
+        || qFromLittleEndian<quint32>(p + 8) != TREE_VERSION) {
+        errorMessage = QString("Файл дерева Меркла повреждён или имеет неподдерживаемую версию.");
+        return false;
+    }
+
+    const qint64 count = qFromLittleEndian<qint64>(p + 16);
+    if (count < 0 || file.size() != TREE_HEADER_SIZE + count * DIGEST_SIZE) {
+        errorMessage = QString("Размер файла дерева Меркла не соответствует числу листьев.");
+        return false;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    levels.push_back(file.read(count * DIGEST_SIZE));
+    if (levels.front().size() != count * DIGEST_SIZE) {
+        clear();
+        errorMessage = QString("Не удалось прочитать листья дерева Меркла: %1").arg(file.errorString());
+        return false;
+    }
+
+    // Корень пересчитывается по листьям: так обнаруживается повреждение самого файла дерева
+    buildLevels(0);
+    if (std::memcmp(levels.back().constData(), p + 24, DIGEST_SIZE) != 0) {
+        clear();
+        errorMessage = QString("Корень дерева Меркла не совпадает с его листьями.");
+        return false;
+    }
+    return true;
+}
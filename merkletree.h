@@ -0,0 +1,68 @@
+#ifndef MERKLETREE_H
+#define MERKLETREE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include <vector>
+
+class LedgerStore;
+
+// Дерево Меркла над записями накладных - дополнительный режим контроля целостности рядом
+// с цепочкой MD5. Лист - SHA-256(0x00 + артикул + количество + timestamp + хеш цепочки)
+// в двоичном виде (little-endian), узел - SHA-256(0x01 + левый + правый); непарный последний
+// узел уровня переносится на следующий уровень без изменений. Листья не зависят друг от друга,
+// поэтому дерево строится и проверяется параллельно, подлинность одной записи подтверждается
+// log2(n) хешами соседей, а сравнение с сохранённым деревом находит все изменённые записи,
+// а не только первую, как цепочка.
+// Дерево хранится в файле рядом с файлом накладных (<файл>.merkle): листья и корень;
+// внутренние узлы пересчитываются при чтении, и пересчитанный корень сверяется с сохранённым.
+class MerkleTree
+{
+public:
+    static const int DIGEST_SIZE = 32;
+
+    MerkleTree();
+
+    // Построение по всем записям хранилища. threadCount <= 0 - по числу доступных ядер
+    void build(const LedgerStore &store, int threadCount = 0);
+    void clear();
+
+    bool isEmpty() const { return leafCount() == 0; }
+    qsizetype leafCount() const { return levels.empty() ? 0 : levels.front().size() / DIGEST_SIZE; }
+    // Корень дерева (пустой для дерева без листьев)
+    QByteArray root() const;
+    const uchar *leaf(qsizetype index) const;
+
+    // Доказательство для листа index: хеши соседей от листа к корню подряд по DIGEST_SIZE байт
+    // (уровни, на которых у узла нет соседа, пропускаются)
+    QByteArray proof(qsizetype index) const;
+    // Проверка листа по доказательству: из листа и соседей вычисляется корень и сравнивается с root
+    static bool verifyProof(const uchar *leafDigest, qsizetype index, qsizetype leafCount,
+                            const QByteArray &proof, const QByteArray &root);
+
+    // Лист для записи хранилища
+    static void leafDigest(const LedgerStore &store, qsizetype index, uchar *out);
+
+    // Индексы записей (по возрастанию), листья которых не совпадают с листьями дерева. Сравниваются
+    // первые min(store.size(), leafCount()) записей; несовпадение числа записей проверяет вызывающий
+    QVector<qsizetype> findTampered(const LedgerStore &store, int threadCount = 0) const;
+
+    // Путь файла дерева для файла накладных
+    static QString sidecarPath(const QString &filePath);
+    bool save(const QString &path, QString &errorMessage) const;
+    // Чтение дерева; false - если файла нет, он повреждён или корень не совпадает с листьями
+    bool load(const QString &path, QString &errorMessage);
+
+    // Уровни меньше этого числа узлов хешируются в одном потоке
+    static const int MIN_PARALLEL_NODES = 16384;
+
+private:
+    // Построение внутренних уровней по листьям levels[0]
+    void buildLevels(int threadCount);
+
+    std::vector<QByteArray> levels;     // levels[0] - листья, последний - корень; DIGEST_SIZE байт на узел
+};
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef PROCESSMEMORY_H
+#define PROCESSMEMORY_H
+
+#include <QtGlobal>
+
+// Объём физической памяти, занимаемой процессом (0, если платформа не сообщает его)
+class ProcessMemory
+{
+public:
+    // Текущий объём
+    static qint64 residentBytes();
+    // Наибольший объём с запуска процесса
+    static qint64 peakResidentBytes();
+};
+
+#endif
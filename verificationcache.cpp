@@ -0,0 +1,220 @@
+#include "verificationcache.h"
+#include "ledgerlog.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QVector>
+#include <QtEndian>
+#include <QtConcurrent/QtConcurrentMap>
+#include <cstring>
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'I', 'N', 'V', 'V', 'C', '0', '0', '1'};
+const quint32 CACHE_VERSION = 2;
+const int CACHE_FIXED_SIZE = 8 + 4 + 4 + 6 * 8 + LedgerStore::HASH_SIZE + 4;
+
+// xxHash64 (Yann Collet): отпечаток со скоростью, близкой к пропускной способности памяти
+const quint64 PRIME1 = 11400714785074694791ULL;
+const quint64 PRIME2 = 14029467366897019727ULL;
+const quint64 PRIME3 = 1609587929392839161ULL;
+const quint64 PRIME4 = 9650029242287828579ULL;
+const quint64 PRIME5 = 2870177450012600261ULL;
+
+inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline quint64 round64(quint64 accumulator, quint64 input)
+{
+    accumulator += input * PRIME2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * PRIME1;
+}
+
+inline quint64 mergeRound(quint64 accumulator, quint64 value)
+{
+    accumulator ^= round64(0, value);
+    return accumulator * PRIME1 + PRIME4;
+}
+
+quint64 xxHash64(const uchar *data, qint64 length, quint64 seed)
+{
+    const uchar *p = data;
+    const uchar *end = data + length;
+    quint64 hash;
+
+    if (length >= 32) {
+        quint64 v1 = seed + PRIME1 + PRIME2;
+        quint64 v2 = seed + PRIME2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - PRIME1;
+        const uchar *limit = end - 32;
+        do {
+            v1 = round64(v1, qFromLittleEndian<quint64>(p));
+            v2 = round64(v2, qFromLittleEndian<quint64>(p + 8));
+            v3 = round64(v3, qFromLittleEndian<quint64>(p + 16));
+            v4 = round64(v4, qFromLittleEndian<quint64>(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+        hash = mergeRound(hash, v1);
+        hash = mergeRound(hash, v2);
+        hash = mergeRound(hash, v3);
+        hash = mergeRound(hash, v4);
+    } else {
+        hash = seed + PRIME5;
+    }
+
+    hash += quint64(length);
+
+    while (p + 8 <= end) {
+        hash ^= round64(0, qFromLittleEndian<quint64>(p));
+        hash = rotateLeft(hash, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        hash ^= quint64(qFromLittleEndian<quint32>(p)) * PRIME1;
+        hash = rotateLeft(hash, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        hash ^= quint64(*p) * PRIME5;
+        hash = rotateLeft(hash, 11) * PRIME1;
+        ++p;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+struct FingerprintBlock
+{
+    const uchar *data;
+    qint64 length;
+    quint64 digest;
+};
+
+}
+
+QString VerificationCache::cachePath(const QString &filePath)
+{
+    return filePath + ".vcache";
+}
+
+bool VerificationCache::read(const QString &filePath, Entry &entry)
+{
+    QFile file(cachePath(filePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const QByteArray data = file.read(64 << 10);
+    const uchar *p = reinterpret_cast<const uchar*>(data.constData());
+    if (data.size() < CACHE_FIXED_SIZE || std::memcmp(p, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+        || qFromLittleEndian<quint32>(p + 8) != CACHE_VERSION) {
+        qCDebug(lcCache) << "VerificationCache::read: Файл кэша повреждён или устарел:" << cachePath(filePath);
+        return false;
+    }
+
+    const quint32 hashAlgorithm = qFromLittleEndian<quint32>(p + 12);
+    if (hashAlgorithm >= LedgerStore::HashAlgorithmCount) {
+        return false;
+    }
+    entry.hashAlgorithm = LedgerStore::HashAlgorithm(hashAlgorithm);
+    entry.fileSize = qFromLittleEndian<qint64>(p + 16);
+    entry.modified = qFromLittleEndian<qint64>(p + 24);
+    entry.regionBegin = qFromLittleEndian<qint64>(p + 32);
+    entry.regionEnd = qFromLittleEndian<qint64>(p + 40);
+    entry.fingerprint = qFromLittleEndian<quint64>(p + 48);
+    entry.verifiedRecords = qFromLittleEndian<qint64>(p + 56);
+    std::memcpy(entry.lastHash, p + 64, LedgerStore::HASH_SIZE);
+    const quint32 pathLength = qFromLittleEndian<quint32>(p + 80);
+    if (data.size() < CACHE_FIXED_SIZE + qint64(pathLength)) {
+        return false;
+    }
+    entry.filePath = QString::fromUtf8(data.constData() + CACHE_FIXED_SIZE, int(pathLength));
+
+    // Кэш, скопированный вместе с другим файлом, не используется
+    if (entry.filePath != QFileInfo(filePath).canonicalFilePath()
+        || entry.regionBegin < 0 || entry.regionEnd < entry.regionBegin || entry.verifiedRecords < 0) {
+        return false;
+    }
+    return true;
+}
+
+bool VerificationCache::write(const QString &filePath, Entry entry, QString &errorMessage)
+{
+    QFileInfo info(filePath);
+    entry.filePath = info.canonicalFilePath();
+    entry.fileSize = info.size();
+    entry.modified = info.lastModified().toMSecsSinceEpoch();
+
+    const QByteArray path = entry.filePath.toUtf8();
+    QByteArray data(CACHE_FIXED_SIZE, '\0');
+    uchar *p = reinterpret_cast<uchar*>(data.data());
+    std::memcpy(p, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    qToLittleEndian<quint32>(CACHE_VERSION, p + 8);
+    qToLittleEndian<quint32>(quint32(entry.hashAlgorithm), p + 12);
+    qToLittleEndian<qint64>(entry.fileSize, p + 16);
+    qToLittleEndian<qint64>(entry.modified, p + 24);
+    qToLittleEndian<qint64>(entry.regionBegin, p + 32);
+    qToLittleEndian<qint64>(entry.regionEnd, p + 40);
+    qToLittleEndian<quint64>(entry.fingerprint, p + 48);
+    qToLittleEndian<qint64>(entry.verifiedRecords, p + 56);
+    std::memcpy(p + 64, entry.lastHash, LedgerStore::HASH_SIZE);
+    qToLittleEndian<quint32>(quint32(path.size()), p + 80);
+    data.append(path);
+
+    QSaveFile file(cachePath(filePath));
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        errorMessage = QString("Не удалось сохранить кэш проверки: %1").arg(file.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool VerificationCache::matches(const Entry &entry, const uchar *data, qint64 size, qint64 modified)
+{
+    if (!data || entry.regionEnd > size) {
+        return false;
+    }
+    // Файл усечён или перезаписан на месте: дописанный файл был бы длиннее
+    if (size < entry.fileSize || (size == entry.fileSize && modified != entry.modified)) {
+        return false;
+    }
+    return fingerprint(data + entry.regionBegin, entry.regionEnd - entry.regionBegin) == entry.fingerprint;
+}
+
+quint64 VerificationCache::fingerprint(const uchar *data, qint64 size)
+{
+    // Блоки хешируются независимо (параллельно), затем хешируются их отпечатки:
+    // изменение любого байта меняет отпечаток своего блока и, следовательно, итоговый
+    QVector<FingerprintBlock> blocks;
+    for (qint64 offset = 0; offset < size; offset += BLOCK_SIZE) {
+        blocks.append({data + offset, qMin<qint64>(BLOCK_SIZE, size - offset), 0});
+    }
+
+    auto hashBlock = [](FingerprintBlock &block) {
+        block.digest = xxHash64(block.data, block.length, 0);
+    };
+    if (blocks.size() == 1) {
+        hashBlock(blocks.first());
+    } else if (blocks.size() > 1) {
+        QtConcurrent::blockingMap(blocks, hashBlock);
+    }
+
+    QByteArray digests(blocks.size() * 8, Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar*>(digests.data());
+    for (int i = 0; i < blocks.size(); ++i) {
+        qToLittleEndian<quint64>(blocks[i].digest, out + i * 8);
+    }
+    return xxHash64(reinterpret_cast<const uchar*>(digests.constData()), digests.size(), quint64(size));
+}
@@ -0,0 +1,54 @@
+#ifndef VERIFICATIONCACHE_H
+#define VERIFICATIONCACHE_H
+
+#include "ledgerstore.h"
+#include <QString>
+#include <QtGlobal>
+
+// Кэш результата проверки цепочки хешей в файле рядом с файлом накладных (<файл>.vcache).
+// Хранит число проверенных записей с начала файла и хеш последней из них вместе с отпечатком
+// участка файла, в котором они находятся. Если при следующем открытии отпечаток этого участка
+// совпадает, записи считаются проверенными, а проверка продолжается с сохранённого хеша:
+// неизменённый файл принимается сразу, у дописанного проверяется только новый хвост.
+// Изменение любого байта внутри участка меняет отпечаток, и запись кэша не используется.
+// Дописывание только увеличивает файл, поэтому файл короче сохранённого или изменённый без
+// изменения размера отвергается по размеру и времени изменения, без вычисления отпечатка.
+class VerificationCache
+{
+public:
+    struct Entry
+    {
+        QString filePath;           // Канонический путь файла накладных
+        qint64 fileSize = 0;        // Размер и время изменения файла при сохранении кэша
+        qint64 modified = 0;        // Мс с начала эпохи
+        qint64 regionBegin = 0;     // Участок файла, покрытый отпечатком: [regionBegin, regionEnd)
+        qint64 regionEnd = 0;
+        quint64 fingerprint = 0;
+        qint64 verifiedRecords = 0; // Число записей с начала файла с проверенной цепочкой
+        // Алгоритм цепочки, которым проверены записи. В .ldg он записан в заголовке вне участка
+        // отпечатка, поэтому сверяется отдельно: записи, проверенные MD5, не подтверждают SHA-256
+        LedgerStore::HashAlgorithm hashAlgorithm = LedgerStore::HashMd5;
+        uchar lastHash[LedgerStore::HASH_SIZE] = {};
+    };
+
+    // Путь файла кэша для файла накладных
+    static QString cachePath(const QString &filePath);
+
+    // Чтение записи кэша; false - если кэша нет, он повреждён или относится к другому файлу
+    static bool read(const QString &filePath, Entry &entry);
+    // Сохранение записи кэша (поля filePath, fileSize и modified заполняются по файлу)
+    static bool write(const QString &filePath, Entry entry, QString &errorMessage);
+
+    // Проверяет, что участок записи кэша целиком входит в данные файла и его отпечаток не изменился.
+    // modified - время изменения файла (мс с начала эпохи): файл короче сохранённого или с тем же
+    // размером, но другим временем изменения отвергается без вычисления отпечатка
+    static bool matches(const Entry &entry, const uchar *data, qint64 size, qint64 modified);
+
+    // Быстрый 64-битный отпечаток данных (xxHash64 по блокам BLOCK_SIZE, блоки считаются параллельно).
+    // Не является криптографическим: защищает от случайных и ручных изменений файла, а не от подбора
+    static quint64 fingerprint(const uchar *data, qint64 size);
+
+    static const int BLOCK_SIZE = 4 << 20;
+};
+
+#endif